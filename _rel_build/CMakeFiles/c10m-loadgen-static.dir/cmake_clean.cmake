@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/c10m-loadgen-static.dir/src/loadgen.c.o"
+  "CMakeFiles/c10m-loadgen-static.dir/src/loadgen.c.o.d"
+  "c10m-loadgen-static"
+  "c10m-loadgen-static.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/c10m-loadgen-static.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
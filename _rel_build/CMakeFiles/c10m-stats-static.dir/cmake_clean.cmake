@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/c10m-stats-static.dir/src/stats.c.o"
+  "CMakeFiles/c10m-stats-static.dir/src/stats.c.o.d"
+  "c10m-stats-static"
+  "c10m-stats-static.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/c10m-stats-static.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
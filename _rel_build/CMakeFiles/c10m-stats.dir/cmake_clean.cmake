@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/c10m-stats.dir/src/stats.c.o"
+  "CMakeFiles/c10m-stats.dir/src/stats.c.o.d"
+  "c10m-stats"
+  "c10m-stats.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/c10m-stats.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
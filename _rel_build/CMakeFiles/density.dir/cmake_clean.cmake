@@ -0,0 +1,8 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/density"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang )
+  include(CMakeFiles/density.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/httpio-static.dir/src/main.c.o"
+  "CMakeFiles/httpio-static.dir/src/main.c.o.d"
+  "httpio-static"
+  "httpio-static.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/httpio-static.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/httpio.dir/src/main.c.o"
+  "CMakeFiles/httpio.dir/src/main.c.o.d"
+  "httpio"
+  "httpio.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/httpio.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
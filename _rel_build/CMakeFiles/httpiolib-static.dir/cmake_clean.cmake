@@ -0,0 +1,33 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/httpiolib-static.dir/src/httpio/bufpool.c.o"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/bufpool.c.o.d"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/coro.c.o"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/coro.c.o.d"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/handler.c.o"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/handler.c.o.d"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/histogram.c.o"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/histogram.c.o.d"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/jobpool.c.o"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/jobpool.c.o.d"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/metrics.c.o"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/metrics.c.o.d"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/poll.c.o"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/poll.c.o.d"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/server.c.o"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/server.c.o.d"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/timer.c.o"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/timer.c.o.d"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/topology.c.o"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/topology.c.o.d"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/trace.c.o"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/trace.c.o.d"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/tuple_socket_inet.c.o"
+  "CMakeFiles/httpiolib-static.dir/src/httpio/tuple_socket_inet.c.o.d"
+  "libhttpiolib-static.a"
+  "libhttpiolib-static.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/httpiolib-static.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,30 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/httpio/bufpool.c" "CMakeFiles/httpiolib.dir/src/httpio/bufpool.c.o" "gcc" "CMakeFiles/httpiolib.dir/src/httpio/bufpool.c.o.d"
+  "/root/repo/src/httpio/coro.c" "CMakeFiles/httpiolib.dir/src/httpio/coro.c.o" "gcc" "CMakeFiles/httpiolib.dir/src/httpio/coro.c.o.d"
+  "/root/repo/src/httpio/handler.c" "CMakeFiles/httpiolib.dir/src/httpio/handler.c.o" "gcc" "CMakeFiles/httpiolib.dir/src/httpio/handler.c.o.d"
+  "/root/repo/src/httpio/histogram.c" "CMakeFiles/httpiolib.dir/src/httpio/histogram.c.o" "gcc" "CMakeFiles/httpiolib.dir/src/httpio/histogram.c.o.d"
+  "/root/repo/src/httpio/jobpool.c" "CMakeFiles/httpiolib.dir/src/httpio/jobpool.c.o" "gcc" "CMakeFiles/httpiolib.dir/src/httpio/jobpool.c.o.d"
+  "/root/repo/src/httpio/metrics.c" "CMakeFiles/httpiolib.dir/src/httpio/metrics.c.o" "gcc" "CMakeFiles/httpiolib.dir/src/httpio/metrics.c.o.d"
+  "/root/repo/src/httpio/poll.c" "CMakeFiles/httpiolib.dir/src/httpio/poll.c.o" "gcc" "CMakeFiles/httpiolib.dir/src/httpio/poll.c.o.d"
+  "/root/repo/src/httpio/server.c" "CMakeFiles/httpiolib.dir/src/httpio/server.c.o" "gcc" "CMakeFiles/httpiolib.dir/src/httpio/server.c.o.d"
+  "/root/repo/src/httpio/timer.c" "CMakeFiles/httpiolib.dir/src/httpio/timer.c.o" "gcc" "CMakeFiles/httpiolib.dir/src/httpio/timer.c.o.d"
+  "/root/repo/src/httpio/topology.c" "CMakeFiles/httpiolib.dir/src/httpio/topology.c.o" "gcc" "CMakeFiles/httpiolib.dir/src/httpio/topology.c.o.d"
+  "/root/repo/src/httpio/trace.c" "CMakeFiles/httpiolib.dir/src/httpio/trace.c.o" "gcc" "CMakeFiles/httpiolib.dir/src/httpio/trace.c.o.d"
+  "/root/repo/src/httpio/tuple_socket_inet.c" "CMakeFiles/httpiolib.dir/src/httpio/tuple_socket_inet.c.o" "gcc" "CMakeFiles/httpiolib.dir/src/httpio/tuple_socket_inet.c.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,198 @@
+#!/bin/bash
+# Measure what an idle keep-alive connection costs httpio, per ioloop x lifecycle.
+#
+#   density.sh HTTPIO LOADGEN [CSV]
+#
+# Ramps up idle connections from c10m-loadgen --idle through STEPS and samples the
+# server at every step: RSS (forked handlers included), the jobpool table, coroutine
+# stacks and buffer pool from its SIGUSR2 usage report, the host's TCP socket
+# buffer memory from /proc/net/sockstat and its kernel slab from /proc/meminfo,
+# where the socket, file and epoll objects of an idle connection live. Every row
+# has the marginal bytes per connection since the step before. The host figures
+# count both ends of a loopback connection, and whatever else runs on the host.
+# select is left out by default, it can't poll past FD_SETSIZE. The environment
+# overrides the defaults below, extra server options go in SERVER_ARGS.
+
+set -u
+
+HTTPIO=${1:?usage: density.sh HTTPIO LOADGEN [CSV]}
+LOADGEN=${2:?usage: density.sh HTTPIO LOADGEN [CSV]}
+CSV=${3:-/dev/stdout}
+
+PORT=${PORT:-18889}
+STEPS=${STEPS:-"1000 2000 4000 8000"}
+IOLOOPS=${IOLOOPS:-"epoll uring"}
+LIFECYCLES=${LIFECYCLES:-"uniprocess threadpool worksteal"}
+SERVER_ARGS=${SERVER_ARGS:-}
+SETTLE=${SETTLE:-5}     # seconds without a new connection before a step gives up
+
+PAGE_SIZE=$(getconf PAGESIZE)
+LAST_STEP=0
+for step in $STEPS; do
+    LAST_STEP=$step
+done
+SOURCES=$(( (LAST_STEP + 19999) / 20000 ))
+
+# wait until the server accepts connections, 1 when it never does
+wait_listening() {
+    tries=50
+    while [ $tries -gt 0 ]; do
+        if ! kill -0 "$1" 2>/dev/null; then
+            return 1
+        fi
+        if (exec 3<>"/dev/tcp/127.0.0.1/$PORT") 2>/dev/null; then
+            return 0
+        fi
+        sleep 0.1
+        tries=$((tries - 1))
+    done
+    return 1
+}
+
+# SIGINT first for a graceful exit, then make sure it is gone
+stop_server() {
+    kill -INT "$1" 2>/dev/null
+    tries=20
+    while [ $tries -gt 0 ] && kill -0 "$1" 2>/dev/null; do
+        sleep 0.1
+        tries=$((tries - 1))
+    done
+    kill -KILL "$1" 2>/dev/null
+    pkill -KILL -P "$1" 2>/dev/null
+    wait "$1" 2>/dev/null
+}
+
+# resident bytes of the server and its forked handlers
+rss_bytes() {
+    kb=0
+    for pid in "$1" $(pgrep -P "$1"); do
+        rss=$(awk '/^VmRSS:/ { print $2 }' "/proc/$pid/status" 2>/dev/null)
+        kb=$((kb + ${rss:-0}))
+    done
+    echo $((kb * 1024))
+}
+
+# fresh usage report of the server, USAGE_* set from it, 1 when none came
+sample_usage() {
+    before=$(wc -l < "$2")
+    kill -USR2 "$1" 2>/dev/null
+    tries=50
+    while [ $tries -gt 0 ]; do
+        if [ "$(wc -l < "$2")" -gt "$before" ]; then
+            line=$(tail -n 1 "$2")
+            USAGE_CONNECTIONS=$(echo "$line" | sed 's/.*connections=\([0-9]*\).*/\1/')
+            USAGE_JOBTABLE=$(echo "$line" | sed 's/.*jobtable_bytes=\([0-9]*\).*/\1/')
+            USAGE_CORO=$(echo "$line" | sed 's/.*coro_stacks=\([0-9]*\).*/\1/')
+            USAGE_BUFFER=$(echo "$line" | sed 's/.*buffer_bytes=\([0-9]*\).*/\1/')
+            return 0
+        fi
+        sleep 0.1
+        tries=$((tries - 1))
+    done
+    return 1
+}
+
+# TCP socket buffer memory of the host in bytes
+sockstat_bytes() {
+    pages=$(awk '/^TCP:/ { for (i = 2; i < NF; i++) if ($i == "mem") print $(i + 1) }' /proc/net/sockstat)
+    echo $((${pages:-0} * PAGE_SIZE))
+}
+
+# kernel slab of the host in bytes
+slab_bytes() {
+    kb=$(awk '/^Slab:/ { print $2 }' /proc/meminfo)
+    echo $((${kb:-0} * 1024))
+}
+
+# bytes per connection between two samples
+marginal() {
+    if [ "$3" -gt 0 ]; then
+        echo $(( ($2 - $1) / $3 ))
+    fi
+}
+
+echo "ioloop,lifecycle,connections,rss_bytes,jobtable_bytes,coro_stacks,buffer_bytes,sock_mem_bytes,slab_bytes,rss_per_conn,jobtable_per_conn,buffer_per_conn,sock_mem_per_conn,slab_per_conn" > "$CSV"
+
+for ioloop in $IOLOOPS; do
+    for lifecycle in $LIFECYCLES; do
+        if [ "$ioloop" = uring ] && [ "$lifecycle" = fork ]; then
+            continue    # not supported, see conf in main.c
+        fi
+
+        log="density_httpio_${ioloop}_${lifecycle}.log"
+        usage="density_httpio_${ioloop}_${lifecycle}.usage"
+        : > "$usage"
+        # the usage reports get a file of their own, the log can grow large under errors,
+        # and the idle connections are held for the whole ramp, past any timeout
+        # shellcheck disable=SC2086
+        "$HTTPIO" --ioloop "$ioloop" --lifecycle "$lifecycle" --port "$PORT" \
+            --header-timeout 0 --idle-timeout 0 $SERVER_ARGS \
+            > >(tee "$log" | grep --line-buffered "poll: usage::" > "$usage") 2>&1 &
+        server=$!
+
+        if ! wait_listening "$server" || ! sample_usage "$server" "$usage"; then
+            echo "density: $ioloop x $lifecycle: server did not start" >&2
+            stop_server "$server"
+            continue
+        fi
+
+        # the connection from wait_listening may still be counted, the baseline is whatever is there
+        prev_conns=$USAGE_CONNECTIONS
+        prev_rss=$(rss_bytes "$server")
+        prev_jobtable=$USAGE_JOBTABLE
+        prev_buffer=$USAGE_BUFFER
+        prev_sock=$(sockstat_bytes)
+        prev_slab=$(slab_bytes)
+        echo "$ioloop,$lifecycle,$prev_conns,$prev_rss,$prev_jobtable,$USAGE_CORO,$prev_buffer,$prev_sock,$prev_slab,,,,," \
+            >> "$CSV"
+
+        loadgens=""
+        opened=0
+        for step in $STEPS; do
+            # every step adds a load generator holding the difference
+            "$LOADGEN" --port "$PORT" --idle --connections $((step - opened)) --sources "$SOURCES" \
+                --duration 86400 > /dev/null 2>&1 &
+            loadgens="$loadgens $!"
+            opened=$step
+
+            # until all are in, or the count stops moving
+            tries=$((SETTLE * 2))
+            seen=$prev_conns
+            while sample_usage "$server" "$usage" && [ "$USAGE_CONNECTIONS" -lt "$step" ] && [ $tries -gt 0 ]; do
+                if [ "$USAGE_CONNECTIONS" -gt "$seen" ]; then
+                    seen=$USAGE_CONNECTIONS
+                    tries=$((SETTLE * 2))
+                fi
+                sleep 0.5
+                tries=$((tries - 1))
+            done
+            if [ "$USAGE_CONNECTIONS" -lt "$step" ]; then
+                echo "density: $ioloop x $lifecycle: $USAGE_CONNECTIONS of $step connections" >&2
+            fi
+
+            rss=$(rss_bytes "$server")
+            sock=$(sockstat_bytes)
+            slab=$(slab_bytes)
+            added=$((USAGE_CONNECTIONS - prev_conns))
+            row="$ioloop,$lifecycle,$USAGE_CONNECTIONS,$rss,$USAGE_JOBTABLE,$USAGE_CORO,$USAGE_BUFFER,$sock,$slab"
+            row="$row,$(marginal "$prev_rss" "$rss" "$added"),$(marginal "$prev_jobtable" "$USAGE_JOBTABLE" "$added")"
+            row="$row,$(marginal "$prev_buffer" "$USAGE_BUFFER" "$added"),$(marginal "$prev_sock" "$sock" "$added")"
+            row="$row,$(marginal "$prev_slab" "$slab" "$added")"
+            echo "density: $row" >&2
+            echo "$row" >> "$CSV"
+
+            prev_conns=$USAGE_CONNECTIONS
+            prev_rss=$rss
+            prev_jobtable=$USAGE_JOBTABLE
+            prev_buffer=$USAGE_BUFFER
+            prev_sock=$sock
+            prev_slab=$slab
+        done
+
+        # shellcheck disable=SC2086
+        kill -INT $loadgens 2>/dev/null
+        # shellcheck disable=SC2086
+        wait $loadgens 2>/dev/null
+        stop_server "$server"
+    done
+done
@@ -0,0 +1,82 @@
+#!/bin/bash
+# Run every ioloop x lifecycle combination of httpio against c10m-loadgen.
+#
+#   matrix.sh HTTPIO LOADGEN [CSV]
+#
+# One CSV row per combination goes to CSV, stdout by default. The environment
+# overrides the defaults below, extra server options go in SERVER_ARGS and extra
+# load generator options in LOADGEN_ARGS.
+
+set -u
+
+HTTPIO=${1:?usage: matrix.sh HTTPIO LOADGEN [CSV]}
+LOADGEN=${2:?usage: matrix.sh HTTPIO LOADGEN [CSV]}
+CSV=${3:-/dev/stdout}
+
+PORT=${PORT:-18888}
+CONNECTIONS=${CONNECTIONS:-64}
+DURATION=${DURATION:-10}
+IOLOOPS=${IOLOOPS:-"accept select epoll uring"}
+LIFECYCLES=${LIFECYCLES:-"uniprocess fork threadpool worksteal"}
+SERVER_ARGS=${SERVER_ARGS:-}
+LOADGEN_ARGS=${LOADGEN_ARGS:-}
+
+# wait until the server accepts connections, 1 when it never does
+wait_listening() {
+    tries=50
+    while [ $tries -gt 0 ]; do
+        if ! kill -0 "$1" 2>/dev/null; then
+            return 1
+        fi
+        if (exec 3<>"/dev/tcp/127.0.0.1/$PORT") 2>/dev/null; then
+            return 0
+        fi
+        sleep 0.1
+        tries=$((tries - 1))
+    done
+    return 1
+}
+
+# SIGINT first for a graceful exit, then make sure it is gone
+stop_server() {
+    kill -INT "$1" 2>/dev/null
+    tries=20
+    while [ $tries -gt 0 ] && kill -0 "$1" 2>/dev/null; do
+        sleep 0.1
+        tries=$((tries - 1))
+    done
+    kill -KILL "$1" 2>/dev/null
+    # forked handlers share the process group of the server
+    pkill -KILL -P "$1" 2>/dev/null
+    wait "$1" 2>/dev/null
+}
+
+echo "ioloop,lifecycle,connections,requests,errors,seconds,rps,p50_us,p90_us,p99_us,p999_us,max_us" > "$CSV"
+
+for ioloop in $IOLOOPS; do
+    for lifecycle in $LIFECYCLES; do
+        if [ "$ioloop" = uring ] && [ "$lifecycle" = fork ]; then
+            continue    # not supported, see conf in main.c
+        fi
+
+        # shellcheck disable=SC2086
+        "$HTTPIO" --ioloop "$ioloop" --lifecycle "$lifecycle" --port "$PORT" $SERVER_ARGS \
+            > "bench_httpio_${ioloop}_${lifecycle}.log" 2>&1 &
+        server=$!
+
+        if ! wait_listening "$server"; then
+            echo "matrix: $ioloop x $lifecycle: server did not start" >&2
+            echo "$ioloop,$lifecycle,$CONNECTIONS,,,,,,,,," >> "$CSV"
+            stop_server "$server"
+            continue
+        fi
+
+        # shellcheck disable=SC2086
+        row=$("$LOADGEN" --port "$PORT" --connections "$CONNECTIONS" --duration "$DURATION" $LOADGEN_ARGS --csv \
+            | tail -n 1)
+        stop_server "$server"
+
+        echo "matrix: $ioloop x $lifecycle: $row" >&2
+        echo "$ioloop,$lifecycle,$CONNECTIONS,$row" >> "$CSV"
+    done
+done
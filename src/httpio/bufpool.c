@@ -0,0 +1,178 @@
+// Buffer pool
+// ===========================================================================
+
+#include "bufpool.h"
+
+// cstd
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+// system
+#include <pthread.h>
+// freestanding
+#include <stdatomic.h>
+
+
+// DEVNOTE: Every thread keeps a few idle buffers per class for the next connection it
+//          serves. A full cache spills half of itself to the class's shared list, an
+//          empty one refills from it, so the lock is taken once per batch. The shared
+//          list keeps at most BUFPOOL_SHARED_BYTES, the rest goes back to malloc and
+//          idle memory stays bounded whatever the peak was.
+#define BUFPOOL_BATCH (BUFPOOL_CACHE_MAX / 2)
+
+struct bufpool_shared {
+    pthread_mutex_t lock;
+    struct iobuf * free;
+    size_t count;
+};
+
+static struct bufpool_shared bufpool_shared[BUFPOOL_CLASSES];
+
+// only touched on malloc and free, the cached paths don't pay for them
+static _Atomic size_t bufpool_allocated_bytes = 0;
+static _Atomic size_t bufpool_shared_bytes = 0;
+
+static _Thread_local struct iobuf * bufpool_cache[BUFPOOL_CLASSES];
+static _Thread_local int bufpool_cache_count[BUFPOOL_CLASSES];
+
+
+__attribute__((constructor))
+static void bufpool_init(void)
+{
+    for (int cls = 0; cls < BUFPOOL_CLASSES; cls++) {
+        if (pthread_mutex_init(&bufpool_shared[cls].lock, NULL) != 0) {
+            perror("bufpool: init: mutex");
+            exit(1);
+        }
+        bufpool_shared[cls].free = NULL;
+        bufpool_shared[cls].count = 0;
+    }
+}
+
+size_t bufpool_class_size(int cls)
+{
+    return (size_t)1 << (BUFPOOL_CLASS_MIN_SHIFT + cls * BUFPOOL_CLASS_STEP_SHIFT);
+}
+
+// move up to BUFPOOL_BATCH buffers from the shared list into the thread's cache
+static void bufpool_refill(int cls)
+{
+    struct bufpool_shared * shared = &bufpool_shared[cls];
+
+    pthread_mutex_lock(&shared->lock);
+    for (int i = 0; i < BUFPOOL_BATCH && NULL != shared->free; i++) {
+        struct iobuf * buf = shared->free;
+        shared->free = buf->nextfree;
+        shared->count -= 1;
+        atomic_fetch_sub_explicit(&bufpool_shared_bytes, buf->size, memory_order_relaxed);
+        buf->nextfree = bufpool_cache[cls];
+        bufpool_cache[cls] = buf;
+        bufpool_cache_count[cls] += 1;
+    }
+    pthread_mutex_unlock(&shared->lock);
+}
+
+// move BUFPOOL_BATCH buffers out of the thread's cache, what the shared list can't keep is freed
+static void bufpool_spill(int cls)
+{
+    struct bufpool_shared * shared = &bufpool_shared[cls];
+    size_t shared_max = BUFPOOL_SHARED_BYTES / bufpool_class_size(cls);
+    struct iobuf * spill = NULL;
+
+    pthread_mutex_lock(&shared->lock);
+    for (int i = 0; i < BUFPOOL_BATCH; i++) {
+        struct iobuf * buf = bufpool_cache[cls];
+        bufpool_cache[cls] = buf->nextfree;
+        bufpool_cache_count[cls] -= 1;
+        if (shared->count < shared_max) {
+            buf->nextfree = shared->free;
+            shared->free = buf;
+            shared->count += 1;
+            atomic_fetch_add_explicit(&bufpool_shared_bytes, buf->size, memory_order_relaxed);
+        } else {
+            buf->nextfree = spill;
+            spill = buf;
+        }
+    }
+    pthread_mutex_unlock(&shared->lock);
+
+    while (NULL != spill) {
+        struct iobuf * buf = spill;
+        spill = buf->nextfree;
+        atomic_fetch_sub_explicit(&bufpool_allocated_bytes, buf->size, memory_order_relaxed);
+        free(buf);
+    }
+}
+
+// a buffer of at least size bytes, NULL with errno when there is none that large
+struct iobuf * bufpool_get(size_t size)
+{
+    int cls = 0;
+
+    while (cls < BUFPOOL_CLASSES && bufpool_class_size(cls) < size) {
+        cls += 1;
+    }
+    if (cls == BUFPOOL_CLASSES) {
+        errno = EMSGSIZE;
+        return NULL;
+    }
+
+    if (NULL == bufpool_cache[cls]) {
+        bufpool_refill(cls);
+    }
+
+    struct iobuf * buf = bufpool_cache[cls];
+    if (NULL != buf) {
+        bufpool_cache[cls] = buf->nextfree;
+        bufpool_cache_count[cls] -= 1;
+    } else {
+        buf = malloc(sizeof(struct iobuf) + bufpool_class_size(cls));
+        if (NULL == buf) {
+            return NULL;
+        }
+        buf->cls = (uint32_t)cls;
+        buf->size = (uint32_t)bufpool_class_size(cls);
+        atomic_fetch_add_explicit(&bufpool_allocated_bytes, buf->size, memory_order_relaxed);
+    }
+    buf->nextfree = NULL;
+
+    return buf;
+}
+
+// the first used bytes of buf in a buffer of at least size, buf itself is let go
+// DEVNOTE: On failure buf stays valid and untouched.
+struct iobuf * bufpool_grow(struct iobuf * buf, size_t used, size_t size)
+{
+    struct iobuf * bigger = bufpool_get(size);
+
+    if (NULL == bigger) {
+        return NULL;
+    }
+    memcpy(bigger->data, buf->data, used);
+    bufpool_put(buf);
+
+    return bigger;
+}
+
+// back to the calling thread's cache, any thread may put a buffer another one got
+void bufpool_put(struct iobuf * buf)
+{
+    int cls = (int)buf->cls;
+
+    if (bufpool_cache_count[cls] == BUFPOOL_CACHE_MAX) {
+        bufpool_spill(cls);
+    }
+    buf->nextfree = bufpool_cache[cls];
+    bufpool_cache[cls] = buf;
+    bufpool_cache_count[cls] += 1;
+}
+
+// data bytes malloc'd for buffers, and of those the ones idle on the shared lists
+// DEVNOTE: Buffers idle in thread caches count as allocated, at most BUFPOOL_CACHE_MAX
+//          per class and thread.
+void bufpool_usage(size_t * allocated, size_t * shared)
+{
+    *allocated = atomic_load_explicit(&bufpool_allocated_bytes, memory_order_relaxed);
+    *shared = atomic_load_explicit(&bufpool_shared_bytes, memory_order_relaxed);
+}
@@ -0,0 +1,64 @@
+#ifndef C10M_JOB__BUFPOOL_H_
+#define C10M_JOB__BUFPOOL_H_
+
+// == includes ==
+
+// freestanding
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+namespace c10m_job {
+#endif
+
+
+#define BUFPOOL_CLASSES 3           // 2KiB, 8KiB, 32KiB
+#define BUFPOOL_CLASS_MIN_SHIFT 11
+#define BUFPOOL_CLASS_STEP_SHIFT 2  // each class is four times the one below
+#define BUFPOOL_CACHE_MAX 32        // idle buffers kept per thread and class
+#define BUFPOOL_SHARED_BYTES (4 * 1024 * 1024)  // idle bytes kept process-wide per class
+
+
+
+// primitive types
+
+// DEVNOTE: A buffer is only held by a connection while there is something in it. The
+//          header sits in front of the data, so a buffer goes back to its class from
+//          nothing but its own pointer.
+struct iobuf {
+    struct iobuf * nextfree;    // thread cache or shared free list
+    uint32_t cls;
+    uint32_t size;              // usable bytes of data
+    _Alignas(16)
+    char data[];
+};
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// protoypes
+
+size_t bufpool_class_size(int cls);
+
+struct iobuf * bufpool_get(size_t size);
+
+struct iobuf * bufpool_grow(struct iobuf * buf, size_t used, size_t size);
+
+void bufpool_put(struct iobuf * buf);
+
+void bufpool_usage(size_t * allocated, size_t * shared);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif // namespace
+
+#endif // C10M_JOB__BUFPOOL_H_
@@ -0,0 +1,227 @@
+// Coroutines
+// ===========================================================================
+
+#define _GNU_SOURCE // MAP_STACK, MAP_NORESERVE
+#include "coro.h"
+
+// cstd
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+// system
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+// DEVNOTE: The switch saves the callee-saved registers on the outgoing stack, stores
+//          the stack pointer, loads the other one and pops its registers back. A new
+//          stack is laid out as if it had been switched out right before entering
+//          coro_trampoline, which hands the coroutine to coro_main. Floating point
+//          control words are left alone, nothing in the server changes them.
+void coro_switch(void ** save_sp, void * load_sp);
+
+#if defined(__x86_64__)
+
+#define CORO_FRAME_WORDS 7  // r15-r12 rbx rbp, trampoline, leaves rsp aligned for its call
+
+__asm__ (
+    ".text\n"
+    ".globl coro_switch\n"
+    ".hidden coro_switch\n"
+    ".type coro_switch, @function\n"
+    "coro_switch:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size coro_switch, .-coro_switch\n"
+    "\n"
+    ".type coro_trampoline, @function\n"
+    "coro_trampoline:\n"
+    "    movq %rbx, %rdi\n"
+    "    callq *%r12\n"
+    "    ud2\n"
+    ".size coro_trampoline, .-coro_trampoline\n"
+);
+
+#elif defined(__aarch64__)
+
+#define CORO_FRAME_WORDS 22 // x19-x30, d8-d15, padded to 16 bytes
+
+__asm__ (
+    ".text\n"
+    ".globl coro_switch\n"
+    ".hidden coro_switch\n"
+    ".type coro_switch, %function\n"
+    "coro_switch:\n"
+    "    sub sp, sp, #176\n"
+    "    stp x19, x20, [sp, #0]\n"
+    "    stp x21, x22, [sp, #16]\n"
+    "    stp x23, x24, [sp, #32]\n"
+    "    stp x25, x26, [sp, #48]\n"
+    "    stp x27, x28, [sp, #64]\n"
+    "    stp x29, x30, [sp, #80]\n"
+    "    stp d8, d9, [sp, #96]\n"
+    "    stp d10, d11, [sp, #112]\n"
+    "    stp d12, d13, [sp, #128]\n"
+    "    stp d14, d15, [sp, #144]\n"
+    "    mov x9, sp\n"
+    "    str x9, [x0]\n"
+    "    mov sp, x1\n"
+    "    ldp x19, x20, [sp, #0]\n"
+    "    ldp x21, x22, [sp, #16]\n"
+    "    ldp x23, x24, [sp, #32]\n"
+    "    ldp x25, x26, [sp, #48]\n"
+    "    ldp x27, x28, [sp, #64]\n"
+    "    ldp x29, x30, [sp, #80]\n"
+    "    ldp d8, d9, [sp, #96]\n"
+    "    ldp d10, d11, [sp, #112]\n"
+    "    ldp d12, d13, [sp, #128]\n"
+    "    ldp d14, d15, [sp, #144]\n"
+    "    add sp, sp, #176\n"
+    "    ret\n"
+    ".size coro_switch, .-coro_switch\n"
+    "\n"
+    ".type coro_trampoline, %function\n"
+    "coro_trampoline:\n"
+    "    mov x0, x19\n"
+    "    blr x20\n"
+    "    brk #0\n"
+    ".size coro_trampoline, .-coro_trampoline\n"
+);
+
+#else
+#error "coro: no context switch for this architecture"
+#endif
+
+void coro_trampoline(void);
+
+
+static _Thread_local struct coro * coro_current = NULL;
+static _Thread_local struct coro * coro_pool = NULL;
+static _Thread_local int coro_pool_count = 0;
+static _Atomic long coro_mapped = 0;    // stacks mapped over all threads, running, suspended or pooled
+
+
+// runs on the coroutine's stack, never returns
+static void coro_main(struct coro * co)
+{
+    co->result = co->fn(co->arg);
+    co->finished = true;
+
+    coro_switch(&co->sp, co->caller_sp);
+}
+
+// lay out the first switch into co, see coro_switch
+static void coro_prepare(struct coro * co)
+{
+    uintptr_t top = (uintptr_t)co & ~(uintptr_t)15;
+    void ** frame = (void **)top - CORO_FRAME_WORDS;
+
+    for (int i = 0; i < CORO_FRAME_WORDS; i++) {
+        frame[i] = NULL;
+    }
+#if defined(__x86_64__)
+    frame[3] = (void *)(uintptr_t)coro_main;        // r12
+    frame[4] = co;                                  // rbx
+    frame[6] = (void *)(uintptr_t)coro_trampoline;  // return address
+#elif defined(__aarch64__)
+    frame[0] = co;                                  // x19
+    frame[1] = (void *)(uintptr_t)coro_main;        // x20
+    frame[11] = (void *)(uintptr_t)coro_trampoline; // x30
+#endif
+
+    co->sp = frame;
+    co->finished = false;
+}
+
+// a pooled stack if the thread has one, else a fresh lazily backed mapping
+struct coro * coro_create(coro_fn fn, void * arg)
+{
+    struct coro * co = coro_pool;
+
+    if (NULL != co) {
+        coro_pool = co->nextfree;
+        coro_pool_count -= 1;
+    } else {
+        size_t guard = (size_t)sysconf(_SC_PAGESIZE);
+        size_t size = guard + CORO_STACK_SIZE;
+        char * base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+        if (base == MAP_FAILED) {
+            perror("coro: mmap: stack");
+            return NULL;
+        }
+        if (mprotect(base, guard, PROT_NONE) == -1) {
+            perror("coro: mprotect: guard");
+            munmap(base, size);
+            return NULL;
+        }
+        co = (struct coro *)(base + size - sizeof(struct coro));
+        atomic_fetch_add_explicit(&coro_mapped, 1, memory_order_relaxed);
+    }
+
+    co->fn = fn;
+    co->arg = arg;
+    co->nextfree = NULL;
+    coro_prepare(co);
+
+    return co;
+}
+
+// back to the calling thread's pool, the stack must not be running
+void coro_destroy(struct coro * co)
+{
+    if (coro_pool_count < CORO_POOL_MAX) {
+        co->nextfree = coro_pool;
+        coro_pool = co;
+        coro_pool_count += 1;
+        return;
+    }
+
+    size_t guard = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = guard + CORO_STACK_SIZE;
+    munmap((char *)co + sizeof(struct coro) - size, size);
+    atomic_fetch_sub_explicit(&coro_mapped, 1, memory_order_relaxed);
+}
+
+// stacks currently mapped, each CORO_STACK_SIZE of address space and backed as far as touched
+long coro_stacks(void)
+{
+    return atomic_load_explicit(&coro_mapped, memory_order_relaxed);
+}
+
+// run co until it yields or returns, not from inside another coroutine
+coro_state_e coro_resume(struct coro * co)
+{
+    coro_current = co;
+    coro_switch(&co->caller_sp, co->sp);
+    coro_current = NULL;
+
+    return co->finished? CORO_FINISHED: CORO_SUSPENDED;
+}
+
+// back to whoever resumed the running coroutine
+void coro_yield(void)
+{
+    struct coro * co = coro_current;
+
+    coro_switch(&co->sp, co->caller_sp);
+}
+
+// the running coroutine, NULL on a thread's own stack
+struct coro * coro_self(void)
+{
+    return coro_current;
+}
@@ -0,0 +1,73 @@
+#ifndef C10M_JOB__CORO_H_
+#define C10M_JOB__CORO_H_
+
+// == includes ==
+
+// freestanding
+#include <stdbool.h>
+#include <stddef.h>
+
+
+#ifdef __cplusplus
+namespace c10m_job {
+#endif
+
+
+#define CORO_STACK_SIZE (64 * 1024) // usable bytes, a guard page sits below
+#define CORO_POOL_MAX 64            // idle stacks cached per thread
+
+typedef enum coro_state_enum {
+    CORO_SUSPENDED,
+    CORO_FINISHED
+} coro_state_e;
+
+
+
+// primitive types
+
+typedef int (*coro_fn)(void * arg);
+
+// DEVNOTE: A coroutine lives at the top of its own stack mapping, below it the stack
+//          grows down towards the guard page. Pages are only backed once touched.
+//          A suspended coroutine may be resumed by any thread, so code running on it
+//          must not keep thread-local addresses (errno included) across a yield.
+struct coro {
+    void * sp;                  // saved stack pointer while switched out
+    void * caller_sp;           // resumer's stack pointer while running
+    coro_fn fn;
+    void * arg;
+    int result;                 // fn's return, once finished
+    bool finished;
+    struct coro * nextfree;     // thread-local stack pool
+};
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// protoypes
+
+struct coro * coro_create(coro_fn fn, void * arg);
+
+void coro_destroy(struct coro * co);
+
+coro_state_e coro_resume(struct coro * co);
+
+void coro_yield(void);
+
+struct coro * coro_self(void);
+
+long coro_stacks(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif // namespace
+
+#endif // C10M_JOB__CORO_H_
@@ -2,8 +2,12 @@
 #include "handler.h"
 
 // local
+#include "coro.h"
 #include "jobpool.h"
+#include "metrics.h"
 #include "server.h"
+#include "topology.h"
+#include "trace.h"
 // libraries
 #include <stdio.h>
 #include <stdlib.h> 
@@ -15,9 +19,11 @@
 // freestanding
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 
 #define HANDLER_PARALLEL_LIMIT 4096
+#define HANDLER_DEQUEUE_BATCH 4
 
 
 
@@ -25,44 +31,125 @@
 /* common */
 /******************************************************************************/
 
-static handler_state_e handler_common_blockio(int connector_socket)
+// serve the connection's requests until it closes, or goes idle between requests
+// DEVNOTE: Pipelined requests are answered as they are parsed and the responses go out
+//          together once nothing more is buffered. On a coroutine, a keep-alive connection
+//          with an empty buffer returns tracked and waits for its next request without
+//          holding a stack or a buffer. That relies on the poller reporting the rearmed
+//          fd again, which every backend does, the accept one through its rearmed list.
+static handler_state_e handler_common_serve(struct jobnode * job, struct server_http_request * request,
+                                            struct server_http_response * response)
 {
     server_state_e state = SERVER_ERROR;
-    struct server_http_request request = {0};
     int keep_alive = 0;
 
-    // Note: SERVER_OK is not a valid returt code for process_request
-    state = server_http_process_request(connector_socket, &request);
-    switch (state) {
-        case SERVER_ERROR:        
-            break; // TODO: How to handle this?
-        case SERVER_CLIENT_KEEPALIVE:
-            keep_alive = 1;
-            break;
-        case SERVER_CLIENT_CLOSE_REQ:
-            keep_alive = 0;
-            break;
-        case SERVER_CLIENT_CLOSED:
-        case SERVER_CLIENT_ERROR:
-        default:
+    do {
+        // Note: SERVER_OK is not a valid returt code for process_request
+        state = server_http_process_request(job, request, false);
+        if (state == SERVER_CLIENT_IDLE) {
+            if (server_http_response_flush(job, response) != SERVER_OK) {
+                return HANDLER_ERROR;
+            }
+            if (request->len == 0 && NULL != coro_self()) {
+                return HANDLER_TRACK_CONNECTOR;
+            }
+            state = server_http_process_request(job, request, true);
+        }
+
+        switch (state) {
+            case SERVER_ERROR:
+                keep_alive = 0; // malformed, answered with its error status
+                break;
+            case SERVER_CLIENT_KEEPALIVE:
+                keep_alive = 1;
+                break;
+            case SERVER_CLIENT_CLOSE_REQ:
+                keep_alive = 0;
+                break;
+            case SERVER_CLIENT_CLOSED:
+                // a client may shut down its side right after pipelining
+                server_http_response_flush(job, response);
+                return HANDLER_UNTRACK_CONNECTOR;
+            case SERVER_CLIENT_ERROR:
+            default:
+                return HANDLER_ERROR;
+        }
+
+        state = server_http_process_response(job, request, response);
+        if (state != SERVER_OK) {
             return HANDLER_ERROR;
+        }
+
+        server_http_request_next(request);
+    } while (keep_alive);
+
+    state = server_http_response_flush(job, response);
+
+    return (state == SERVER_OK)? HANDLER_UNTRACK_CONNECTOR: HANDLER_ERROR;
+}
+
+static handler_state_e handler_common_blockio(struct jobnode * job)
+{
+    struct server_http_request request;
+    struct server_http_response response;
+
+    server_http_request_init(&request);
+    server_http_response_init(&response);
+
+    handler_state_e state = handler_common_serve(job, &request, &response);
+    server_http_request_release(&request);
+
+    return state;
+}
+
+static int handler_common_entry(void * param)
+{
+    return handler_common_blockio(param);
+}
+
+// run or resume the job's handler on its coroutine, suspended handlers stay tracked
+static handler_state_e handler_common_run(struct jobnode * job)
+{
+    uint64_t start_ns = metrics_now_ns();
+
+    metrics_add(METRIC_JOBS_RUN, 1);
+    metrics_record(METRIC_DEQUEUE_WAIT_NS, start_ns - job->queued_ns);
+    trace_record(job->trace_id, TRACE_DEQUEUED, 0);
+
+    // idle past its deadline, a suspended handler finds out in job_wait instead
+    if (job->expired && NULL == job->coro) {
+        trace_record(job->trace_id, TRACE_RETURNED, 0);
+        return HANDLER_ERROR;
     }
 
+    if (NULL == job->coro) {
+        job->coro = coro_create(handler_common_entry, job);
+        if (NULL == job->coro) {
+            trace_record(job->trace_id, TRACE_RETURNED, 0);
+            return HANDLER_ERROR;
+        }
+    }
 
-    state = server_http_process_response(connector_socket, &request);
-    if (state != SERVER_OK) {
-        return state;
+    coro_state_e coro_state = coro_resume(job->coro);
+    metrics_record(METRIC_HANDLER_NS, metrics_now_ns() - start_ns);
+    if (coro_state == CORO_SUSPENDED) {
+        trace_record(job->trace_id, TRACE_RETURNED, 1);
+        return HANDLER_TRACK_CONNECTOR;
     }
 
-    return (keep_alive? HANDLER_TRACK_CONNECTOR: HANDLER_UNTRACK_CONNECTOR) ;
+    handler_state_e state = job->coro->result;
+    coro_destroy(job->coro);
+    job->coro = NULL;
+    trace_record(job->trace_id, TRACE_RETURNED, state == HANDLER_TRACK_CONNECTOR);
+
+    return state;
 }
 
 
-int handler_common_init(void *(*start_routine) (void *), int affinity)
+int handler_common_init(void *(*start_routine) (void *), void * param, int affinity)
 {
     pthread_t thread;
     pthread_attr_t attr;
-    cpu_set_t cpuset;
     int ret;
 
     ret = pthread_attr_init(&attr);
@@ -73,25 +160,22 @@ int handler_common_init(void *(*start_routine) (void *), int affinity)
 
     ret = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
     if (ret != 0) {
-        // TODO: free up attr
         perror("handler: common-init: detach");
+        pthread_attr_destroy(&attr);
         return -1;
     }
 
-    if (affinity >= 0) {
-        CPU_ZERO(&cpuset);
-        CPU_SET(affinity, &cpuset);
-        ret = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset);
-        if (ret != 0) {
-            perror("handler: common-init: affinity");
-            return -1;
-        }
+    // the thread starts out on its cpu, before it touches any memory
+    ret = topology_attr_set(&attr, affinity);
+    if (ret != 0) {
+        pthread_attr_destroy(&attr);
+        return -1;
     }
 
-    ret = pthread_create(&thread, &attr, start_routine, NULL);
+    ret = pthread_create(&thread, &attr, start_routine, param);
     if (ret != 0) {
-        // TODO: free up attr
         perror("handler: common-init: create");
+        pthread_attr_destroy(&attr);
         return -1;
     }
 
@@ -113,27 +197,33 @@ static sig_atomic_t handler_run = true;
 
 static void * handler_process_uniprocess(void * param)
 {
-    (void)param;
+    struct jobpool * pool = param;
 
     printf("Started thread\n");
+    metrics_attach(METRICS_WORKER);
     
+    int spin = JOBPOOL_SPIN_MIN;
+
     while(handler_run) {
-        // get a pending job
-        struct jobnode * job = jobq_active_dequeue();
-        if (NULL == job) {
-            usleep(10000); // TODO: change deprecated api
+        // get a few pending jobs at once, parks when there are none
+        struct jobnode * jobs[HANDLER_DEQUEUE_BATCH];
+        int count = jobq_active_wait_batch(pool, jobs, HANDLER_DEQUEUE_BATCH, &spin);
+        if (count == 0) {
             continue;
         }
 
-        handler_state_e state = handler_common_blockio(job->sockfd);
-        switch(state) {
-            case HANDLER_TRACK_CONNECTOR:
-                atomic_store(&job->state, JOB_BLOCKED);
-                break;
-            case HANDLER_UNTRACK_CONNECTOR:
-            case HANDLER_ERROR:
-            default:
-                atomic_store(&job->state, JOB_DONE);
+        for (int i = 0; i < count; i++) {
+            struct jobnode * job = jobs[i];
+            handler_state_e state = handler_common_run(job);
+            switch(state) {
+                case HANDLER_TRACK_CONNECTOR:
+                    job_block(job);
+                    break;
+                case HANDLER_UNTRACK_CONNECTOR:
+                case HANDLER_ERROR:
+                default:
+                    job_done(job);
+            }
         }
 
     }
@@ -143,13 +233,15 @@ static void * handler_process_uniprocess(void * param)
     return NULL;
 }
 
-handler_state_e handler_init_uniprocess(void)
+handler_state_e handler_init_uniprocess(struct jobpool * pool, int threads)
 {
     int ret = -1;
 
+    (void)threads;
+
     printf("Uniprocess init\n");
 
-    ret = handler_common_init(handler_process_uniprocess, -1);
+    ret = handler_common_init(handler_process_uniprocess, pool, topology_worker_next(pool->cpu));
 
     return (ret == 0)? HANDLER_OK: HANDLER_ERROR;
 }
@@ -173,46 +265,56 @@ struct handler_lifecycle handler_uniprocess = {
 /******************************************************************************/
 static void * handler_process_fork(void * param)
 {
-    (void)param;
+    struct jobpool * pool = param;
 
     signal(SIGCHLD, SIG_IGN); // TODO: Ignore sigchild in a better way
+    metrics_attach(METRICS_WORKER);
 
     // TODO: warn: parallel limit is not enforced
 
+    int spin = JOBPOOL_SPIN_MIN;
+
     while(handler_run) {
-        // get a pending job
-        struct jobnode * job = jobq_active_dequeue();
-        if (NULL == job) {
-            usleep(10000); // TODO: change deprecated api
+        // get a pending job, parks when there are none
+        struct jobnode * job = NULL;
+        if (jobq_active_wait_batch(pool, &job, 1, &spin) == 0) {
             continue;
         }   
 
+        metrics_add(METRIC_JOBS_RUN, 1);
+        metrics_record(METRIC_DEQUEUE_WAIT_NS, metrics_now_ns() - job->queued_ns);
+        trace_record(job->trace_id, TRACE_DEQUEUED, 0);
         if (!fork()) { // this is the child process
+            // its writes would race the parent's on the same slot, children go uncounted
+            metrics_detach();
             // TODO: close the server socket on the child side
             //close(server_socket); // child doesn't need the server
 
             // doesn't make sense for a process not to handle keep-alive
             handler_state_e state = HANDLER_ERROR;
             do {
-                state = handler_common_blockio(job->sockfd);
+                state = handler_common_blockio(job);
             } while(state == HANDLER_TRACK_CONNECTOR); 
 
             exit(EXIT_SUCCESS); // TODO: handle error conditions
         } else { // this is the parent process
             // since keepalive is done in process context,
             // no need to keep the client socket open here            
-            atomic_store(&job->state, JOB_DONE);
+            trace_record(job->trace_id, TRACE_RETURNED, 0);
+            job_done(job);
         }
     }
 
     return NULL; 
 }
 
-handler_state_e handler_init_fork(void)
+handler_state_e handler_init_fork(struct jobpool * pool, int threads)
 {
     int ret = -1;
 
-    ret = handler_common_init(handler_process_fork, -1);
+    (void)threads;
+
+    ret = handler_common_init(handler_process_fork, pool, topology_worker_next(pool->cpu));
 
     return (ret == 0)? HANDLER_OK: HANDLER_ERROR;
 }
@@ -235,22 +337,93 @@ struct handler_lifecycle handler_fork = {
 
 
 
-handler_state_e handler_init_threadpool(void)
+handler_state_e handler_init_threadpool(struct jobpool * pool, int threads)
 {
 
     int ret = -1;
+    long num_threads = threads;
 
-    // Get total available cores
-    long num_threads = sysconf(_SC_NPROCESSORS_ONLN); // get the number of cpus available
-    if (num_threads < 0) {
-        perror("Could not get the number of availble cores");
-        return HANDLER_ERROR;
+    if (num_threads <= 0) {
+        // Get total available cores
+        num_threads = sysconf(_SC_NPROCESSORS_ONLN); // get the number of cpus available
+        if (num_threads < 0) {
+            perror("Could not get the number of availble cores");
+            return HANDLER_ERROR;
+        }
+        num_threads = (num_threads > 1)? num_threads - 1: num_threads; // reserve one thread for the ioloop if possible
     }
-    num_threads = (num_threads > 1)? num_threads - 1: num_threads; // reserve one thread for the ioloop if possible
 
     // Creae thread pool
     for (int i = 0; i < num_threads; i++) {
-        ret = handler_common_init(handler_process_uniprocess, -1);
+        ret = handler_common_init(handler_process_uniprocess, pool, topology_worker_next(pool->cpu));
+        if (ret != 0) {
+            return HANDLER_ERROR;
+        }    
+    }
+
+    return HANDLER_OK;
+}
+
+
+/******************************************************************************/
+/* work-stealing */
+/******************************************************************************/
+
+static void * handler_process_worksteal(void * param)
+{
+    struct jobworker * worker = param;
+
+    printf("Started thread %d\n", worker->id);
+    metrics_attach(METRICS_WORKER);
+
+    int spin = JOBPOOL_SPIN_MIN;
+
+    while(handler_run) {
+        // own jobs first, somebody else's when idle, parks when there are none
+        struct jobnode * job = jobq_worker_wait(worker, &spin);
+        if (NULL == job) {
+            continue;
+        }
+
+        handler_state_e state = handler_common_run(job);
+        switch(state) {
+            case HANDLER_TRACK_CONNECTOR:
+                job_block(job);
+                break;
+            case HANDLER_UNTRACK_CONNECTOR:
+            case HANDLER_ERROR:
+            default:
+                job_done(job);
+        }
+    }
+
+    printf("Stopped thread %d\n", worker->id);
+
+    return NULL;
+}
+
+handler_state_e handler_init_worksteal(struct jobpool * pool, int threads)
+{
+    int ret = -1;
+    long num_threads = threads;
+
+    if (num_threads <= 0) {
+        num_threads = sysconf(_SC_NPROCESSORS_ONLN); // get the number of cpus available
+        if (num_threads < 0) {
+            perror("Could not get the number of availble cores");
+            return HANDLER_ERROR;
+        }
+        num_threads = (num_threads > 1)? num_threads - 1: num_threads; // reserve one thread for the ioloop if possible
+    }
+
+    // DEVNOTE: the ioloop dispatches to the workers as soon as they are attached
+    ret = jobpool_workers_init(pool, (int)num_threads);
+    if (ret != 0) {
+        return HANDLER_ERROR;
+    }
+
+    for (int i = 0; i < num_threads; i++) {
+        ret = handler_common_init(handler_process_worksteal, &pool->workers[i], topology_worker_next(pool->cpu));
         if (ret != 0) {
             return HANDLER_ERROR;
         }    
@@ -271,6 +444,9 @@ int handler_lifecycle_get(handler_lifecycle_e type, struct handler_lifecycle * h
     } else if  (type == PROCESS_THREADPOOL) {
         hl->init = handler_init_threadpool;
         hl->deinit = handler_deinit_uniprocess;
+    } else if  (type == PROCESS_WORKSTEAL) {
+        hl->init = handler_init_worksteal;
+        hl->deinit = handler_deinit_uniprocess;
     } else {
         return -1;
     }
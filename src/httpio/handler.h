@@ -20,7 +20,8 @@ typedef enum handler_state_enum {
 typedef enum handler_lifecycle_enum {
    PROCESS_UNIPROCESS,
    PROCESS_FORK,
-   PROCESS_THREADPOOL
+   PROCESS_THREADPOOL,
+   PROCESS_WORKSTEAL
 } handler_lifecycle_e;
 
 
@@ -30,8 +31,12 @@ typedef handler_state_e (*handler_process_fn)(int server_socket, int connector_s
 
 // aggregate types
 
+struct jobpool;
+
+// DEVNOTE: init is called once per jobpool shard, workers only take jobs from that shard.
+//          threads <= 0 lets the lifecycle pick its own worker count.
 struct handler_lifecycle {
-    handler_state_e (*init)(void);
+    handler_state_e (*init)(struct jobpool * pool, int threads);
     handler_state_e (*deinit)(void);
 };
 
@@ -0,0 +1,159 @@
+// Latency histogram
+// ===========================================================================
+
+#include "histogram.h"
+
+// cstd
+#include <string.h>
+
+
+// bucket of value, values past the range land in the last one
+static size_t histogram_index(uint64_t value)
+{
+    if (value < HISTOGRAM_SUB_COUNT) {
+        return (size_t)value;
+    }
+
+    int msb = 63 - __builtin_clzll(value);
+    if (msb > HISTOGRAM_MAX_SHIFT) {
+        return HISTOGRAM_COUNTS - 1;
+    }
+
+    // value >> shift lands in [HALF_COUNT, SUB_COUNT)
+    int shift = msb - (HISTOGRAM_SUB_SHIFT - 1);
+
+    return HISTOGRAM_SUB_COUNT + (size_t)(shift - 1) * HISTOGRAM_HALF_COUNT +
+           (size_t)((value >> shift) - HISTOGRAM_HALF_COUNT);
+}
+
+// highest value counted in bucket idx
+static uint64_t histogram_value(size_t idx)
+{
+    if (idx < HISTOGRAM_SUB_COUNT) {
+        return idx;
+    }
+
+    size_t k = idx - HISTOGRAM_SUB_COUNT;
+    int shift = (int)(k / HISTOGRAM_HALF_COUNT) + 1;
+    uint64_t mantissa = k % HISTOGRAM_HALF_COUNT + HISTOGRAM_HALF_COUNT;
+
+    return ((mantissa + 1) << shift) - 1;
+}
+
+
+void histogram_init(struct histogram * h)
+{
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void histogram_record(struct histogram * h, uint64_t value)
+{
+    h->counts[histogram_index(value)] += 1;
+    h->total += 1;
+    h->min = (value < h->min)? value: h->min;
+    h->max = (value > h->max)? value: h->max;
+}
+
+void histogram_merge(struct histogram * dst, const struct histogram * src)
+{
+    for (size_t i = 0; i < HISTOGRAM_COUNTS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->min = (src->min < dst->min)? src->min: dst->min;
+    dst->max = (src->max > dst->max)? src->max: dst->max;
+}
+
+// the value pct percent of the records are at or below, 0 when there are none
+// DEVNOTE: Reported as the top of its bucket and clamped to the exact max, so the
+//          error is always an over-estimate.
+uint64_t histogram_percentile(const struct histogram * h, double pct)
+{
+    if (h->total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(pct / 100.0 * (double)h->total + 0.5);
+    rank = (rank == 0)? 1: (rank > h->total)? h->total: rank;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_COUNTS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t value = histogram_value(i);
+            return (value > h->max)? h->max: value;
+        }
+    }
+
+    return h->max;
+}
+
+double histogram_mean(const struct histogram * h)
+{
+    double sum = 0;
+
+    if (h->total == 0) {
+        return 0;
+    }
+    for (size_t i = 0; i < HISTOGRAM_COUNTS; i++) {
+        if (h->counts[i] > 0) {
+            // the middle of the bucket
+            uint64_t hi = histogram_value(i);
+            uint64_t lo = (i == 0)? 0: histogram_value(i - 1) + 1;
+            sum += (double)h->counts[i] * ((double)lo + (double)hi) / 2.0;
+        }
+    }
+
+    return sum / (double)h->total;
+}
+
+// first percentile to print after pct, five steps in every halving of what is left
+static double histogram_next_tick(double pct)
+{
+    double base = 0.0;
+    double half = 50.0;
+
+    while (pct >= base + half && half > 1e-9) {
+        base += half;
+        half /= 2.0;
+    }
+    double step = half / 5.0;
+
+    return base + step * ((double)(long)((pct - base) / step) + 1.0);   // non-negative, the cast floors
+}
+
+// percentile distribution in the HdrHistogram text format, values divided by unit
+int histogram_print(const struct histogram * h, FILE * out, double unit)
+{
+    if (fprintf(out, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)") < 0) {
+        return -1;
+    }
+
+    uint64_t seen = 0;
+    double next = 0.0;
+    for (size_t i = 0; i < HISTOGRAM_COUNTS && seen < h->total; i++) {
+        if (h->counts[i] == 0) {
+            continue;
+        }
+        seen += h->counts[i];
+        double pct = 100.0 * (double)seen / (double)h->total;
+        if (pct < next && seen < h->total) {
+            continue;
+        }
+
+        uint64_t value = histogram_value(i);
+        value = (value > h->max)? h->max: value;
+        if (seen < h->total) {
+            fprintf(out, "%12.3f %2.12f %10llu %14.2f\n", (double)value / unit, pct / 100.0,
+                    (unsigned long long)seen, 1.0 / (1.0 - pct / 100.0));
+        } else {
+            fprintf(out, "%12.3f %2.12f %10llu\n", (double)value / unit, 1.0, (unsigned long long)seen);
+        }
+        next = histogram_next_tick(pct);
+    }
+
+    fprintf(out, "#[Mean    = %12.3f, Max     = %12.3f]\n", histogram_mean(h) / unit, (double)h->max / unit);
+
+    return (fprintf(out, "#[Total count    = %12llu]\n", (unsigned long long)h->total) < 0)? -1: 0;
+}
@@ -0,0 +1,69 @@
+#ifndef C10M_BENCH__HISTOGRAM_H_
+#define C10M_BENCH__HISTOGRAM_H_
+
+// == includes ==
+
+// freestanding
+#include <stddef.h>
+#include <stdint.h>
+// libraries
+#include <stdio.h>
+
+
+#ifdef __cplusplus
+namespace c10m_bench {
+#endif
+
+
+#define HISTOGRAM_SUB_SHIFT 8       // 256 linear sub-buckets, under 0.8% relative error
+#define HISTOGRAM_MAX_SHIFT 42      // values up to 2^42, over an hour in nanoseconds
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_SHIFT)
+#define HISTOGRAM_HALF_COUNT (HISTOGRAM_SUB_COUNT / 2)
+#define HISTOGRAM_COUNTS (HISTOGRAM_SUB_COUNT + \
+                          (HISTOGRAM_MAX_SHIFT - HISTOGRAM_SUB_SHIFT + 1) * HISTOGRAM_HALF_COUNT)
+
+
+
+// primitive types
+
+// DEVNOTE: Log-linear like HdrHistogram. Values below HISTOGRAM_SUB_COUNT are counted
+//          exactly, every power of two above is split into HISTOGRAM_HALF_COUNT equal
+//          buckets. Fixed size and no allocation, record is a shift and an add. Not
+//          thread-safe, keep one per thread and merge them.
+struct histogram {
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    uint64_t counts[HISTOGRAM_COUNTS];
+};
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// protoypes
+
+void histogram_init(struct histogram * h);
+
+void histogram_record(struct histogram * h, uint64_t value);
+
+void histogram_merge(struct histogram * dst, const struct histogram * src);
+
+uint64_t histogram_percentile(const struct histogram * h, double pct);
+
+double histogram_mean(const struct histogram * h);
+
+int histogram_print(const struct histogram * h, FILE * out, double unit);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif // namespace
+
+#endif // C10M_BENCH__HISTOGRAM_H_
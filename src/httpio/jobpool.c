@@ -5,90 +5,220 @@
 
 #include "jobpool.h"
 
+// local
+#include "coro.h"
+#include "metrics.h"
+#include "poll.h"
+#include "trace.h"
 // cstd
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 // system
+#include <linux/errqueue.h>
+#include <linux/futex.h>
+#include <netinet/in.h>
 #include <pthread.h>
+#include <sys/poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
 #include <unistd.h>
 
 
-struct jobpool {
-    struct jobnode * free_pool;         // flock
-    struct jobnode * * blocking_map;    // flock read, write ???
-    struct jobnode * active_queue_front;    // qlock
-    struct jobnode * active_queue_rear;     // qlock
-    int free_count;     // flock
-    int queue_count;    // qlock
-    int size;           // immutable
-    pthread_spinlock_t flock; // DEVNOTE: Using spinlock since I don't want context switch in case of wait
-    pthread_spinlock_t qlock; // DEVNOTE: Using spinlock since I don't want context switch in case of wait
-} _jobpool = {
-    .free_pool = NULL, 
-    .blocking_map = NULL, 
-    .active_queue_front = NULL, 
-    .active_queue_rear = NULL, 
-    .free_count = 0, 
-    .queue_count = 0, 
-    .size = 0};
+#define JOBPOOL_CHUNK_SHIFT 10
+#define JOBPOOL_CHUNK_SIZE (1 << JOBPOOL_CHUNK_SHIFT)  // jobnodes per table chunk
+#define JOBPOOL_QUEUE_MAX ((size_t)1 << 20)  // active ring cap, power of two
+#define JOBPOOL_DEQUE_SIZE 1024  // power of two
+#define JOBPOOL_PARK_TIMEOUT_NS 100000000   // parked workers re-check for shutdown
 
+#if defined(__x86_64__) || defined(__i386__)
+#define JOBPOOL_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define JOBPOOL_CPU_RELAX() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define JOBPOOL_CPU_RELAX() do {} while (0)
+#endif
 
-// TODO: counterpart destroy function
-int jobpool_init(int size)
+
+// DEVNOTE: File descriptors are process-wide, so is the table. Shards accept into
+//          disjoint fds of the same table and tag the nodes they own. The directory
+//          is sized once for the fd limit, chunks are allocated on first use of their
+//          fd range and published with a release store, never moved or freed while
+//          the server runs. Lookups are an acquire load and an index.
+struct jobtab {
+    struct jobnode * _Atomic * chunks;  // immutable directory, entries set once
+    int capacity;                       // immutable, fds below it have a node
+    int chunk_count;                    // immutable
+    _Atomic int used;                   // live connections over all shards
+    _Atomic int chunks_used;            // chunks allocated so far
+    pthread_mutex_t grow_lock;          // serialises chunk allocation only
+};
+
+static struct jobtab _jobtab = { NULL, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+
+static size_t jobpool_zerocopy_min = 0;    // set once before the workers start
+static unsigned long jobpool_timeouts[JOB_TIMEOUT_KINDS];   // ms, 0 for none, set once before the workers start
+
+
+// capacity <= 0 sizes the table for RLIMIT_NOFILE, raising the soft limit to the hard one
+int jobpool_table_init(int capacity)
 {
-    struct jobnode * jobs = malloc(sizeof(struct jobnode) * size);
-    if (NULL == jobs) { 
-        perror("jobpool: malloc: allocating jobs");
-        return -1;
+    if (NULL != _jobtab.chunks) {
+        return 0;
     }
-    
-    _jobpool.blocking_map = malloc(sizeof(struct jobnode *) * size);
-    if (NULL == jobs) {
-        free(jobs);
-        perror("jobpool: malloc: allocating map");
+
+    if (capacity <= 0) {
+        struct rlimit lim;
+        if (getrlimit(RLIMIT_NOFILE, &lim) == -1) {
+            perror("jobpool: getrlimit");
+            return -1;
+        }
+        if (lim.rlim_cur < lim.rlim_max) {
+            lim.rlim_cur = lim.rlim_max;
+            if (setrlimit(RLIMIT_NOFILE, &lim) == -1) {
+                perror("jobpool: setrlimit"); // keep going with the soft limit
+                getrlimit(RLIMIT_NOFILE, &lim);
+            }
+        }
+        capacity = (lim.rlim_cur == RLIM_INFINITY || lim.rlim_cur > INT_MAX - JOBPOOL_CHUNK_SIZE)?
+                INT_MAX - JOBPOOL_CHUNK_SIZE: (int)lim.rlim_cur;
+    }
+
+    int chunk_count = (capacity + JOBPOOL_CHUNK_SIZE - 1) / JOBPOOL_CHUNK_SIZE;
+    struct jobnode * _Atomic * chunks = calloc((size_t)chunk_count, sizeof(*chunks));
+    if (NULL == chunks) {
+        perror("jobpool: calloc: allocating table");
         return -1;
     }
 
-    for (int i = 0; i < size - 1; i++) {
-        jobs[i].nextfree = &jobs[i+1];
-        jobs[i].state = JOB_UNINITED;
-        _jobpool.blocking_map[i] = NULL;
+    _jobtab.chunk_count = chunk_count;
+    _jobtab.capacity = capacity;
+    _jobtab.chunks = chunks;
+
+    return 0;
+}
+
+int jobpool_table_capacity(void)
+{
+    return _jobtab.capacity;
+}
+
+int jobpool_table_used(void)
+{
+    return atomic_load_explicit(&_jobtab.used, memory_order_relaxed);
+}
+
+// bytes of the directory and the chunks allocated so far, chunks are never freed
+size_t jobpool_table_bytes(void)
+{
+    size_t chunks = (size_t)atomic_load_explicit(&_jobtab.chunks_used, memory_order_relaxed);
+
+    return sizeof(struct jobnode * _Atomic) * (size_t)_jobtab.chunk_count +
+           sizeof(struct jobnode) * JOBPOOL_CHUNK_SIZE * chunks;
+}
+
+static struct jobnode * jobpool_table_slot(int sockfd)
+{
+    if (sockfd < 0 || sockfd >= _jobtab.capacity) {
+        return NULL;
+    }
+
+    struct jobnode * chunk = atomic_load_explicit(&_jobtab.chunks[sockfd >> JOBPOOL_CHUNK_SHIFT],
+            memory_order_acquire);
+    if (NULL == chunk) {
+        return NULL;
     }
-    jobs[size - 1].next = NULL;
-    _jobpool.blocking_map[size - 1] = NULL;
 
-    _jobpool.free_pool = jobs;
-    _jobpool.free_count = size;
-    _jobpool.size = size;
+    return &chunk[sockfd & (JOBPOOL_CHUNK_SIZE - 1)];
+}
 
-    int ret = -1;
-    ret = pthread_spin_init(&_jobpool.flock, PTHREAD_PROCESS_PRIVATE);
-    if (ret != 0) {
-        free(jobs);
-        free(_jobpool.blocking_map);
-        perror("jobpool: pthread_spin_init: freepool");
+static struct jobnode * jobpool_table_grow(int sockfd)
+{
+    struct jobnode * _Atomic * entry = &_jobtab.chunks[sockfd >> JOBPOOL_CHUNK_SHIFT];
+    struct jobnode * chunk = NULL;
+
+    if (pthread_mutex_lock(&_jobtab.grow_lock) != 0) goto EXIT;
+
+    chunk = atomic_load_explicit(entry, memory_order_relaxed);
+    if (NULL == chunk) {
+        chunk = malloc(sizeof(struct jobnode) * JOBPOOL_CHUNK_SIZE);
+        if (NULL != chunk) {
+            int base = sockfd & ~(JOBPOOL_CHUNK_SIZE - 1);
+            for (int i = 0; i < JOBPOOL_CHUNK_SIZE; i++) {
+                chunk[i].sockfd = base + i;
+                atomic_init(&chunk[i].pool, NULL);
+                atomic_init(&chunk[i].state, JOB_UNINITED);
+                atomic_init(&chunk[i].deadline_ms, UINT64_MAX);
+                chunk[i].timer.pprev = NULL;
+            }
+            atomic_store_explicit(entry, chunk, memory_order_release);
+            atomic_fetch_add_explicit(&_jobtab.chunks_used, 1, memory_order_relaxed);
+        }
+    }
+
+    if (pthread_mutex_unlock(&_jobtab.grow_lock) != 0) goto EXIT;
+
+    return (NULL == chunk)? NULL: &chunk[sockfd & (JOBPOOL_CHUNK_SIZE - 1)];
+
+EXIT:
+    perror("jobpool: grow - mutex lock/unlock failed");
+    exit(1); // lock only fails in case of a dead lock, no recovery for that case
+    return NULL;
+}
+
+// TODO: counterpart destroy function
+int jobpool_init(struct jobpool * pool)
+{
+    if (NULL == _jobtab.chunks && jobpool_table_init(0) == -1) {
         return -1;
     }
 
-    ret = pthread_spin_init(&_jobpool.qlock, PTHREAD_PROCESS_PRIVATE);
-    if (ret != 0) {
-        free(jobs);
-        free(_jobpool.blocking_map);
-        pthread_spin_destroy(&_jobpool.flock); // TODO: even if spin destroy fails, can't do anything about it
-        perror("jobpool: pthread_spin_init: queue");
+    // active queue, a power of two covering the table up to JOBPOOL_QUEUE_MAX
+    size_t capacity = 4;
+    while (capacity < (size_t)_jobtab.capacity && capacity < JOBPOOL_QUEUE_MAX) {
+        capacity <<= 1;
+    }
+    pool->active_queue.cells = aligned_alloc(64, sizeof(struct jobq_cell) * capacity);
+    if (NULL == pool->active_queue.cells) {
+        perror("jobpool: malloc: allocating queue");
         return -1;
     }
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&pool->active_queue.cells[i].seq, i);
+        pool->active_queue.cells[i].job = NULL;
+    }
+    pool->active_queue.mask = capacity - 1;
+    atomic_init(&pool->active_queue.enqueue_pos, 0);
+    atomic_init(&pool->active_queue.dequeue_pos, 0);
+    atomic_init(&pool->park.seq, 0);
+    atomic_init(&pool->park.sleepers, 0);
+    jobmpsc_init(&pool->done_queue);
+
+    pool->active_count = 0;
+    atomic_init(&pool->shedding, false);
+    pool->poller_class = NULL;
+    pool->poller_inst = NULL;
+    pool->workers = NULL;
+    pool->worker_count = 0;
+    pool->cpu = -1;
 
     return 0;
 }
 
 
-struct jobnode * jobpool_get(int sockfd) {
-    if (sockfd > _jobpool.size) {
+// the node of a live connection of this shard, NULL for free fds and other shards' fds
+struct jobnode * jobpool_get(struct jobpool * pool, int sockfd) {
+    struct jobnode * job = jobpool_table_slot(sockfd);
+    if (NULL == job || atomic_load_explicit(&job->pool, memory_order_relaxed) != pool) {
         return NULL;
     }
 
-    return _jobpool.blocking_map[sockfd];
+    return job;
 }
 
 
@@ -156,122 +286,792 @@ EXIT:
 #endif
 
 
-struct jobnode * jobpool_free_acquire(int sockfd)
+// milliseconds on CLOCK_MONOTONIC, the coarse clock is plenty for deadlines
+uint64_t jobpool_clock_ms(void)
 {
-    
-    struct jobnode * temp = NULL;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
 
-    if (pthread_spin_lock(&_jobpool.flock) != 0) goto EXIT;
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
 
-    if (_jobpool.free_count > 0) {
-        temp = _jobpool.free_pool;
-        _jobpool.free_pool = _jobpool.free_pool->nextfree;
-        _jobpool.free_count -= 1;
+static void job_deadline_set(struct jobnode * job, job_timeout_e kind)
+{
+    unsigned long ms = jobpool_timeouts[kind];
 
-        _jobpool.blocking_map[sockfd] = temp;
-    } else {
-        fprintf(stderr, "TODO: unhandler error of running out of free connections\n");
-        exit(1);
-    }
+    job->timeout = (uint8_t)kind;
+    atomic_store_explicit(&job->deadline_ms, (ms == 0)? UINT64_MAX: jobpool_clock_ms() + ms, memory_order_relaxed);
+}
 
-    if (pthread_spin_unlock(&_jobpool.flock) != 0) goto EXIT;
+// NULL with errno set when the fd is beyond the table or its chunk can't be allocated
+struct jobnode * jobpool_free_acquire(struct jobpool * pool, int sockfd)
+{
+    if (sockfd < 0 || sockfd >= _jobtab.capacity) {
+        errno = EMFILE;
+        return NULL;
+    }
 
-    // DEVNOTE: Any object which just came out of the freepool should not need to be synchronise.
-    //          Synchronisation issues will only appear after first dequeueing.
-    if (temp != NULL) {
-        temp->sockfd = sockfd;
-        temp->yielded = false;
-        temp->next = NULL;
-        temp->prev = NULL;
-        temp->nextfree = NULL;
+    struct jobnode * temp = jobpool_table_slot(sockfd);
+    if (NULL == temp) {
+        temp = jobpool_table_grow(sockfd);
+        if (NULL == temp) {
+            errno = ENOMEM;
+            return NULL;
+        }
     }
 
+    // DEVNOTE: The fd was just handed out by the kernel, so no other shard or worker
+    //          holds this node. Synchronisation issues will only appear after first dequeueing.
+    temp->coro = NULL;
+    temp->home = -1;
+    temp->wait = SOCK_READABLE;
+    temp->zerocopy = JOB_ZEROCOPY_UNSET;
+    temp->zc_sent = 0;
+    temp->zc_done = 0;
+    temp->expired = 0;
+    job_deadline_set(temp, JOB_TIMEOUT_HEADER);
+    atomic_store_explicit(&temp->pool, pool, memory_order_relaxed);
+    pool->active_count += 1;
+    atomic_fetch_add_explicit(&_jobtab.used, 1, memory_order_relaxed);
+
     return temp;
-    
-EXIT:
-    perror("jobpool: acquire - spin lock/unlock failed");
-    exit(1); // spinlock taking only fails in case of a dead lock, no recovery for that case
-    return NULL;
 }
 
-void jobpool_free_release(int sockfd)
+void jobpool_free_release(struct jobpool * pool, int sockfd)
 {
-    
-    if (pthread_spin_lock(&_jobpool.flock) != 0) goto EXIT;
-    
-    struct jobnode * released = _jobpool.blocking_map[sockfd];
+    struct jobnode * released = jobpool_table_slot(sockfd);
 
-    released->nextfree = _jobpool.free_pool;
-    _jobpool.free_pool = released;
-    _jobpool.free_count += 1;
+    // shed before the handler got to run again, its stack goes to this thread's pool
+    if (NULL != released->coro) {
+        coro_destroy(released->coro);
+        released->coro = NULL;
+    }
+    atomic_store_explicit(&released->pool, NULL, memory_order_relaxed);
+    pool->active_count -= 1;
+    atomic_fetch_sub_explicit(&_jobtab.used, 1, memory_order_relaxed);
+}
 
-    _jobpool.blocking_map[sockfd] = NULL;
+void jobpool_poller_attach(struct jobpool * pool, struct Poller * poller_class, void * poller_inst)
+{
+    pool->poller_class = poller_class;
+    pool->poller_inst = poller_inst;
+}
 
-    if (pthread_spin_unlock(&_jobpool.flock) != 0) goto EXIT;
-    
-    return;
+// sends of at least min bytes go out with MSG_ZEROCOPY, 0 keeps copying everything
+void jobpool_zerocopy_init(size_t min)
+{
+    jobpool_zerocopy_min = min;
+}
 
-EXIT:
-    perror("jobpool: release - spin lock/unlock failed");
-    exit(1); // spinlock taking only fails in case of a dead lock, no recovery for that case
+// connections time out after this many ms reading a request head, idle between requests
+// and with a send making no progress, 0 never times them out
+void jobpool_timeouts_init(unsigned long header_ms, unsigned long idle_ms, unsigned long write_ms)
+{
+    jobpool_timeouts[JOB_TIMEOUT_HEADER] = header_ms;
+    jobpool_timeouts[JOB_TIMEOUT_IDLE] = idle_ms;
+    jobpool_timeouts[JOB_TIMEOUT_WRITE] = write_ms;
 }
 
-// enqueque new job
-void jobq_active_enqueue(struct jobnode * job)
+// the shortest timeout set, 0 when there is none
+unsigned long jobpool_timeout_min(void)
 {
+    unsigned long min = 0;
+
+    for (int kind = 0; kind < JOB_TIMEOUT_KINDS; kind++) {
+        unsigned long ms = jobpool_timeouts[kind];
+        min = (ms != 0 && (min == 0 || ms < min))? ms: min;
+    }
 
-    job->next = NULL;
+    return min;
+}
 
-    if (pthread_spin_lock(&_jobpool.qlock) != 0) goto EXIT;
+// QUEUED -> ARMING -> BLOCKED, the state must be visible before the poller can report the fd again
+// DEVNOTE: A handler suspended mid-send waits for the socket to drain, everything else
+//          for the next bytes to read. The next run starts from reading again.
+//          The deadline is published with the state, the ioloop reads it once it sees
+//          BLOCKED. A head read over several blocks keeps its first deadline, so a client
+//          trickling bytes in can't stretch it. Neither can idling before the first
+//          head, a connection keeps its accept deadline until a head was parsed.
+//          ARMING keeps the timers off the job until the rearm returned, one expiring
+//          it earlier could have it closed and its fd reused under the rearm. An event
+//          the rearm raises claims the job from ARMING too, this worker then leaves it.
+void job_block(struct jobnode * job)
+{
+    // once rearmed the job may run, finish and be reaped elsewhere, only these stay valid
+    struct jobpool * pool = job->pool;
+    int sockfd = job->sockfd;
+    sock_state_e want = (sock_state_e)job->wait;
+    job_timeout_e kind = (want != SOCK_READABLE)? JOB_TIMEOUT_WRITE:
+                         (NULL == job->coro)? JOB_TIMEOUT_IDLE: JOB_TIMEOUT_HEADER;
+
+    if (kind == JOB_TIMEOUT_WRITE || job->timeout != JOB_TIMEOUT_HEADER) {
+        job_deadline_set(job, kind);
+    }
+    job->wait = SOCK_READABLE;
+    atomic_store(&job->state, JOB_ARMING);
+
+    job_state_e expected = JOB_ARMING;
+    if (pool->poller_class->rearmfd(pool->poller_inst, sockfd, want) == -1) {
+        perror("jobpool: rearm");
+        // can't get events for this socket anymore, let the ioloop reap it
+        if (atomic_compare_exchange_strong(&job->state, &expected, JOB_QUEUED)) {
+            job_done(job);
+        }
+        return;
+    }
+    // fails when an event queued it meanwhile
+    atomic_compare_exchange_strong(&job->state, &expected, JOB_BLOCKED);
 
-    if (_jobpool.queue_count > 0) {
-        _jobpool.active_queue_rear->next = job;
-        job->prev = _jobpool.active_queue_rear;
-    } else {
-        job->prev = NULL;
-        _jobpool.active_queue_front = job;        
+    metrics_add(METRIC_JOBS_BLOCKED, 1);
+    if (atomic_load_explicit(&pool->shedding, memory_order_relaxed)) {
+        // the ioloop re-checks its watermarks on wakeup, don't leave it paused on a drained queue
+        pool->poller_class->notify(pool->poller_inst);
     }
+}
 
-    _jobpool.active_queue_rear = job;
-    _jobpool.queue_count += 1;
+// QUEUED -> DONE, the ioloop releases the socket on its next pass
+// DEVNOTE: A QUEUED job has left the worker inbox already, so its next link is free
+//          for the done_queue.
+void job_done(struct jobnode * job)
+{
+    struct jobpool * pool = job->pool;
 
-    if (pthread_spin_unlock(&_jobpool.qlock) != 0) goto EXIT;
+    metrics_add(METRIC_JOBS_DONE, 1);
+    trace_record(job->trace_id, TRACE_DONE, 0);
+    atomic_store(&job->state, JOB_DONE);
+    jobmpsc_push(&pool->done_queue, job);
 
-    return;
+    pool->poller_class->notify(pool->poller_inst);
+}
 
-EXIT:
-    perror("jobpool: enqueue - spin lock/unlock failed");
-    exit(1); // spinlock taking only fails in case of a dead lock, no recovery for that case
+// ioloop only, a job pushed mid-way shows up on the pass after its notify
+struct jobnode * jobq_done_dequeue(struct jobpool * pool)
+{
+    return jobmpsc_pop(&pool->done_queue);
+}
+
+// DEVNOTE: Kept out of line, so the errno address is looked up again on whichever
+//          worker resumed the coroutine.
+__attribute__((noinline))
+int job_io_again(void)
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK;
 }
 
-struct jobnode * jobq_active_dequeue(void)
+// park the handler until the socket is ready for want, -1 when waiting failed or timed out
+// DEVNOTE: On a coroutine the handler is suspended, the worker re-arms the job for want
+//          and whichever worker the poller hands it to next resumes it. Off a coroutine,
+//          a forked child for one, it blocks on the socket instead.
+static int job_wait(struct jobnode * job, sock_state_e want)
 {
-    struct jobnode * temp = NULL;
+    if (NULL != coro_self()) {
+        job->wait = (uint8_t)want;
+        coro_yield();
+        if (job->expired) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        return 0;
+    }
+
+    // POLLERR is always reported, it is all a zero-copy completion raises
+    short events = (want == SOCK_READABLE)? POLLIN: (want == SOCK_WRITABLE)? POLLOUT: 0;
+    struct pollfd pfd = { .fd = job->sockfd, .events = events, .revents = 0 };
+    if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+        return -1;
+    }
 
-    if (pthread_spin_lock(&_jobpool.qlock) != 0) goto EXIT;
+    return 0;
+}
 
-    temp = _jobpool.active_queue_front;
-    if (_jobpool.queue_count > 1) {
-        _jobpool.active_queue_front = temp->next;
-        _jobpool.active_queue_front->prev = NULL;
-        _jobpool.queue_count -= 1;
-        temp->next = NULL;
-    } else if (_jobpool.queue_count == 1) {
-        _jobpool.active_queue_front = NULL;
-        _jobpool.active_queue_rear = NULL;
-        _jobpool.queue_count -= 1;
-        temp->next = NULL;
+// socket I/O goes through the poller, completion based pollers own the data path
+ssize_t job_recv(struct jobnode * job, void * buf, size_t n)
+{
+    while (1) {
+        ssize_t rc = job_try_recv(job, buf, n);
+        if (rc != -1 || !job_io_again()) {
+            return rc;
+        }
+
+        if (job_wait(job, SOCK_READABLE) == -1) {
+            return -1;
+        }
     }
+}
 
-    if (pthread_spin_unlock(&_jobpool.qlock) != 0) goto EXIT;
+// a single attempt, -1 with job_io_again() when there is nothing to read yet
+ssize_t job_try_recv(struct jobnode * job, void * buf, size_t n)
+{
+    return job->pool->poller_class->recvfd(job->pool->poller_inst, job->sockfd, buf, n);
+}
 
-    return temp;
-    
-EXIT:
-    perror("jobpool: dequeue - spin lock/unlock failed");
-    exit(1); // spinlock taking only fails in case of a dead lock, no recovery for that case
+// MSG_ZEROCOPY when a send of len bytes is worth pinning its pages for
+static int job_zerocopy_flags(struct jobnode * job, size_t len)
+{
+    if (jobpool_zerocopy_min == 0 || len < jobpool_zerocopy_min || job->zerocopy == JOB_ZEROCOPY_OFF) {
+        return 0;
+    }
+
+    if (job->zerocopy == JOB_ZEROCOPY_UNSET) {
+        int one = 1;
+        job->zerocopy = (setsockopt(job->sockfd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0)?
+                JOB_ZEROCOPY_ON: JOB_ZEROCOPY_OFF;
+    }
+
+    return (job->zerocopy == JOB_ZEROCOPY_ON)? MSG_ZEROCOPY: 0;
+}
+
+// count the zero-copy completions on the error queue, 1 while some are still out
+// DEVNOTE: The kernel merges consecutive completions into one notification for the
+//          range ee_info..ee_data. A completion flagged as copied means the route can't
+//          send from user pages, loopback for one, and pinning them only costs there.
+static int job_zerocopy_reap(struct jobnode * job)
+{
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+    struct msghdr msg;
+
+    while (job->zc_done != job->zc_sent) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(job->sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return job_io_again()? 1: -1;
+        }
+
+        for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg); NULL != cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+                !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            struct sock_extended_err * ee = (struct sock_extended_err *)CMSG_DATA(cmsg);
+            if (ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY || ee->ee_errno != 0) {
+                continue;
+            }
+            job->zc_done += ee->ee_data - ee->ee_info + 1;
+            if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                job->zerocopy = JOB_ZEROCOPY_OFF;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// drop the n bytes written from the front of iov[idx..], the index of the first one left
+static int job_iov_consume(struct iovec * iov, int idx, int iovcnt, size_t n)
+{
+    while (idx < iovcnt && n >= iov[idx].iov_len) {
+        n -= iov[idx].iov_len;
+        idx += 1;
+    }
+    if (idx < iovcnt) {
+        iov[idx].iov_base = (char *)iov[idx].iov_base + n;
+        iov[idx].iov_len -= n;
+    }
+
+    return idx;
+}
+
+// write all of iov with flags, parking the handler whenever the send buffer is full
+// DEVNOTE: iov is the connection's output queue. What didn't fit stays in it, on the
+//          suspended handler's stack, while the poller waits for the socket to drain,
+//          and the flush carries on from there once the reactor hands the job back.
+static ssize_t job_sendv(struct jobnode * job, struct iovec * iov, int iovcnt, int flags)
+{
+    size_t totWritten = 0;
+    int idx = job_iov_consume(iov, 0, iovcnt, 0);
+
+    while (idx < iovcnt) {
+        ssize_t rc = job->pool->poller_class->sendfd(job->pool->poller_inst, job->sockfd, 
+                                                    &iov[idx], iovcnt - idx, flags);
+        if (rc == -1 && (flags & MSG_ZEROCOPY) && errno == ENOBUFS) {
+            flags &= ~MSG_ZEROCOPY;     // out of option memory for pinned pages, copy this one
+            continue;
+        } else if (rc == -1) {
+            if (!job_io_again() || job_wait(job, SOCK_WRITABLE) == -1) {
+                return -1;
+            }
+            continue;
+        }
+
+        if (flags & MSG_ZEROCOPY) {
+            job->zc_sent += 1;
+        }
+        totWritten += (size_t)rc;
+        idx = job_iov_consume(iov, idx, iovcnt, (size_t)rc);
+    }
+
+    return (ssize_t)totWritten;
 }
 
+// write all of iov, which is consumed on the way
+// DEVNOTE: Zero-copy sends reference the caller's buffers until the peer acknowledged
+//          them, so this waits for their completions before handing the buffers back.
+ssize_t job_send(struct jobnode * job, struct iovec * iov, int iovcnt)
+{
+    size_t len = 0;
+
+    for (int i = 0; i < iovcnt; i++) {
+        len += iov[i].iov_len;
+    }
+
+    ssize_t rc = job_sendv(job, iov, iovcnt, job_zerocopy_flags(job, len));
+    if (rc == -1) {
+        return -1;
+    }
+
+    int pending;
+    while ((pending = job_zerocopy_reap(job)) == 1) {
+        if (job_wait(job, SOCK_ERRQUEUE) == -1) {
+            return -1;
+        }
+    }
 
+    return (pending == 0)? rc: -1;
+}
 
+// headers in iov, then count bytes of in_fd from offset
+// DEVNOTE: MSG_MORE holds the headers back to share a segment with the file's first bytes.
+ssize_t job_sendfile(struct jobnode * job, struct iovec * iov, int iovcnt, int in_fd, off_t offset, size_t count)
+{
+    ssize_t rc = job_sendv(job, iov, iovcnt, (count > 0)? MSG_MORE: 0);
+    if (rc == -1) {
+        return -1;
+    }
+    size_t totWritten = (size_t)rc;
+
+    while (count > 0) {
+        rc = job->pool->poller_class->sendfilefd(job->pool->poller_inst, job->sockfd, in_fd, offset, count);
+        if (rc == -1) {
+            if (!job_io_again() || job_wait(job, SOCK_WRITABLE) == -1) {
+                return -1;
+            }
+            continue;
+        }
+        totWritten += (size_t)rc;
+        offset += rc;
+        count -= (size_t)rc;
+    }
 
+    return (ssize_t)totWritten;
+}
+
+// enqueque new job, to its worker when the pool is work-stealing, -1 when the ring is full
+// DEVNOTE: A cell is free for position pos when its seq equals pos, and holds a job for
+//          pos when its seq equals pos + 1. A job is only queued once per QUEUED state,
+//          so the ring only fills up with more than JOBPOOL_QUEUE_MAX jobs waiting.
+int jobq_active_enqueue(struct jobpool * pool, struct jobnode * job)
+{
+    struct jobq * q = &pool->active_queue;
+    struct jobq_cell * cell = NULL;
+
+    if (pool->worker_count > 0) {
+        // stick to the worker which ran the connection last, its caches are warm
+        if (job->home < 0) {
+            job->home = job->sockfd % pool->worker_count;
+        }
+        jobmpsc_push(&pool->workers[job->home].inbox, job);
+        pool->workers[job->home].inbox_pushed += 1;
+        pool->workers[job->home].wake_pending = true;
+        return 0;
+    }
+
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+
+    while (1) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1, 
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    cell->job = job;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+    return 0;
+}
+
+// jobs waiting for a worker, racy snapshot for the ioloop's admission control
+long jobq_active_depth(struct jobpool * pool)
+{
+    long depth = 0;
+
+    if (pool->worker_count > 0) {
+        for (int i = 0; i < pool->worker_count; i++) {
+            struct jobworker * w = &pool->workers[i];
+            long stolen = atomic_load_explicit(&w->deque.top, memory_order_relaxed);
+            long deque = atomic_load_explicit(&w->deque.bottom, memory_order_relaxed) - stolen;
+            depth += (long)(w->inbox_pushed - atomic_load_explicit(&w->inbox_popped, memory_order_relaxed));
+            depth += (deque > 0)? deque: 0;
+        }
+        return depth;
+    }
+
+    size_t dequeued = atomic_load_explicit(&pool->active_queue.dequeue_pos, memory_order_relaxed);
+    depth = (long)(atomic_load_explicit(&pool->active_queue.enqueue_pos, memory_order_relaxed) - dequeued);
+
+    return (depth > 0)? depth: 0;
+}
+
+// dequeue up to max consecutive jobs, claimed with a single CAS on the consumer position
+int jobq_active_dequeue_batch(struct jobpool * pool, struct jobnode ** jobs, int max)
+{
+    struct jobq * q = &pool->active_queue;
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    int count = 0;
+
+    while (1) {
+        intptr_t dif = 0;
+        for (count = 0; count < max; count++) {
+            struct jobq_cell * cell = &q->cells[(pos + (size_t)count) & q->mask];
+            size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+            dif = (intptr_t)seq - (intptr_t)(pos + (size_t)count + 1);
+            if (dif != 0) {
+                break;
+            }
+        }
+
+        if (count == 0) {
+            if (dif < 0) {
+                return 0; // empty
+            }
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+        } else if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + (size_t)count, 
+                    memory_order_relaxed, memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        struct jobq_cell * cell = &q->cells[(pos + (size_t)i) & q->mask];
+        jobs[i] = cell->job;
+        atomic_store_explicit(&cell->seq, pos + (size_t)i + q->mask + 1, memory_order_release);
+    }
+
+    return count;
+}
+
+static uint32_t jobpark_prepare(struct jobpark * park)
+{
+    atomic_fetch_add(&park->sleepers, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    return atomic_load(&park->seq);
+}
+
+static void jobpark_cancel(struct jobpark * park)
+{
+    atomic_fetch_sub(&park->sleepers, 1);
+}
+
+static void jobpark_commit(struct jobpark * park, uint32_t key)
+{
+    struct timespec timeout = {.tv_sec = 0, .tv_nsec = JOBPOOL_PARK_TIMEOUT_NS};
+
+    // returns right away if a wake bumped seq after prepare
+    syscall(SYS_futex, &park->seq, FUTEX_WAIT_PRIVATE, key, &timeout, NULL, 0);
+    atomic_fetch_sub(&park->sleepers, 1);
+}
+
+// no syscall unless somebody is parked
+static void jobpark_wake(struct jobpark * park, int count)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&park->sleepers, memory_order_relaxed) > 0) {
+        atomic_fetch_add(&park->seq, 1);
+        syscall(SYS_futex, &park->seq, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+    }
+}
+
+// DEVNOTE: Spin on the queue first, then park. The spin budget doubles whenever
+//          spinning found work and halves whenever the worker had to park, so busy
+//          workers stay hot and idle ones stop burning cycles quickly.
+int jobq_active_wait_batch(struct jobpool * pool, struct jobnode ** jobs, int max, int * spin)
+{
+    int count = 0;
+
+    for (int i = 0; i < *spin; i++) {
+        count = jobq_active_dequeue_batch(pool, jobs, max);
+        if (count > 0) {
+            *spin = (*spin < JOBPOOL_SPIN_MAX)? *spin * 2: JOBPOOL_SPIN_MAX;
+            return count;
+        }
+        JOBPOOL_CPU_RELAX();
+    }
+    *spin = (*spin > JOBPOOL_SPIN_MIN)? *spin / 2: JOBPOOL_SPIN_MIN;
+
+    uint32_t key = jobpark_prepare(&pool->park);
+    count = jobq_active_dequeue_batch(pool, jobs, max);
+    if (count > 0) {
+        jobpark_cancel(&pool->park);
+        return count;
+    }
+    jobpark_commit(&pool->park, key);
+
+    return jobq_active_dequeue_batch(pool, jobs, max);
+}
+
+// ioloop only, after enqueueing count jobs
+void jobq_active_wake(struct jobpool * pool, int count)
+{
+    if (pool->worker_count > 0) {
+        for (int i = 0; i < pool->worker_count; i++) {
+            struct jobworker * w = &pool->workers[i];
+            if (w->wake_pending) {
+                w->wake_pending = false;
+                jobpark_wake(&w->park, 1);
+            }
+        }
+    } else if (count > 0) {
+        jobpark_wake(&pool->park, count);
+    }
+}
+
+struct jobnode * jobq_active_dequeue(struct jobpool * pool)
+{
+    struct jobnode * job = NULL;
+
+    return (jobq_active_dequeue_batch(pool, &job, 1) == 1)? job: NULL;
+}
+
+
+void jobmpsc_init(struct jobmpsc * q)
+{
+    atomic_init(&q->stub.next, NULL);
+    atomic_init(&q->head, &q->stub);
+    q->tail = &q->stub;
+}
+
+void jobmpsc_push(struct jobmpsc * q, struct jobnode * job)
+{
+    atomic_store_explicit(&job->next, NULL, memory_order_relaxed);
+    struct jobnode * prev = atomic_exchange_explicit(&q->head, job, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, job, memory_order_release);
+}
+
+// single consumer only, NULL when empty or when a producer is between its two stores
+struct jobnode * jobmpsc_pop(struct jobmpsc * q)
+{
+    struct jobnode * tail = q->tail;
+    struct jobnode * next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (tail == &q->stub) {
+        if (NULL == next) {
+            return NULL;
+        }
+        q->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+
+    if (NULL != next) {
+        q->tail = next;
+        return tail;
+    }
+
+    if (tail != atomic_load_explicit(&q->head, memory_order_acquire)) {
+        return NULL;
+    }
+
+    jobmpsc_push(q, &q->stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (NULL != next) {
+        q->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+// owner only
+static int jobdeque_push(struct jobdeque * d, struct jobnode * job)
+{
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+
+    if (b - t > d->mask) {
+        return -1;
+    }
+
+    atomic_store_explicit(&d->buf[b & d->mask], job, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+
+    return 0;
+}
+
+// owner only
+static struct jobnode * jobdeque_take(struct jobdeque * d)
+{
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    struct jobnode * job = atomic_load_explicit(&d->buf[b & d->mask], memory_order_relaxed);
+    if (t == b) {
+        // last one, race the thieves for it
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, 
+                memory_order_seq_cst, memory_order_relaxed)) {
+            job = NULL;
+        }
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+
+    return job;
+}
+
+// any thread
+static struct jobnode * jobdeque_steal(struct jobdeque * d)
+{
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+    if (t >= b) {
+        return NULL;
+    }
+
+    struct jobnode * job = atomic_load_explicit(&d->buf[t & d->mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, 
+            memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL; // lost to the owner or another thief
+    }
+
+    return job;
+}
+
+// TODO: counterpart destroy function
+int jobpool_workers_init(struct jobpool * pool, int count)
+{
+    struct jobworker * workers = aligned_alloc(_Alignof(struct jobworker), sizeof(struct jobworker) * (size_t)count);
+    if (NULL == workers) {
+        perror("jobpool: malloc: allocating workers");
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        struct jobworker * w = &workers[i];
+        w->deque.buf = malloc(sizeof(struct jobnode *) * JOBPOOL_DEQUE_SIZE);
+        if (NULL == w->deque.buf) {
+            for (int j = 0; j < i; j++) {
+                free(workers[j].deque.buf);
+            }
+            free(workers);
+            perror("jobpool: malloc: allocating deque");
+            return -1;
+        }
+        w->deque.mask = JOBPOOL_DEQUE_SIZE - 1;
+        atomic_init(&w->deque.top, 0);
+        atomic_init(&w->deque.bottom, 0);
+        jobmpsc_init(&w->inbox);
+        w->inbox_pushed = 0;
+        atomic_init(&w->inbox_popped, 0);
+        atomic_init(&w->park.seq, 0);
+        atomic_init(&w->park.sleepers, 0);
+        w->wake_pending = false;
+        w->pool = pool;
+        w->id = i;
+        w->seed = (unsigned int)i * 2654435761u + 1;
+    }
+
+    pool->workers = workers;
+    pool->worker_count = count;
+
+    return 0;
+}
+
+// own deque first, topped up from the inbox, then steal from a random victim onwards
+struct jobnode * jobq_worker_dequeue(struct jobworker * worker)
+{
+    struct jobpool * pool = worker->pool;
+    struct jobnode * job = NULL;
+    unsigned long popped = atomic_load_explicit(&worker->inbox_popped, memory_order_relaxed);
+
+    while (NULL != (job = jobmpsc_pop(&worker->inbox))) {
+        atomic_store_explicit(&worker->inbox_popped, ++popped, memory_order_relaxed);
+        if (jobdeque_push(&worker->deque, job) != 0) {
+            // deque full, run this one right away
+            return job;
+        }
+    }
+
+    job = jobdeque_take(&worker->deque);
+    if (NULL != job) {
+        // more queued behind this one, get a parked sibling to steal it
+        if (pool->worker_count > 1 && 
+                atomic_load_explicit(&worker->deque.bottom, memory_order_relaxed) > 
+                atomic_load_explicit(&worker->deque.top, memory_order_relaxed)) {
+            for (int i = 1; i < pool->worker_count; i++) {
+                struct jobworker * sibling = &pool->workers[(worker->id + i) % pool->worker_count];
+                if (atomic_load_explicit(&sibling->park.sleepers, memory_order_relaxed) > 0) {
+                    jobpark_wake(&sibling->park, 1);
+                    break;
+                }
+            }
+        }
+        return job;
+    }
+
+    if (pool->worker_count > 1) {
+        worker->seed = worker->seed * 1103515245u + 12345u;
+        int start = (int)((worker->seed >> 16) % (unsigned int)pool->worker_count);
+        for (int i = 0; i < pool->worker_count; i++) {
+            int victim = (start + i) % pool->worker_count;
+            if (victim == worker->id) {
+                continue;
+            }
+            job = jobdeque_steal(&pool->workers[victim].deque);
+            if (NULL != job) {
+                job->home = worker->id;
+                return job;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// same spin-then-park as jobq_active_wait_batch, on the worker's own park
+struct jobnode * jobq_worker_wait(struct jobworker * worker, int * spin)
+{
+    struct jobnode * job = NULL;
+
+    for (int i = 0; i < *spin; i++) {
+        job = jobq_worker_dequeue(worker);
+        if (NULL != job) {
+            *spin = (*spin < JOBPOOL_SPIN_MAX)? *spin * 2: JOBPOOL_SPIN_MAX;
+            return job;
+        }
+        JOBPOOL_CPU_RELAX();
+    }
+    *spin = (*spin > JOBPOOL_SPIN_MIN)? *spin / 2: JOBPOOL_SPIN_MIN;
+
+    uint32_t key = jobpark_prepare(&worker->park);
+    job = jobq_worker_dequeue(worker);
+    if (NULL != job) {
+        jobpark_cancel(&worker->park);
+        return job;
+    }
+    jobpark_commit(&worker->park, key);
+
+    return jobq_worker_dequeue(worker);
+}
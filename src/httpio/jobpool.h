@@ -3,10 +3,17 @@
 
 // == includes ==
 
-#include <setjmp.h>
+// system
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 // freestanding
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+// local
+#include "timer.h"
 
 
 #ifdef __cplusplus
@@ -14,41 +21,137 @@ namespace c10m_job {
 #endif
 
 
+#define JOBPOOL_SPIN_MIN 16
+#define JOBPOOL_SPIN_MAX 4096
+
+#define JOB_ZEROCOPY_UNSET 0    // SO_ZEROCOPY not tried on the socket yet
+#define JOB_ZEROCOPY_ON 1
+#define JOB_ZEROCOPY_OFF 2      // unsupported, or the kernel had to copy anyway
+
 typedef enum job_state_enum {
     JOB_UNINITED,
     JOB_QUEUED,
     JOB_BLOCKED,
+    JOB_ARMING,                 // a worker is rearming it, BLOCKED once that returned
     JOB_DONE
 } job_state_e;
 
+typedef enum job_timeout_enum {
+    JOB_TIMEOUT_NONE,
+    JOB_TIMEOUT_HEADER,         // reading a request head, the whole of it
+    JOB_TIMEOUT_IDLE,           // keep-alive between requests
+    JOB_TIMEOUT_WRITE,          // no progress sending a response
+    JOB_TIMEOUT_KINDS
+} job_timeout_e;
+
 
 
 // primitive types
 
+struct jobpool;
+struct Poller;
+struct coro;
+
 struct jobnode {
     int sockfd;
-    struct jobnode * next;      // synchronised by jobpool qlock
-    struct jobnode * prev;      // synchronised by jobpool qlock
-    struct jobnode * nextfree;  // synchrnoised by jobpool flock
+    int home;                   // worker last running the job, written while QUEUED
+    struct jobpool * _Atomic pool;  // owning shard, set on acquire, NULL while free
+    struct jobnode * _Atomic next;  // intrusive jobmpsc link, worker inbox or done_queue
     _Atomic job_state_e state;  // synchronised by atomicity
-    bool yielded;               // single threaded use only
-    sigjmp_buf buf;             // single threaded use only
+    uint8_t wait;               // sock_state_e the suspended handler waits for, written while QUEUED
+    uint8_t zerocopy;           // JOB_ZEROCOPY_*, written while QUEUED
+    struct coro * coro;         // handler suspended mid-request, written while QUEUED
+    uint32_t zc_sent;           // MSG_ZEROCOPY sends, written while QUEUED
+    uint32_t zc_done;           // of those, completions reaped off the error queue
+    uint64_t queued_ns;         // when the ioloop queued it, written before the enqueue
+    uint32_t trace_id;          // nonzero when the connection is traced, set on accept
+    uint8_t timeout;            // job_timeout_e of deadline_ms, written while QUEUED
+    uint8_t expired;            // the ioloop timed it out, written before the enqueue
+    _Atomic uint64_t deadline_ms;   // jobpool_clock_ms(), UINT64_MAX for none, written before BLOCKED
+    struct timer_node timer;    // ioloop only
 };
 
 
-// macro and static-inline functions
 
-void job_yieldable(struct jobnode *);
+// aggregate types
 
-int job_yield(struct jobnode *, int);
+struct jobq_cell {
+    _Atomic size_t seq;         // publishes job, see jobq_active_enqueue
+    struct jobnode * job;
+};
 
-#define job_yieldable(x) do { \
-        if (x.yielded) siglongjmp(x.buf, 1); \
-    } while(0)
+// DEVNOTE: Bounded lock-free multi-producer/multi-consumer ring. Producer and consumer
+//          positions live on their own cache lines, so the ioloop enqueueing and the
+//          workers dequeueing don't bounce a shared line.
+struct jobq {
+    _Alignas(64)
+    _Atomic size_t enqueue_pos;
+    _Alignas(64)
+    _Atomic size_t dequeue_pos;
+    _Alignas(64)
+    struct jobq_cell * cells;   // immutable
+    size_t mask;                // immutable
+};
 
+// DEVNOTE: Intrusive multi-producer/single-consumer queue (Vyukov). Push is one
+//          exchange, pop is consumer-local unless it races a producer mid-push.
+struct jobmpsc {
+    _Alignas(64)
+    struct jobnode * _Atomic head;  // producers
+    _Alignas(64)
+    struct jobnode * tail;          // consumer
+    struct jobnode stub;
+};
+
+// DEVNOTE: Chase-Lev work-stealing deque of fixed capacity. The owner pushes and
+//          takes at the bottom, thieves steal from the top.
+struct jobdeque {
+    _Alignas(64)
+    _Atomic long top;
+    _Alignas(64)
+    _Atomic long bottom;
+    _Alignas(64)
+    struct jobnode * _Atomic * buf; // immutable
+    long mask;                      // immutable
+};
+
+// DEVNOTE: Eventcount for idle workers. A worker registers as a sleeper, re-checks
+//          its queue and only then waits on the futex, a producer bumps seq and wakes
+//          after publishing. Either the worker sees the job or the producer sees it.
+struct jobpark {
+    _Alignas(64)
+    _Atomic uint32_t seq;           // futex word
+    _Atomic int sleepers;
+};
+
+struct jobworker {
+    struct jobdeque deque;          // owner and thieves
+    struct jobmpsc inbox;           // ioloop to owner
+    struct jobpark park;            // owner waits, ioloop and thieves wake
+    struct jobpool * pool;          // immutable
+    int id;                         // immutable
+    unsigned int seed;              // owner, victim selection
+    bool wake_pending;              // ioloop only, inbox got jobs since the last wake
+    unsigned long inbox_pushed;     // ioloop only
+    _Atomic unsigned long inbox_popped; // owner writes, ioloop reads for the queue depth
+};
+
+// DEVNOTE: One jobpool is one shard, owned by a single ioloop. Shards only share the
+//          fd table, the alignment keeps neighbouring shards off each other's cache lines.
+struct jobpool {
+    _Alignas(64)
+    int active_count;   // ioloop only, connections owned by the shard
+    atomic_bool shedding;   // ioloop writes, workers read, admission control is shedding load
+    struct Poller * poller_class;   // set once before workers see jobs
+    void * poller_inst;             // set once before workers see jobs
+    struct jobq active_queue; // lock-free
+    struct jobpark park;      // workers idle on active_queue
+    struct jobmpsc done_queue;  // workers push DONE jobs, the ioloop reaps them
+    struct jobworker * workers; // set once before the ioloop, work-stealing only
+    int worker_count;           // set once before the ioloop, work-stealing only
+    int cpu;                    // the ioloop's, -1 when unpinned, set once before the workers start
+};
 
-#define job_yield(x, y)  if (sigsetjmp(x.buf, 0) == 0) { x.yielded = true; return y; } \
-                     else { x.yielded = false; }
 
 #ifdef __cplusplus
 extern "C" {
@@ -56,7 +159,15 @@ extern "C" {
 
 // protoypes
 
-int jobpool_init(int size);
+int jobpool_table_init(int capacity);
+
+int jobpool_table_capacity(void);
+
+int jobpool_table_used(void);
+
+size_t jobpool_table_bytes(void);
+
+int jobpool_init(struct jobpool * pool);
 
 #if 0
 struct jobnode * jobpool_blocked_get(int sockfd);
@@ -66,15 +177,61 @@ struct jobnode * jobpool_blocked_delete(int sockfd);
 int jobpool_blocked_put(int sockfd, struct jobnode * node);
 #endif
 
-struct jobnode * jobpool_get(int sockfd);
+struct jobnode * jobpool_get(struct jobpool * pool, int sockfd);
+
+struct jobnode * jobpool_free_acquire(struct jobpool * pool, int sockfd);
+
+void jobpool_free_release(struct jobpool * pool, int sockfd);
+
+void jobpool_poller_attach(struct jobpool * pool, struct Poller * poller_class, void * poller_inst);
+
+void jobpool_zerocopy_init(size_t min);
+
+void jobpool_timeouts_init(unsigned long header_ms, unsigned long idle_ms, unsigned long write_ms);
+
+unsigned long jobpool_timeout_min(void);
+
+uint64_t jobpool_clock_ms(void);
+
+void job_block(struct jobnode * job);
+
+void job_done(struct jobnode * job);
+
+ssize_t job_recv(struct jobnode * job, void * buf, size_t n);
+
+ssize_t job_try_recv(struct jobnode * job, void * buf, size_t n);
+
+int job_io_again(void);
+
+ssize_t job_send(struct jobnode * job, struct iovec * iov, int iovcnt);
+
+ssize_t job_sendfile(struct jobnode * job, struct iovec * iov, int iovcnt, int in_fd, off_t offset, size_t count);
+
+int jobq_active_enqueue(struct jobpool * pool, struct jobnode * job);
+
+struct jobnode * jobq_active_dequeue(struct jobpool * pool);
+
+struct jobnode * jobq_done_dequeue(struct jobpool * pool);
+
+int jobq_active_dequeue_batch(struct jobpool * pool, struct jobnode ** jobs, int max);
+
+int jobq_active_wait_batch(struct jobpool * pool, struct jobnode ** jobs, int max, int * spin);
+
+void jobq_active_wake(struct jobpool * pool, int count);
+
+long jobq_active_depth(struct jobpool * pool);
+
+int jobpool_workers_init(struct jobpool * pool, int count);
+
+struct jobnode * jobq_worker_dequeue(struct jobworker * worker);
 
-struct jobnode * jobpool_free_acquire(int sockfd);
+struct jobnode * jobq_worker_wait(struct jobworker * worker, int * spin);
 
-void jobpool_free_release(int sockfd);
+void jobmpsc_init(struct jobmpsc * q);
 
-void jobq_active_enqueue(struct jobnode * job);
+void jobmpsc_push(struct jobmpsc * q, struct jobnode * job);
 
-struct jobnode * jobq_active_dequeue(void);
+struct jobnode * jobmpsc_pop(struct jobmpsc * q);
 
 
 #ifdef __cplusplus
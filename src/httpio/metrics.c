@@ -0,0 +1,295 @@
+// Metrics
+// ===========================================================================
+
+#include "metrics.h"
+
+// cstd
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+// system
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+
+_Thread_local struct metrics_slot * metrics_self = NULL;
+
+static struct metrics_region * metrics_region = NULL;
+
+static const char * const metrics_counter_names[METRIC_COUNTERS] = {
+    "httpio_accepted_total",
+    "httpio_accepted_local_total",
+    "httpio_accept_overflows_total",
+    "httpio_rejected_total",
+    "httpio_timeouts_total",
+    "httpio_wakeups_total",
+    "httpio_jobs_queued_total",
+    "httpio_jobs_reaped_total",
+    "httpio_jobs_run_total",
+    "httpio_jobs_blocked_total",
+    "httpio_jobs_done_total",
+    "httpio_requests_total",
+    "httpio_bad_requests_total",
+    "httpio_connections",
+    "httpio_queue_depth"
+};
+
+static const char * const metrics_histogram_names[METRIC_HISTOGRAMS] = {
+    "httpio_dequeue_wait_seconds",
+    "httpio_handler_seconds"
+};
+
+static const double metrics_quantiles[] = { 50, 90, 99, 99.9, 100 };
+
+
+static size_t metrics_region_size(void)
+{
+    return sizeof(struct metrics_header) + sizeof(struct metrics_slot) * METRICS_SLOTS_MAX;
+}
+
+// the region for this process, in the file at path or anonymous when path is NULL or empty
+// DEVNOTE: The file is truncated to size and stays sparse, a slot's pages are only
+//          backed once its thread writes to them.
+int metrics_init(const char * path)
+{
+    size_t size = metrics_region_size();
+    void * base = MAP_FAILED;
+
+    if (NULL != metrics_region) {
+        return 0;
+    }
+
+    if (NULL == path || path[0] == '\0') {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    } else {
+        int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            perror("metrics: open");
+            return -1;
+        }
+        if (ftruncate(fd, (off_t)size) == 0) {
+            base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+    }
+    if (base == MAP_FAILED) {
+        perror("metrics: mmap");
+        return -1;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    struct metrics_region * region = base;
+    region->header.version = METRICS_VERSION;
+    region->header.slot_size = sizeof(struct metrics_slot);
+    region->header.slot_max = METRICS_SLOTS_MAX;
+    atomic_init(&region->header.slot_next, 0);
+    region->header.pid = getpid();
+    region->header.start_ns = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+    // readers check the magic first, it goes in once the rest is there
+    atomic_thread_fence(memory_order_release);
+    region->header.magic = METRICS_MAGIC;
+
+    metrics_region = region;
+
+    return 0;
+}
+
+// NULL until metrics_init
+const struct metrics_region * metrics_region_get(void)
+{
+    return metrics_region;
+}
+
+// another process's region, read-only, NULL when the file isn't one of ours
+const struct metrics_region * metrics_map(const char * path)
+{
+    struct stat st;
+    size_t size = metrics_region_size();
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return NULL;
+    }
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < size) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    const struct metrics_region * region = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        return NULL;
+    }
+
+    if (region->header.magic != METRICS_MAGIC || region->header.version != METRICS_VERSION ||
+        region->header.slot_size != sizeof(struct metrics_slot) || region->header.slot_max > METRICS_SLOTS_MAX) {
+        munmap((void *)region, size);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return region;
+}
+
+// a slot of its own for the calling thread, -1 when there is no region or no slot left
+int metrics_attach(metrics_role_e role)
+{
+    static atomic_bool warned = false;
+
+    if (NULL == metrics_region) {
+        return -1;
+    }
+
+    uint32_t idx = atomic_fetch_add_explicit(&metrics_region->header.slot_next, 1, memory_order_relaxed);
+    if (idx >= METRICS_SLOTS_MAX) {
+        if (!atomic_exchange(&warned, true)) {
+            fprintf(stderr, "metrics: more than %d threads, the rest go uncounted\n", METRICS_SLOTS_MAX);
+        }
+        return -1;
+    }
+
+    struct metrics_slot * slot = &metrics_region->slots[idx];
+    slot->id = idx;
+    for (int i = 0; i < METRIC_HISTOGRAMS; i++) {
+        histogram_init(&slot->histograms[i]);
+    }
+    atomic_store_explicit(&slot->role, (uint32_t)role, memory_order_release);
+    metrics_self = slot;
+
+    return 0;
+}
+
+// stop counting on this thread, a forked child for one shares its parent's slots
+void metrics_detach(void)
+{
+    metrics_self = NULL;
+}
+
+// the calling thread's own count, 0 without a slot
+uint64_t metrics_get(metrics_counter_e counter)
+{
+    return (NULL != metrics_self)? atomic_load_explicit(&metrics_self->counters[counter], memory_order_relaxed): 0;
+}
+
+uint64_t metrics_now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+
+// append to buf like snprintf, the position keeps counting past size
+static size_t metrics_append(char * buf, size_t size, size_t pos, const char * fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+static size_t metrics_append(char * buf, size_t size, size_t pos, const char * fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    int len = vsnprintf((pos < size)? buf + pos: NULL, (pos < size)? size - pos: 0, fmt, args);
+    va_end(args);
+
+    return (len > 0)? pos + (size_t)len: pos;
+}
+
+// all slots summed up in the Prometheus text format, the length it needs like snprintf
+// DEVNOTE: Job states aren't tracked per job, they fall out of the transition counts.
+//          The counts are read one after the other, so a state can be briefly off by
+//          the jobs that moved meanwhile.
+size_t metrics_format(const struct metrics_region * region, char * buf, size_t size)
+{
+    uint64_t counters[METRIC_COUNTERS] = { 0 };
+    int reactors = 0;
+    int workers = 0;
+    size_t pos = 0;
+    struct timespec now;
+
+    // far too large for a handler's stack
+    struct histogram * merged = malloc(sizeof(struct histogram) * METRIC_HISTOGRAMS);
+    if (NULL == merged) {
+        return metrics_append(buf, size, 0, "# out of memory\n");
+    }
+    for (int h = 0; h < METRIC_HISTOGRAMS; h++) {
+        histogram_init(&merged[h]);
+    }
+
+    uint32_t count = atomic_load_explicit(&region->header.slot_next, memory_order_relaxed);
+    count = (count > region->header.slot_max)? region->header.slot_max: count;
+    for (uint32_t i = 0; i < count; i++) {
+        const struct metrics_slot * slot = &region->slots[i];
+        uint32_t role = atomic_load_explicit(&slot->role, memory_order_acquire);
+        if (role == METRICS_UNUSED) {
+            continue;
+        }
+        reactors += (role == METRICS_REACTOR)? 1: 0;
+        workers += (role == METRICS_WORKER)? 1: 0;
+        for (int c = 0; c < METRIC_COUNTERS; c++) {
+            counters[c] += atomic_load_explicit(&slot->counters[c], memory_order_relaxed);
+        }
+        for (int h = 0; h < METRIC_HISTOGRAMS; h++) {
+            histogram_merge(&merged[h], &slot->histograms[h]);
+        }
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t now_ns = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+    pos = metrics_append(buf, size, pos, "# httpio pid %lld\n", (long long)region->header.pid);
+    pos = metrics_append(buf, size, pos, "httpio_uptime_seconds %.3f\n",
+                         (double)(now_ns - region->header.start_ns) / 1e9);
+    pos = metrics_append(buf, size, pos, "httpio_reactors %d\nhttpio_workers %d\n", reactors, workers);
+
+    for (int c = 0; c < METRIC_COUNTERS; c++) {
+        pos = metrics_append(buf, size, pos, "%s %llu\n", metrics_counter_names[c], (unsigned long long)counters[c]);
+    }
+
+    long queued = (long)(counters[METRIC_JOBS_QUEUED] - counters[METRIC_JOBS_BLOCKED] - counters[METRIC_JOBS_DONE]);
+    long done = (long)(counters[METRIC_JOBS_DONE] - counters[METRIC_JOBS_REAPED]);
+    queued = (queued > 0)? queued: 0;
+    done = (done > 0)? done: 0;
+    long blocked = (long)counters[METRIC_CONNECTIONS] - queued - done;
+    blocked = (blocked > 0)? blocked: 0;
+    // DEVNOTE: Locality only means something per reactor, the sum hides a reactor whose
+    //          connections all arrive on other cpus.
+    for (uint32_t i = 0, reactor = 0; i < count; i++) {
+        const struct metrics_slot * slot = &region->slots[i];
+        if (atomic_load_explicit(&slot->role, memory_order_acquire) != METRICS_REACTOR) {
+            continue;
+        }
+        pos = metrics_append(buf, size, pos, "httpio_reactor_accepted_total{reactor=\"%u\"} %llu\n", reactor,
+                             (unsigned long long)atomic_load_explicit(&slot->counters[METRIC_ACCEPTED], memory_order_relaxed));
+        pos = metrics_append(buf, size, pos, "httpio_reactor_accepted_local_total{reactor=\"%u\"} %llu\n", reactor,
+                             (unsigned long long)atomic_load_explicit(&slot->counters[METRIC_ACCEPTED_LOCAL],
+                                                                      memory_order_relaxed));
+        reactor += 1;
+    }
+
+    pos = metrics_append(buf, size, pos, "httpio_jobs{state=\"blocked\"} %ld\n", blocked);
+    pos = metrics_append(buf, size, pos, "httpio_jobs{state=\"queued\"} %ld\n", queued);
+    pos = metrics_append(buf, size, pos, "httpio_jobs{state=\"done\"} %ld\n", done);
+
+    for (int h = 0; h < METRIC_HISTOGRAMS; h++) {
+        const char * name = metrics_histogram_names[h];
+        for (size_t q = 0; q < sizeof(metrics_quantiles) / sizeof(metrics_quantiles[0]); q++) {
+            pos = metrics_append(buf, size, pos, "%s{quantile=\"%g\"} %.9f\n", name, metrics_quantiles[q] / 100,
+                                 (double)histogram_percentile(&merged[h], metrics_quantiles[q]) / 1e9);
+        }
+        pos = metrics_append(buf, size, pos, "%s_sum %.9f\n%s_count %llu\n", name,
+                             histogram_mean(&merged[h]) * (double)merged[h].total / 1e9, name,
+                             (unsigned long long)merged[h].total);
+    }
+    free(merged);
+
+    return pos;
+}
@@ -0,0 +1,155 @@
+#ifndef C10M_METRICS__METRICS_H_
+#define C10M_METRICS__METRICS_H_
+
+// == includes ==
+
+#include "histogram.h"
+
+// freestanding
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+namespace c10m_metrics {
+#endif
+
+
+#define METRICS_MAGIC 0x316d6f6970747468ULL     // "httpiom1" little-endian, first word of the file
+#define METRICS_VERSION 3                       // bumped on any change to the layout below
+#define METRICS_SLOTS_MAX 256                   // reactors and workers, later threads go uncounted
+
+typedef enum metrics_counter_enum {
+    METRIC_ACCEPTED,            // reactor, connections taken off the listener
+    METRIC_ACCEPTED_LOCAL,      // reactor, of those with their packets processed on its cpu
+    METRIC_ACCEPT_OVERFLOWS,    // reactor, host-wide accept queue drops it saw
+    METRIC_REJECTED,            // reactor, answered 503 while shedding
+    METRIC_TIMEOUTS,            // reactor, connections closed past their deadline
+    METRIC_WAKEUPS,             // reactor, poller waits that returned
+    METRIC_JOBS_QUEUED,         // reactor, BLOCKED -> QUEUED
+    METRIC_JOBS_REAPED,         // reactor, DONE -> free
+    METRIC_JOBS_RUN,            // worker, handler runs and resumes
+    METRIC_JOBS_BLOCKED,        // worker, QUEUED -> BLOCKED
+    METRIC_JOBS_DONE,           // any, QUEUED -> DONE
+    METRIC_REQUESTS,            // worker, requests answered
+    METRIC_BAD_REQUESTS,        // worker, of those the malformed or too large
+    METRIC_CONNECTIONS,         // reactor gauge, connections it owns
+    METRIC_QUEUE_DEPTH,         // reactor gauge, jobs waiting for a worker
+    METRIC_COUNTERS
+} metrics_counter_e;
+
+typedef enum metrics_histogram_enum {
+    METRIC_DEQUEUE_WAIT_NS,     // worker, from being queued to a worker running the job
+    METRIC_HANDLER_NS,          // worker, one run or resume of the handler
+    METRIC_HISTOGRAMS
+} metrics_histogram_e;
+
+typedef enum metrics_role_enum {
+    METRICS_UNUSED,
+    METRICS_REACTOR,
+    METRICS_WORKER
+} metrics_role_e;
+
+
+
+// aggregate types
+
+// DEVNOTE: Each slot has exactly one writing thread. Counters are a relaxed load and
+//          store, never a read-modify-write, and the slot's cache lines are its own,
+//          so counting costs what a plain increment does. Readers load whatever is
+//          there, a histogram may be read mid-record and be one count off.
+struct metrics_slot {
+    _Alignas(64)
+    _Atomic uint64_t counters[METRIC_COUNTERS];
+    _Atomic uint32_t role;      // metrics_role_e, stored last once the slot is set up
+    uint32_t id;                // index of the slot
+    _Alignas(64)
+    struct histogram histograms[METRIC_HISTOGRAMS];
+};
+
+// DEVNOTE: The whole region is one shared mapping, of a file when exported. Slots are
+//          written in place, so an outside reader maps the file read-only and sees the
+//          live values, the layout is fixed by METRICS_VERSION and slot_size.
+struct metrics_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t slot_size;         // sizeof(struct metrics_slot)
+    uint32_t slot_max;
+    _Atomic uint32_t slot_next; // slots handed out, the newest may not be set up yet
+    int64_t pid;
+    uint64_t start_ns;          // CLOCK_REALTIME at init
+};
+
+struct metrics_region {
+    struct metrics_header header;
+    struct metrics_slot slots[];
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// externs
+
+extern _Thread_local struct metrics_slot * metrics_self;
+
+// inlines
+
+static inline void metrics_add(metrics_counter_e counter, uint64_t n)
+{
+    struct metrics_slot * slot = metrics_self;
+
+    if (NULL != slot) {
+        uint64_t value = atomic_load_explicit(&slot->counters[counter], memory_order_relaxed);
+        atomic_store_explicit(&slot->counters[counter], value + n, memory_order_relaxed);
+    }
+}
+
+static inline void metrics_set(metrics_counter_e counter, uint64_t value)
+{
+    struct metrics_slot * slot = metrics_self;
+
+    if (NULL != slot) {
+        atomic_store_explicit(&slot->counters[counter], value, memory_order_relaxed);
+    }
+}
+
+static inline void metrics_record(metrics_histogram_e hist, uint64_t value)
+{
+    struct metrics_slot * slot = metrics_self;
+
+    if (NULL != slot) {
+        histogram_record(&slot->histograms[hist], value);
+    }
+}
+
+// protoypes
+
+int metrics_init(const char * path);
+
+const struct metrics_region * metrics_region_get(void);
+
+const struct metrics_region * metrics_map(const char * path);
+
+int metrics_attach(metrics_role_e role);
+
+void metrics_detach(void);
+
+uint64_t metrics_get(metrics_counter_e counter);
+
+uint64_t metrics_now_ns(void);
+
+size_t metrics_format(const struct metrics_region * region, char * buf, size_t size);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif // namespace
+
+#endif // C10M_METRICS__METRICS_H_
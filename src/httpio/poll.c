@@ -2,35 +2,101 @@
 #include "poll.h"
 
 // local
+#include "bufpool.h"
+#include "coro.h"
 #include "jobpool.h"
+#include "metrics.h"
 #include "handler.h"
+#include "timer.h"
+#include "topology.h"
+#include "trace.h"
 // stdlib
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 // systems
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
 #include <signal.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/poll.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
 #include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
 #include <unistd.h>
 // freestanding
+#include <stdint.h>
 #include <stdlib.h>
 #include <sys/types.h>
 
 
-#define POLL_CONNECTION_BACKLOG 10
+// listen backlog, 0 takes net.core.somaxconn which caps it anyway
+#ifndef POLL_ACCEPT_BACKLOG
+#define POLL_ACCEPT_BACKLOG 0
+#endif
+// connections taken off the listener per wakeup, before the connectors get a turn
+#ifndef POLL_ACCEPT_BUDGET
+#define POLL_ACCEPT_BUDGET 64
+#endif
+#define POLL_OVERFLOW_INTERVAL_NS 1000000000L   // between samples of the listen overflow count
+#define POLL_KICK_SIGNAL SIGUSR1
+#define POLL_USAGE_SIGNAL SIGUSR2      // logs a poll: usage:: line with the memory in use, dumps the trace
+#define POLL_KICK_INTERVAL_NS 10000000
+
+// admission control, shed load above either high mark until back under both low marks
+#define POLL_ADMIT_CONN_HIGH_PCT 90     // of the fd table, over all shards
+#define POLL_ADMIT_CONN_LOW_PCT 80
+#define POLL_ADMIT_QUEUE_HIGH 8192      // jobs waiting for a worker, per shard
+#define POLL_ADMIT_QUEUE_LOW 2048
+// 1 accepts and answers 503 while shedding, 0 leaves new connections in the backlog
+#ifndef POLL_ADMIT_REJECT
+#define POLL_ADMIT_REJECT 0
+#endif
+#define POLL_TIMER_TICK_MS 100          // resolution of the connection timeouts
 
 
 /******************************************************************************/
 /* comon */
 /******************************************************************************/
 
-static sig_atomic_t poll_run = 1;
+static volatile sig_atomic_t poll_run = 1;
+static volatile sig_atomic_t poll_usage_requested = 0;
+static int poll_sharded = 0;
+static pthread_t poll_main_thread;
+static _Atomic long poll_overflow_due = 0;     // CLOCK_MONOTONIC_COARSE ns of the next sample
+static _Atomic unsigned long poll_overflow_seen = 0;
 
 static void poll_sigint_handler(int signal)
 {
     (void)signal;
     poll_run = 0;
+
+    // a worker may take the signal, make sure the main ioloop leaves its wait
+    if (!pthread_equal(pthread_self(), poll_main_thread)) {
+        pthread_kill(poll_main_thread, POLL_KICK_SIGNAL);
+    }
+}
+
+static void poll_sigusage_handler(int signal)
+{
+    (void)signal;
+    poll_usage_requested = 1;
+
+    if (!pthread_equal(pthread_self(), poll_main_thread)) {
+        pthread_kill(poll_main_thread, POLL_KICK_SIGNAL);
+    }
+}
+
+static void poll_sigkick_handler(int signal)
+{
+    // nothing to do, only here to interrupt a blocking wait
+    (void)signal;
 }
 
 static void poll_sigint_hook(void)
@@ -42,22 +108,335 @@ static void poll_sigint_hook(void)
     sigemptyset(&sig_int_handler.sa_mask);
     sig_int_handler.sa_flags = 0;
     sigaction(SIGINT, &sig_int_handler, NULL);
+
+    // DEVNOTE: no SA_RESTART, the kick must break select/epoll_wait/accept with EINTR
+    sig_int_handler.sa_handler = poll_sigkick_handler;
+    sigaction(POLL_KICK_SIGNAL, &sig_int_handler, NULL);
+    sig_int_handler.sa_handler = poll_sigusage_handler;
+    sigaction(POLL_USAGE_SIGNAL, &sig_int_handler, NULL);
+
+    // sendfile takes no MSG_NOSIGNAL, a peer resetting mid-file must not end the server
+    sig_int_handler.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sig_int_handler, NULL);
+}
+
+// count the connection as local when its packets are processed on the pinned reactor's cpu
+// DEVNOTE: SO_INCOMING_CPU is the cpu which ran the softirq for the connection's last
+//          packet, the final ack of the handshake for a connection just accepted. Only
+//          asked for with the reactor pinned, which steering requires, an unpinned one
+//          has no cpu of its own and would pay a getsockopt per accept for nothing.
+static void poll_locality_update(int client_sock, int reactor_cpu)
+{
+    int cpu = -1;
+    socklen_t len = sizeof(cpu);
+
+    if (getsockopt(client_sock, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 && cpu == reactor_cpu) {
+        metrics_add(METRIC_ACCEPTED_LOCAL, 1);
+    }
+}
+
+// DEVNOTE: All of it is process-wide, whichever shard wakes up first reports. This is
+//          what bench/density.sh samples per connection count.
+static void poll_usage_report(void)
+{
+    size_t buffer_bytes;
+    size_t buffer_idle_bytes;
+
+    bufpool_usage(&buffer_bytes, &buffer_idle_bytes);
+    fprintf(stderr, "poll: usage:: connections=%d jobtable_bytes=%zu coro_stacks=%ld buffer_bytes=%zu "
+            "buffer_idle_bytes=%zu\n", jobpool_table_used(), jobpool_table_bytes(), coro_stacks(),
+            buffer_bytes, buffer_idle_bytes);
+}
+
+
+
+// read avaiable bytes, the default for pollers which only report readiness
+ssize_t poll_common_recvfd(void * this, int fd, void * buffer, size_t n)
+{
+    ssize_t numRead;                    /* # of bytes fetched by last read() */
+
+    (void)this;
+
+    do {
+        numRead = read(fd, buffer, n);
+    } while (numRead == -1 && errno == EINTR); /* Interrupted --> restart read() */
+
+    return numRead;
+}
+
+// a single sendmsg of the vector, -1 with EAGAIN once the send buffer is full
+// DEVNOTE: MSG_NOSIGNAL, so a reset peer is an error and not a signal. The default for
+//          the readiness based pollers, a worker owns the send side of its connection
+//          while it runs the job. uring submits its sends through the ring instead.
+ssize_t poll_common_sendfd(void * this, int fd, const struct iovec * iov, int iovcnt, int flags)
+{
+    struct msghdr msg;
+    ssize_t numWritten;
+
+    (void)this;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (struct iovec *)iov;
+    msg.msg_iovlen = (size_t)iovcnt;
+
+    do {
+        numWritten = sendmsg(fd, &msg, flags | MSG_NOSIGNAL);
+    } while (numWritten == -1 && errno == EINTR); /* Interrupted --> restart sendmsg() */
+
+    return numWritten;
+}
+
+// a single sendfile of count bytes of in_fd from offset, without a copy through userspace
+ssize_t poll_common_sendfilefd(void * this, int fd, int in_fd, off_t offset, size_t count)
+{
+    ssize_t numWritten;
+
+    (void)this;
+
+    do {
+        numWritten = sendfile(fd, in_fd, &offset, count);
+    } while (numWritten == -1 && errno == EINTR);
+
+    if (numWritten == 0 && count > 0) {
+        errno = EIO;                    // the file got shorter than it was announced
+        return -1;
+    }
+
+    return numWritten;
+}
+
+
+static const char poll_reject_response[] = 
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Content-Length: 0\r\n"
+    "Retry-After: 1\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+// answer straight from the ioloop, the connection never gets a jobnode
+static void poll_reject(struct Poller * poller_class, void * poller_inst, int sockfd)
+{
+    // a fresh socket has an empty send buffer, this never blocks or goes short
+    if (send(sockfd, poll_reject_response, sizeof(poll_reject_response) - 1, MSG_DONTWAIT | MSG_NOSIGNAL) == -1) {
+        // peer gone already, nothing to tell it
+    }
+    metrics_add(METRIC_REJECTED, 1);
+    poller_class->releasefd(poller_inst, sockfd);
+    close(sockfd); // TODO: check close return
+}
+
+// net.core.somaxconn, SOMAXCONN when it can't be read
+static int poll_listen_backlog(void)
+{
+    int backlog = SOMAXCONN;
+
+    if (POLL_ACCEPT_BACKLOG > 0) {
+        return POLL_ACCEPT_BACKLOG;
+    }
+
+    FILE * f = fopen("/proc/sys/net/core/somaxconn", "r");
+    if (NULL != f) {
+        if (fscanf(f, "%d", &backlog) != 1 || backlog <= 0) {
+            backlog = SOMAXCONN;
+        }
+        fclose(f);
+    }
+
+    return backlog;
+}
+
+// TcpExt ListenOverflows, connections dropped because some accept queue was full, -1 on failure
+// DEVNOTE: The kernel only counts these host-wide, every listener adds to the same counter.
+static long poll_listen_overflows(void)
+{
+    char names[4096];
+    char values[4096];
+    long overflows = -1;
+
+    FILE * f = fopen("/proc/net/netstat", "r");
+    if (NULL == f) {
+        return -1;
+    }
+
+    // pairs of lines, a header naming the fields and one with their values
+    while (fgets(names, sizeof(names), f) != NULL && fgets(values, sizeof(values), f) != NULL) {
+        if (strncmp(names, "TcpExt:", 7) != 0) {
+            continue;
+        }
+        char * name_save = NULL;
+        char * value_save = NULL;
+        char * name = strtok_r(names, " \n", &name_save);
+        char * value = strtok_r(values, " \n", &value_save);
+        while (NULL != name && NULL != value) {
+            if (strcmp(name, "ListenOverflows") == 0) {
+                overflows = strtol(value, NULL, 10);
+                break;
+            }
+            name = strtok_r(NULL, " \n", &name_save);
+            value = strtok_r(NULL, " \n", &value_save);
+        }
+        break;
+    }
+    fclose(f);
+
+    return overflows;
+}
+
+// report new accept queue overflows, at most once per interval over all shards
+static void poll_overflow_update(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    long now_ns = now.tv_sec * 1000000000L + now.tv_nsec;
+    long due = atomic_load_explicit(&poll_overflow_due, memory_order_relaxed);
+    if (now_ns < due || !atomic_compare_exchange_strong(&poll_overflow_due, &due, now_ns + POLL_OVERFLOW_INTERVAL_NS)) {
+        return;
+    }
+
+    long overflows = poll_listen_overflows();
+    if (overflows < 0) {
+        return;
+    }
+
+    // the first sample is the baseline, overflows from before the server started don't count
+    unsigned long seen = atomic_exchange_explicit(&poll_overflow_seen, (unsigned long)overflows, memory_order_relaxed);
+    if (due != 0 && (unsigned long)overflows > seen) {
+        metrics_add(METRIC_ACCEPT_OVERFLOWS, (unsigned long)overflows - seen);
+        fprintf(stderr, "poll: accept-overflow:: %lu connections dropped on a full accept queue, accepted=%llu\n",
+                (unsigned long)overflows - seen, (unsigned long long)metrics_get(METRIC_ACCEPTED));
+    }
+}
+
+// hysteresis between the marks, so the listener doesn't flap on every connection
+static void poll_admission_update(struct Poller * poller_class, void * poller_inst, struct jobpool * pool, 
+                                  int conn_high, int conn_low)
+{
+    bool shedding = atomic_load_explicit(&pool->shedding, memory_order_relaxed);
+    int used = jobpool_table_used();
+    long depth = jobq_active_depth(pool);
+
+    if (!shedding && (used >= conn_high || depth >= POLL_ADMIT_QUEUE_HIGH)) {
+        shedding = true;
+    } else if (shedding && used <= conn_low && depth <= POLL_ADMIT_QUEUE_LOW) {
+        shedding = false;
+    } else {
+        return;
+    }
+
+    atomic_store_explicit(&pool->shedding, shedding, memory_order_relaxed);
+    if (!POLL_ADMIT_REJECT && poller_class->pauseaccept(poller_inst, shedding) == -1) {
+        perror("poll: poller_pauseaccept:");
+    }
+    fprintf(stderr, "poll: admission:: %s, connections=%d queued=%ld\n", 
+            shedding? "shedding": "admitting", used, depth);
+}
+
+// BLOCKED -> QUEUED done, hand the job to the workers, 0 when it was shed instead
+static int poll_job_enqueue(struct jobpool * pool, struct jobnode * job, uint64_t pass_ns)
+{
+    job->queued_ns = pass_ns;
+    metrics_add(METRIC_JOBS_QUEUED, 1);
+    trace_record(job->trace_id, TRACE_QUEUED, 0);
+    if (jobq_active_enqueue(pool, job) == -1) {
+        // more waiting than the workers will get to, shed the connection
+        job_done(job);
+        return 0;
+    }
+
+    return 1;
+}
+
+// the job's timer goes off by bound_ms, or earlier when it already does
+static void poll_timer_bound(struct timer_wheel * timers, struct jobnode * job, uint64_t bound_ms)
+{
+    if (bound_ms == UINT64_MAX) {
+        return;
+    }
+
+    uint64_t tick = bound_ms / POLL_TIMER_TICK_MS + (bound_ms % POLL_TIMER_TICK_MS != 0);
+    if (NULL == job->timer.pprev || job->timer.expire > tick) {
+        timer_wheel_del(timers, &job->timer);
+        timer_wheel_add(timers, &job->timer, tick);
+    }
+}
+
+// queue the jobs past their deadline with expired set, the workers close them
+// DEVNOTE: Workers only ever move deadline_ms, the wheel is the ioloop's alone. A timer
+//          stays at its tick until it goes off, then looks at the deadline as it is now
+//          and moves on to it when that is still ahead. A deadline a worker sets is at
+//          least the shortest timeout away, or a head's kept one, so queueing a job pulls
+//          its timer in to the shortest timeout and nothing else has to. That is one wheel
+//          add when a timer goes off early and at most one per event, none for a quiet
+//          connection until its deadline. A job a worker holds, or one just expired, is
+//          looked at again on the next tick, until it blocks or is reaped.
+static int poll_timers_expire(struct timer_wheel * timers, struct jobpool * pool, uint64_t now_ms, uint64_t pass_ns)
+{
+    int queued = 0;
+    uint64_t now_tick = now_ms / POLL_TIMER_TICK_MS;
+    struct timer_node * node = timer_wheel_advance(timers, now_tick);
+
+    while (NULL != node) {
+        struct timer_node * next = node->next;
+        struct jobnode * job = (struct jobnode *)(void *)((char *)node - offsetof(struct jobnode, timer));
+        job_state_e expected = JOB_BLOCKED;
+
+        // the deadline written before BLOCKED is visible once BLOCKED is
+        bool blocked = atomic_load(&job->state) == JOB_BLOCKED;
+        uint64_t deadline = atomic_load_explicit(&job->deadline_ms, memory_order_relaxed);
+        if (blocked && deadline > now_ms) {
+            poll_timer_bound(timers, job, deadline);
+        } else if (blocked && atomic_compare_exchange_strong(&job->state, &expected, JOB_QUEUED)) {
+            // a send still out in the kernel fails instead of going on once the job let go
+            shutdown(job->sockfd, SHUT_RDWR);
+            job->expired = 1;
+            metrics_add(METRIC_TIMEOUTS, 1);
+            queued += poll_job_enqueue(pool, job, pass_ns);
+            timer_wheel_add(timers, node, now_tick + 1);
+        } else {
+            timer_wheel_add(timers, node, now_tick + 1);
+        }
+        node = next;
+    }
+
+    return queued;
 }
 
+// ms until the next tick with timers due, -1 for none
+static int poll_timers_timeout(const struct timer_wheel * timers, uint64_t now_ms)
+{
+    uint64_t next = timer_wheel_next(timers);
+    if (next == TIMER_NONE) {
+        return -1;
+    }
+
+    uint64_t due_ms = next * POLL_TIMER_TICK_MS;
+    if (due_ms <= now_ms) {
+        return 0;
+    }
 
+    return (due_ms - now_ms < INT_MAX)? (int)(due_ms - now_ms): INT_MAX;
+}
 
-int poll_ioloop(int server_socket, struct Poller * poller_class, void * poller_inst)
+int poll_ioloop(int server_socket, struct Poller * poller_class, void * poller_inst, struct jobpool * pool)
 {
 
     int rc = -1;
 
+    // hanlde server closing, hooked before listening so a client can't signal too early
+    if (!poll_sharded) {
+        poll_main_thread = pthread_self();
+        poll_sigint_hook(); // TODO: add cleanup code
+    }
+
     // listen 
-    rc = listen(server_socket, POLL_CONNECTION_BACKLOG); // TODO: cleanup code
+    int backlog = poll_listen_backlog();
+    rc = listen(server_socket, backlog); // TODO: cleanup code
     if (rc == -1) {
         perror("poll: listen:");
         return -1;
     }
-    printf("poll: listening:: On socket %d\n", server_socket);
+    printf("poll: listening:: On socket %d, backlog %d\n", server_socket, backlog);
 
     // init the poller
     rc = poller_class->init(poller_inst, server_socket);
@@ -66,8 +445,18 @@ int poll_ioloop(int server_socket, struct Poller * poller_class, void * poller_i
         return -1;
     }
 
-    // hanlde server closing
-    poll_sigint_hook(); // TODO: add cleanup code
+    // let workers re-arm and hand back jobs through this poller
+    jobpool_poller_attach(pool, poller_class, poller_inst);
+    metrics_attach(METRICS_REACTOR);
+
+    int capacity = jobpool_table_capacity();
+    int conn_high = (int)((long)capacity * POLL_ADMIT_CONN_HIGH_PCT / 100);
+    int conn_low = (int)((long)capacity * POLL_ADMIT_CONN_LOW_PCT / 100);
+
+    // connection timeouts, the wheel stays empty without any
+    bool timeouts = jobpool_timeout_min() != 0;
+    struct timer_wheel timers;
+    timer_wheel_init(&timers, jobpool_clock_ms() / POLL_TIMER_TICK_MS);
 
     // selectloop
     //int lll = 0;
@@ -81,30 +470,61 @@ int poll_ioloop(int server_socket, struct Poller * poller_class, void * poller_i
         */
 
         // Wait for event
-        rc = poller_class->wait(poller_inst);
+        rc = poller_class->wait(poller_inst, poll_timers_timeout(&timers, jobpool_clock_ms()));
+        uint64_t pass_ns = metrics_now_ns();
+        uint64_t now_ms = jobpool_clock_ms();
+        metrics_add(METRIC_WAKEUPS, 1);
+        if (poll_usage_requested) {
+            poll_usage_requested = 0;
+            poll_usage_report();
+            trace_dump();
+        }
         if (rc == -1) { // TODO: WARN: OOB data is ignored
-            perror("poll: poller_wait:");
+            if (errno != EINTR) {
+                perror("poll: poller_wait:");
+            }
             continue;
         }
 
-        // Try accepting connection
-        int client_sock = -1;
-        rc = poller_class->try_acceptfd(poller_inst, &client_sock);
-        if (rc == -1) {
-            perror("poll: poller_try_acceptfd:");
-        } else if(client_sock == -1) {
-            // no errors, but no sockets to accept
-        } else {
-            struct jobnode* job = jobpool_free_acquire(client_sock); // DEVNOTE: socket set, job-state changed
+        // Accept until the listener runs dry or the budget is spent
+        // DEVNOTE: One accept per wakeup leaves a connection storm sitting in the accept
+        //          queue until it overflows. The budget bounds how long the connectors
+        //          already here wait for their turn.
+        for (int burst = 0; burst < POLL_ACCEPT_BUDGET; burst++) {
+            int client_sock = -1;
+            rc = poller_class->try_acceptfd(poller_inst, &client_sock);
+            if (rc == -1) {
+                perror("poll: poller_try_acceptfd:");
+                break;
+            } else if(client_sock == -1) {
+                // no errors, but no sockets to accept
+                break;
+            }
+            metrics_add(METRIC_ACCEPTED, 1);
+            if (pool->cpu >= 0) {
+                poll_locality_update(client_sock, pool->cpu);
+            }
+            if (POLL_ADMIT_REJECT && atomic_load_explicit(&pool->shedding, memory_order_relaxed)) {
+                poll_reject(poller_class, poller_inst, client_sock);
+                continue;
+            }
+            struct jobnode* job = jobpool_free_acquire(pool, client_sock); // DEVNOTE: socket set, job-state changed
             if (NULL == job) {
                 perror("poll: poller_try_acceptfd: job creation");
+                poller_class->releasefd(poller_inst, client_sock);
                 close(client_sock); // TODO: check close return
-            } else {    
-                atomic_store(&job->state, JOB_BLOCKED); // Note: Atomic not really necessary
+                break;
+            }
+            job->trace_id = trace_sample();
+            trace_record(job->trace_id, TRACE_ACCEPT, (uint64_t)client_sock);
+            atomic_store(&job->state, JOB_BLOCKED); // Note: Atomic not really necessary
+            if (timeouts) {
+                poll_timer_bound(&timers, job, atomic_load_explicit(&job->deadline_ms, memory_order_relaxed));
             }
         }
 
         // run through the existing connections looking for data to read
+        int queued = 0;
         sock_state_e sock_state = SOCK_UNKNOWN;
         poller_class->iterator_reset(poller_inst);
         int fd_iterator = poller_class->iterator_getfd(poller_inst, &sock_state);
@@ -116,7 +536,7 @@ int poll_ioloop(int server_socket, struct Poller * poller_class, void * poller_i
                 // TODO TODO TODO TODO
                 // TODO: add remote shutdown case based sock_state
             } else {
-                struct jobnode * job = jobpool_get(fd_iterator);
+                struct jobnode * job = jobpool_get(pool, fd_iterator);
                 if (NULL == job) {
                     fprintf(stderr, "poll: illegal-state:: Terminating server sock=%d, state=%d\n", fd_iterator, sock_state);
                     // TODO: listen cleanup before exiting
@@ -125,10 +545,15 @@ int poll_ioloop(int server_socket, struct Poller * poller_class, void * poller_i
                 
                 //printf("Before enqueue state: %d\n", job->state);
                 job_state_e expected = JOB_BLOCKED;
-                if (atomic_compare_exchange_strong(&job->state, &expected, JOB_QUEUED)) {
-                    // TODO TODO TODO TODO
+                if (atomic_compare_exchange_strong(&job->state, &expected, JOB_QUEUED) ||
+                    (expected == JOB_ARMING && atomic_compare_exchange_strong(&job->state, &expected, JOB_QUEUED))) {
+                    // DEVNOTE: one-shot pollers have disarmed the fd already, level-triggered
+                    //          ones keep reporting it and the CAS above filters it out
                     // TODO: must remove job from select fds
-                    jobq_active_enqueue(job);
+                    if (timeouts) {
+                        poll_timer_bound(&timers, job, now_ms + jobpool_timeout_min());
+                    }
+                    queued += poll_job_enqueue(pool, job, pass_ns);
                     //printf("enqueueq\n");
                 }
             }
@@ -154,21 +579,31 @@ int poll_ioloop(int server_socket, struct Poller * poller_class, void * poller_i
             fd_iterator = poller_class->iterator_getfd(poller_inst, &sock_state);
         }
 
-        // TODO TODO TODO TODO
-        // TODO This is inefficient, we can just have a queue for cleanup
-        // Cleanup all fds marked for cleanup
-        int max_fd = poller_class->maxfd(poller_inst);
-        for (int sockfd = server_socket; sockfd <= max_fd; sockfd++) {
+        queued += poll_timers_expire(&timers, pool, now_ms, pass_ns);
+
+        // one wakeup per queued job, and only for parked workers
+        jobq_active_wake(pool, queued);
+
+        // Cleanup the jobs workers finished since the last pass
+        struct jobnode * done = NULL;
+        while (NULL != (done = jobq_done_dequeue(pool))) {
+            int sockfd = done->sockfd;
+            metrics_add(METRIC_JOBS_REAPED, 1);
             job_state_e expected = JOB_DONE;
-            struct jobnode * job = jobpool_get(sockfd);
-            if (NULL == job) {
-                continue;
-            } else if (atomic_compare_exchange_strong(&job->state, &expected, JOB_UNINITED)) {
+            if (atomic_compare_exchange_strong(&done->state, &expected, JOB_UNINITED)) {
+                // DEVNOTE: the node is free before the fd is, another shard may
+                //          accept the same fd number right after the close
+                timer_wheel_del(&timers, &done->timer);
+                jobpool_free_release(pool, sockfd);
                 poller_class->releasefd(poller_inst, sockfd);
                 close(sockfd); // TODO: check returns
-                jobpool_free_release(sockfd);
             }
         }
+        metrics_set(METRIC_CONNECTIONS, (uint64_t)pool->active_count);
+        metrics_set(METRIC_QUEUE_DEPTH, (uint64_t)jobq_active_depth(pool));
+
+        poll_admission_update(poller_class, poller_inst, pool, conn_high, conn_low);
+        poll_overflow_update();
     }
 
     poller_class->deinit(poller_inst);
@@ -177,37 +612,244 @@ int poll_ioloop(int server_socket, struct Poller * poller_class, void * poller_i
     return 0;
 }
 
+static void * poll_shard_run(void * param)
+{
+    struct poll_shard * shard = param;
+
+    shard->rc = poll_ioloop(shard->server_socket, shard->poller_class, shard->poller_inst, shard->pool);
+
+    return NULL;
+}
+
+// DEVNOTE: Shard 0 runs on the calling thread and is the only one taking SIGINT. The
+//          other shards are interrupted with POLL_KICK_SIGNAL once it returns. The kick
+//          is repeated until they join, since it can land just before their wait.
+int poll_ioloop_sharded(struct poll_shard * shards, int count)
+{
+    int rc = -1;
+    sigset_t sigint_set;
+    sigset_t saved_set;
+    struct timespec deadline;
+    pthread_attr_t attr;
+
+    poll_sharded = 1;
+    poll_main_thread = pthread_self();
+    poll_sigint_hook();
+
+    sigemptyset(&sigint_set);
+    sigaddset(&sigint_set, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &sigint_set, &saved_set);
+
+    int started = 1;
+    for (; started < count; started++) {
+        pthread_attr_init(&attr);
+        rc = (topology_attr_set(&attr, shards[started].cpu) == 0)? 
+             pthread_create(&shards[started].thread, &attr, poll_shard_run, &shards[started]): EINVAL;
+        pthread_attr_destroy(&attr);
+        if (rc != 0) {
+            fprintf(stderr, "poll: shard-create:: %s\n", strerror(rc));
+            poll_run = 0;
+            break;
+        }
+    }
+
+    pthread_sigmask(SIG_SETMASK, &saved_set, NULL);
+
+    // only now, the shard threads would have inherited it
+    topology_pin_self(shards[0].cpu);
+    shards[0].thread = poll_main_thread;
+    shards[0].rc = (poll_run)? poll_ioloop(shards[0].server_socket, shards[0].poller_class, 
+                                           shards[0].poller_inst, shards[0].pool): -1;
+
+    poll_run = 0;
+    rc = shards[0].rc;
+    for (int i = 1; i < started; i++) {
+        do {
+            pthread_kill(shards[i].thread, POLL_KICK_SIGNAL);
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += POLL_KICK_INTERVAL_NS;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec += 1;
+                deadline.tv_nsec -= 1000000000;
+            }
+        } while (pthread_timedjoin_np(shards[i].thread, NULL, &deadline) == ETIMEDOUT);
+        rc = (shards[i].rc != 0)? shards[i].rc: rc;
+    }
+
+    return rc;
+}
+
 /******************************************************************************/
 /* accept - new */
 /******************************************************************************/
 
+#define ACCEPT_PENDING_MAX 64
+
+// DEVNOTE: The listener and the connectors workers rearmed are polled together. rearmfd
+//          lists the fd under the lock and kicks the eventfd, the next wait moves the
+//          listed ones into its pollfd array. A reported connector leaves the array again,
+//          like EPOLLONESHOT, so it is only polled while its job is blocked.
+struct AcceptConn {
+    int next_rearmed;                   // intrusive list, lock
+    int slot;                           // index in pfds plus one, 0 while not polled, ioloop only
+    uint8_t want;                       // sock_state_e of the last rearm, lock
+    uint8_t listed;                     // on the rearmed list, lock
+    uint8_t armed;                      // rearmed since it was released, lock
+};
+
 struct AcceptPoller {
     int server_socket;
-    int connector_socket;
+    int eventfd;
+    int pending[ACCEPT_PENDING_MAX];    // accepted since the last wait, each reported once
+    int pending_count;
+    int pending_cur;
+    int * ready;                        // connectors the last wait reported
+    int ready_count;
+    int ready_cur;
+    struct pollfd * pfds;               // listener, eventfd, then the polled connectors
+    int pfd_count;
+    struct AcceptConn * conns;
+    int conn_max;
+    int rearmed_head;                   // lock
+    pthread_mutex_t lock;
     int fd_max_value;
+    int paused;
 };
 
-// TODO check sizeof AcceptPoller against IOLOOP_INST_SIZE_MAX 
+_Static_assert(sizeof(struct AcceptPoller) <= IOLOOP_INST_SIZE_MAX, "AcceptPoller exceeds IOLOOP_INST_SIZE_MAX");
+
+void AcceptPoller_deinit(void * this)
+{
+    struct AcceptPoller* self = this;
+
+    if (self->eventfd != -1) {
+        close(self->eventfd);
+    }
+    free(self->conns);
+    free(self->ready);
+    free(self->pfds);
+    pthread_mutex_destroy(&self->lock);
+}
 
 int AcceptPoller_init(void * this, int server_socket)
 {
     struct AcceptPoller* self = this;
-    
+    struct rlimit nofile;
+
+    memset(self, 0, sizeof(*self));
+    self->eventfd = -1;
+    self->rearmed_head = -1;
     self->server_socket = server_socket;
-    self->connector_socket = -1;
+    self->fd_max_value = server_socket;
+    pthread_mutex_init(&self->lock, NULL);
+
+    // wait blocks on the listener, accept drains it without blocking
+    int flags = fcntl(server_socket, F_GETFL);
+    if (flags == -1 || fcntl(server_socket, F_SETFL, flags | O_NONBLOCK) == -1) {
+        perror("poll-accept: fcntl:");
+        AcceptPoller_deinit(self);
+        return -1;
+    }
+
+    // per-fd state, the fd table can't grow past the soft limit
+    if (getrlimit(RLIMIT_NOFILE, &nofile) == -1) {
+        perror("poll-accept: getrlimit:");
+        AcceptPoller_deinit(self);
+        return -1;
+    }
+    self->conn_max = (nofile.rlim_cur < INT_MAX)? (int)nofile.rlim_cur: INT_MAX;
+    self->conns = calloc((size_t)self->conn_max, sizeof(struct AcceptConn));
+    self->ready = malloc(sizeof(int) * (size_t)self->conn_max);
+    self->pfds = malloc(sizeof(struct pollfd) * ((size_t)self->conn_max + 2));
+    if (NULL == self->conns || NULL == self->ready || NULL == self->pfds) {
+        perror("poll-accept: malloc:");
+        AcceptPoller_deinit(self);
+        return -1;
+    }
+
+    self->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (self->eventfd == -1) {
+        perror("poll-accept: eventfd:");
+        AcceptPoller_deinit(self);
+        return -1;
+    }
+
+    self->pfds[0] = (struct pollfd){ .fd = server_socket, .events = POLLIN, .revents = 0 };
+    self->pfds[1] = (struct pollfd){ .fd = self->eventfd, .events = POLLIN, .revents = 0 };
+    self->pfd_count = 2;
 
     return 0;
 }
 
-void AcceptPoller_deinit(void * this)
+// ioloop only
+static void accept_pfd_remove(struct AcceptPoller * self, int fd)
 {
-    // nothing to do
-    (void)this;
+    struct AcceptConn * conn = &self->conns[fd];
+    int idx = conn->slot - 1;
+
+    self->pfd_count -= 1;
+    if (idx != self->pfd_count) {
+        self->pfds[idx] = self->pfds[self->pfd_count];
+        self->conns[self->pfds[idx].fd].slot = idx + 1;
+    }
+    conn->slot = 0;
 }
 
-int AcceptPoller_wait(void * this)
+int AcceptPoller_wait(void * this, int timeout_ms)
 {
-    (void)this;
+    struct AcceptPoller* self = this;
+
+    self->pending_count = 0;
+    self->pending_cur = 0;
+    self->ready_count = 0;
+    self->ready_cur = 0;
+
+    // the connectors rearmed since the last wait join the poll
+    pthread_mutex_lock(&self->lock);
+    while (self->rearmed_head != -1) {
+        int fd = self->rearmed_head;
+        struct AcceptConn * conn = &self->conns[fd];
+        self->rearmed_head = conn->next_rearmed;
+        conn->listed = 0;
+        if (!conn->armed) {
+            continue;   // released since
+        }
+        // POLLERR is always reported, it is all a zero-copy completion raises
+        short events = (conn->want == SOCK_READABLE)? POLLIN | POLLRDHUP:
+                       (conn->want == SOCK_WRITABLE)? POLLOUT: 0;
+        if (conn->slot == 0) {
+            self->pfds[self->pfd_count] = (struct pollfd){ .fd = fd, .events = events, .revents = 0 };
+            self->pfd_count += 1;
+            conn->slot = self->pfd_count;
+        } else {
+            self->pfds[conn->slot - 1].events = events;
+        }
+    }
+    pthread_mutex_unlock(&self->lock);
+
+    // a negative fd is skipped, the listener sits out while accepting is paused
+    self->pfds[0].fd = self->paused? -1: self->server_socket;
+    int rc = poll(self->pfds, (nfds_t)self->pfd_count, timeout_ms);
+    if (rc == -1) {
+        return (errno == EINTR)? 0: -1;
+    }
+
+    if (self->pfds[1].revents != 0) {
+        uint64_t count;
+        if (read(self->eventfd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+            perror("poll-accept: eventfd read:");
+        }
+    }
+    // reported connectors leave the poll until they are rearmed
+    for (int i = 2; i < self->pfd_count; ) {
+        if (self->pfds[i].revents != 0) {
+            int fd = self->pfds[i].fd;
+            self->ready[self->ready_count++] = fd;
+            accept_pfd_remove(self, fd);
+        } else {
+            i++;
+        }
+    }
 
     return 0;
 }
@@ -220,15 +862,41 @@ int AcceptPoller_try_acceptfd(void * this, int * sockfd)
     struct AcceptPoller* self = this;
     connector_addr_size = sizeof(connector_addr);
 
-    self->connector_socket = accept4(self->server_socket, (struct sockaddr *)&connector_addr, 
-                                    &connector_addr_size, SOCK_NONBLOCK);
-    if (self->connector_socket == -1) {
-        return -1;
-    } else {
-        *sockfd = self->connector_socket;
-        self->fd_max_value = (self->fd_max_value < self->connector_socket)? self->connector_socket: self->fd_max_value;        
+    if (self->paused || self->pending_count == ACCEPT_PENDING_MAX) {
         return 0;
     }
+
+    int connector_socket = accept4(self->server_socket, (struct sockaddr *)&connector_addr, 
+                                   &connector_addr_size, SOCK_NONBLOCK);
+    if (connector_socket == -1) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)? 0: -1;
+    }
+    if (connector_socket >= self->conn_max) {
+        close(connector_socket);
+        errno = EMFILE;
+        return -1;
+    }
+
+    self->pending[self->pending_count] = connector_socket;
+    self->pending_count += 1;
+    *sockfd = connector_socket;
+    self->fd_max_value = (self->fd_max_value < connector_socket)? connector_socket: self->fd_max_value;        
+
+    return 0;
+}
+
+// nothing is polled before the first rearm
+int AcceptPoller_addfd(void * this, int fd)
+{
+    struct AcceptPoller* self = this;
+
+    if (fd >= self->conn_max) {
+        errno = EMFILE;
+        return -1;
+    }
+    self->fd_max_value = (self->fd_max_value < fd)? fd: self->fd_max_value;
+
+    return 0;
 }
 
 void AcceptPoller_iterator_reset(void * this)
@@ -237,61 +905,156 @@ void AcceptPoller_iterator_reset(void * this)
     (void)this;
 }
 
+// the sockets just accepted, then the connectors the wait reported
 int AcceptPoller_iterator_getfd(void * this, sock_state_e * sock_state)
 {
     struct AcceptPoller* self = this;
 
-    int temp = self->connector_socket;
-    
-    self->connector_socket = -1;
-
     *sock_state = SOCK_READABLE; // TODO: blindly setting readable might not work in all cases
 
-    return temp;
+    if (self->pending_cur < self->pending_count) {
+        return self->pending[self->pending_cur++];
+    } else if (self->ready_cur < self->ready_count) {
+        return self->ready[self->ready_cur++];
+    }
+
+    return -1;
 }
 
-void AcceptPoller_releasefd(void * this, int fd)
+int AcceptPoller_rearmfd(void * this, int fd, sock_state_e want)
 {
     struct AcceptPoller* self = this;
+    uint64_t one = 1;
 
-    if (fd == self->fd_max_value) {
-        self->fd_max_value -= 1;
+    if (fd >= self->conn_max) {
+        errno = EMFILE;
+        return -1;
+    }
+
+    pthread_mutex_lock(&self->lock);
+    struct AcceptConn * conn = &self->conns[fd];
+    conn->want = (uint8_t)want;
+    conn->armed = 1;
+    if (!conn->listed) {
+        conn->listed = 1;
+        conn->next_rearmed = self->rearmed_head;
+        self->rearmed_head = fd;
+    }
+    pthread_mutex_unlock(&self->lock);
+
+    // the ioloop's poll doesn't have the fd yet
+    if (write(self->eventfd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        return -1;
     }
+
+    return 0;
 }
 
-int AcceptPoller_maxfd(void * this)
+void AcceptPoller_notify(void * this)
 {
     struct AcceptPoller* self = this;
+    uint64_t one = 1;
 
-    return self->fd_max_value;
+    if (write(self->eventfd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        perror("poll-accept: eventfd write:");
+    }
 }
 
-struct Poller poller_accept = {
-    .init = AcceptPoller_init,
-    .deinit = AcceptPoller_deinit,
-    .wait = AcceptPoller_wait,
-    .try_acceptfd = AcceptPoller_try_acceptfd,
-    .iterator_reset = AcceptPoller_iterator_reset,
-    .iterator_getfd = AcceptPoller_iterator_getfd,
-    .releasefd = AcceptPoller_releasefd,
-    .maxfd =  AcceptPoller_maxfd
-};
+int AcceptPoller_pauseaccept(void * this, int paused)
+{
+    struct AcceptPoller* self = this;
 
-/******************************************************************************/
+    self->paused = paused;
+
+    return 0;
+}
+
+void AcceptPoller_releasefd(void * this, int fd)
+{
+    struct AcceptPoller* self = this;
+
+    if (fd < self->conn_max) {
+        pthread_mutex_lock(&self->lock);
+        self->conns[fd].armed = 0;
+        pthread_mutex_unlock(&self->lock);
+        if (self->conns[fd].slot != 0) {
+            accept_pfd_remove(self, fd);
+        }
+    }
+
+    if (fd == self->fd_max_value) {
+        self->fd_max_value -= 1;
+    }
+}
+
+int AcceptPoller_maxfd(void * this)
+{
+    struct AcceptPoller* self = this;
+
+    return self->fd_max_value;
+}
+
+struct Poller poller_accept = {
+    .init = AcceptPoller_init,
+    .deinit = AcceptPoller_deinit,
+    .wait = AcceptPoller_wait,
+    .try_acceptfd = AcceptPoller_try_acceptfd,
+    .addfd = AcceptPoller_addfd,
+    .iterator_reset = AcceptPoller_iterator_reset,
+    .iterator_getfd = AcceptPoller_iterator_getfd,
+    .rearmfd = AcceptPoller_rearmfd,
+    .notify = AcceptPoller_notify,
+    .pauseaccept = AcceptPoller_pauseaccept,
+    .recvfd = poll_common_recvfd,
+    .sendfd = poll_common_sendfd,
+    .sendfilefd = poll_common_sendfilefd,
+    .releasefd = AcceptPoller_releasefd,
+    .maxfd =  AcceptPoller_maxfd
+};
+
+/******************************************************************************/
 /* select - new */
 /******************************************************************************/
 
+#define SELECT_WANT_WORDS (FD_SETSIZE / (8 * sizeof(unsigned long)))
+
 struct SelectPoller {
     fd_set all_fds;
     fd_set cached_read_fds;
     fd_set cached_write_fds;
+    _Atomic unsigned long want_out[SELECT_WANT_WORDS];  // rearmfd, jobs waiting to send more
     int fd_max_value;
     int fd_count;
     int server_socket;
+    int eventfd;                        // notify and writable rearms wake the select up
     int iterator;
 };
 
-// TODO check sizeof SelectPoller against IOLOOP_INST_SIZE_MAX 
+_Static_assert(sizeof(struct SelectPoller) <= IOLOOP_INST_SIZE_MAX, "SelectPoller exceeds IOLOOP_INST_SIZE_MAX");
+
+// returns 1 when the interest changed
+static int select_want_out(struct SelectPoller * self, int fd, int out)
+{
+    unsigned long bit = 1UL << ((unsigned)fd % (8 * sizeof(unsigned long)));
+    _Atomic unsigned long * word = &self->want_out[(unsigned)fd / (8 * sizeof(unsigned long))];
+    unsigned long prev = 0;
+
+    if (out) {
+        prev = atomic_fetch_or_explicit(word, bit, memory_order_relaxed);
+    } else {
+        prev = atomic_fetch_and_explicit(word, ~bit, memory_order_relaxed);
+    }
+
+    return ((prev & bit) != 0) != (out != 0);
+}
+
+static int select_wants_out(struct SelectPoller * self, int fd)
+{
+    unsigned long bit = 1UL << ((unsigned)fd % (8 * sizeof(unsigned long)));
+
+    return (atomic_load_explicit(&self->want_out[(unsigned)fd / (8 * sizeof(unsigned long))],
+                                 memory_order_relaxed) & bit) != 0;
+}
 
 int SelectPoller_init(void * this, int server_socket)
 {
@@ -301,29 +1064,73 @@ int SelectPoller_init(void * this, int server_socket)
 
     FD_ZERO(&self->cached_read_fds);
     FD_ZERO(&self->cached_write_fds);
+    for (size_t i = 0; i < SELECT_WANT_WORDS; i++) {
+        atomic_init(&self->want_out[i], 0);
+    }
 
-    FD_SET(server_socket, &self->all_fds);
-    self->fd_max_value = server_socket;
-    self->fd_count = 1;
     self->server_socket = server_socket;
+    self->fd_max_value = server_socket;
+    self->fd_count = 0;
     self->iterator = 0;
 
+    self->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (self->eventfd == -1) {
+        perror("poll-select: eventfd:");
+        return -1;
+    } else if (FD_SETSIZE <= self->eventfd) {
+        fprintf(stderr, "poll-select: eventfd:: doesn't fit an fd_set\n");
+        close(self->eventfd);
+        self->eventfd = -1;
+        return -1;
+    }
+
+    // no listener, the caller adds the connectors it opens
+    if (server_socket < 0) {
+        return 0;
+    }
+
+    FD_SET(server_socket, &self->all_fds);
+    self->fd_count = 1;
+    // accept drains the listener, the last call must not block
+    int flags = fcntl(server_socket, F_GETFL);
+    if (flags == -1 || fcntl(server_socket, F_SETFL, flags | O_NONBLOCK) == -1) {
+        perror("poll-select: fcntl:");
+        return -1;
+    }
+
     return 0;
 }
 
 void SelectPoller_deinit(void * this)
 {
-    // nothing to do
-    (void)this;
+    struct SelectPoller* self = this;
+
+    if (self->eventfd != -1) {
+        close(self->eventfd);
+        self->eventfd = -1;
+    }
 }
 
-int SelectPoller_wait(void * this)
+int SelectPoller_wait(void * this, int timeout_ms)
 {
     struct SelectPoller* self = this;
 
     // we mutate the list we read, so make a cache
+    // DEVNOTE: An idle connector is always writable, only the jobs waiting to send go
+    //          into the write set or select would never block. Those leave the read set,
+    //          a pipelined request must not wake the reactor while their send is stuck.
     memcpy(&self->cached_read_fds, &self->all_fds, sizeof(fd_set));
-    memcpy(&self->cached_write_fds, &self->all_fds, sizeof(fd_set));
+    FD_SET(self->eventfd, &self->cached_read_fds);
+    FD_ZERO(&self->cached_write_fds);
+    for (size_t i = 0; i < SELECT_WANT_WORDS; i++) {
+        unsigned long word = atomic_load_explicit(&self->want_out[i], memory_order_relaxed);
+        while (word != 0) {
+            int fd = (int)(i * 8 * sizeof(unsigned long)) + __builtin_ctzl(word);
+            word &= word - 1;
+            FD_SET(fd, &self->cached_write_fds);
+            FD_CLR(fd, &self->cached_read_fds);
+        }
+    }
 
     // TODO: Major TODO: Currently the read and write calls within the process callbacks
     //                   are blocking. We need to make them non-blockin for optimal use of
@@ -336,9 +1143,21 @@ int SelectPoller_wait(void * this)
 
     // Wait for event
     // TODO: out of band data is not considered, which would have appeared as part of the except fd set
-    return select(self->fd_max_value+1, 
-            &self->cached_read_fds, &self->cached_write_fds, NULL, NULL);
+    struct timeval timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+    int nfds = (self->fd_max_value < self->eventfd)? self->eventfd: self->fd_max_value;
+    int ret = select(nfds+1,
+            &self->cached_read_fds, &self->cached_write_fds, NULL, (timeout_ms < 0)? NULL: &timeout);
+    if (ret == -1 && errno == EINTR) {
+        return 0;
+    } else if (ret > 0 && FD_ISSET(self->eventfd, &self->cached_read_fds)) {
+        uint64_t count = 0;
+        if (read(self->eventfd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+            perror("poll-select: eventfd read:");
+        }
+        FD_CLR(self->eventfd, &self->cached_read_fds);
+    }
 
+    return ret;
 }
 
 int SelectPoller_try_acceptfd(void * this, int * sockfd)
@@ -349,7 +1168,7 @@ int SelectPoller_try_acceptfd(void * this, int * sockfd)
     int connector_socket = -1;
     struct sockaddr_storage connector_addr; // connector's address information
 
-    if (FD_ISSET(self->server_socket, &self->cached_read_fds)) {
+    if (self->server_socket >= 0 && FD_ISSET(self->server_socket, &self->cached_read_fds)) {
 
         // try to accept a connection
         connector_addr_size = sizeof(connector_addr);
@@ -357,10 +1176,13 @@ int SelectPoller_try_acceptfd(void * this, int * sockfd)
                 (struct sockaddr *)&connector_addr, &connector_addr_size, SOCK_NONBLOCK);
 
         // limits to accepting connection
-        if (connector_socket == -1) { // error case
+        if (connector_socket == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) { // drained
+            FD_CLR(self->server_socket, &self->cached_read_fds);
+            return 0;
+        } else if (connector_socket == -1) { // error case
             perror("poll-select: accept:");
             return -1;            
-        } else if (FD_SETSIZE > self->fd_count) { // accept connection
+        } else if (FD_SETSIZE > self->fd_count && FD_SETSIZE > connector_socket) { // accept connection
             //char *connector_add_str = NULL;
             FD_SET(connector_socket, &self->all_fds);
             self->fd_max_value = (self->fd_max_value < connector_socket)? connector_socket: self->fd_max_value;
@@ -372,6 +1194,7 @@ int SelectPoller_try_acceptfd(void * this, int * sockfd)
             return 0;
         } else { // can't accept any more connections
             fprintf(stderr, "poll-select: fd-count:: read_fds can't accomodate more fds\n");
+            close(connector_socket);
             return -1;            
         }
     } else {
@@ -379,6 +1202,22 @@ int SelectPoller_try_acceptfd(void * this, int * sockfd)
     }
 }
 
+int SelectPoller_addfd(void * this, int fd)
+{
+    struct SelectPoller* self = this;
+
+    if (FD_SETSIZE <= self->fd_count || FD_SETSIZE <= fd) {
+        errno = EMFILE;
+        return -1;
+    }
+
+    FD_SET(fd, &self->all_fds);
+    self->fd_max_value = (self->fd_max_value < fd)? fd: self->fd_max_value;
+    self->fd_count += 1;
+
+    return 0;
+}
+
 void SelectPoller_iterator_reset(void * this)
 {
     struct SelectPoller* self = this;
@@ -395,12 +1234,15 @@ int SelectPoller_iterator_getfd(void * this, sock_state_e * sock_state)
         return -1; 
     }
 
+    // a job waiting to send is due once it can, the others once there is something to read
     int readable = FD_ISSET(self->iterator, &self->cached_read_fds);
     int writeable = FD_ISSET(self->iterator, &self->cached_write_fds);
-    while (self->iterator == self->server_socket || readable == 0 || writeable == 0) {
+    int out = select_wants_out(self, self->iterator);
+    while (self->iterator == self->server_socket || (out? writeable == 0: readable == 0)) {
         self->iterator += 1;
         readable = FD_ISSET(self->iterator, &self->cached_read_fds);
         writeable = FD_ISSET(self->iterator, &self->cached_write_fds);
+        out = select_wants_out(self, self->iterator);
         if (self->iterator > self->fd_max_value) {
             return -1;    
         }
@@ -416,11 +1258,50 @@ int SelectPoller_iterator_getfd(void * this, sock_state_e * sock_state)
     return (self->iterator - 1); // return the last value before increment
 }
 
+void SelectPoller_notify(void * this)
+{
+    struct SelectPoller* self = this;
+    uint64_t one = 1;
+
+    if (write(self->eventfd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        perror("poll-select: eventfd write:");
+    }
+}
+
+// select is level-triggered and fds stay in all_fds, only the interest changes
+// DEVNOTE: Errors and zero-copy completions show up as readable and writable, a job
+//          waiting for them is reported like one waiting to read. A changed interest
+//          kicks the eventfd, the reactor has to rebuild its sets for it.
+int SelectPoller_rearmfd(void * this, int fd, sock_state_e want)
+{
+    struct SelectPoller* self = this;
+
+    if (select_want_out(self, fd, want == SOCK_WRITABLE)) {
+        SelectPoller_notify(self);
+    }
+
+    return 0;
+}
+
+int SelectPoller_pauseaccept(void * this, int paused)
+{
+    struct SelectPoller* self = this;
+
+    if (paused) {
+        FD_CLR(self->server_socket, &self->all_fds);
+    } else {
+        FD_SET(self->server_socket, &self->all_fds);
+    }
+
+    return 0;
+}
+
 void SelectPoller_releasefd(void * this, int fd)
 {
     struct SelectPoller* self = this;
 
     FD_CLR(fd, &self->all_fds);
+    select_want_out(self, fd, 0);
     self->fd_count -= 1;
     if (self->fd_max_value == fd) {
         self->fd_max_value -= 1;
@@ -439,8 +1320,15 @@ struct Poller poller_select = {
     .deinit = SelectPoller_deinit,
     .wait = SelectPoller_wait,
     .try_acceptfd = SelectPoller_try_acceptfd,
+    .addfd = SelectPoller_addfd,
     .iterator_reset = SelectPoller_iterator_reset,
     .iterator_getfd = SelectPoller_iterator_getfd,
+    .rearmfd = SelectPoller_rearmfd,
+    .notify = SelectPoller_notify,
+    .pauseaccept = SelectPoller_pauseaccept,
+    .recvfd = poll_common_recvfd,
+    .sendfd = poll_common_sendfd,
+    .sendfilefd = poll_common_sendfilefd,
     .releasefd = SelectPoller_releasefd,
     .maxfd = SelectPoller_maxfd
 };
@@ -450,61 +1338,144 @@ struct Poller poller_select = {
 /* epoll */
 /******************************************************************************/
 
+// DEVNOTE: Connector sockets are registered edge-triggered and one-shot. An
+//          event disarms the fd, so it is reported exactly once per BLOCKED ->
+//          QUEUED transition. The worker re-arms it with rearmfd while the job
+//          is JOB_ARMING, and EPOLL_CTL_MOD re-checks readiness so no data
+//          arriving in between is lost.
+#define EPOLL_MAX_EVENTS 1024
+#define EPOLL_CONNECTOR_EVENTS (EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT)
+// no EPOLLRDHUP while sending, a half-closed peer still reads and would only re-fire
+#define EPOLL_CONNECTOR_OUT_EVENTS (EPOLLOUT | EPOLLET | EPOLLONESHOT)
+#define EPOLL_CONNECTOR_ERR_EVENTS (EPOLLET | EPOLLONESHOT)     // EPOLLERR is implied
+
 struct EpollPoller { 
     struct epoll_event * epoll_events;
-    uint32_t max_events;
-    uint32_t iterator_nfds;
-    uint32_t iterator_cur;
+    int max_events;
+    int iterator_nfds;
+    int iterator_cur;
     int epollfd;
+    int eventfd;
     int server_socket;
+    int accept_ready;
+    int fd_max_value;
 };
 
-int EpollPoller_init(void * this, int server_socket, int max_connections)
+void EpollPoller_deinit(void * this)
+{
+    struct EpollPoller* self = this;
+
+    close(self->eventfd);
+    close(self->epollfd);
+    free(self->epoll_events);
+}
+
+int EpollPoller_init(void * this, int server_socket)
 {
     struct EpollPoller* self = this;
+    struct epoll_event ev;
+
+    // listener is level-triggered, but accept must never block the loop
+    int flags = (server_socket < 0)? 0: fcntl(server_socket, F_GETFL);
+    if (flags == -1 || (server_socket >= 0 && fcntl(server_socket, F_SETFL, flags | O_NONBLOCK) == -1)) {
+        perror("poll-epoll: fcntl:");
+        return -1;
+    }
 
-    self->epoll_events = malloc(max_connections * sizeof(struct EpollPoller));
+    self->max_events = EPOLL_MAX_EVENTS;
+    self->epoll_events = malloc(sizeof(struct epoll_event) * (size_t)self->max_events);
     if (NULL == self->epoll_events) {
+        perror("poll-epoll: malloc:");
         return -1;
     }
 
-    self->max_events = max_connections;
+    self->epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (self->epollfd == -1) {
+        perror("poll-epoll: epoll_create1:");
+        free(self->epoll_events);
+        return -1;
+    }
 
-    self->epollfd = epoll_create(max_connections);
-    if (self->epollfd < 0) {
+    self->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (self->eventfd == -1) {
+        perror("poll-epoll: eventfd:");
+        close(self->epollfd);
         free(self->epoll_events);
         return -1;
     }
 
-    struct epoll_event ev;
+    // no listener, the caller adds the connectors it opens
+    memset(&ev, 0, sizeof(ev));
     ev.events = EPOLLIN;
     ev.data.fd = server_socket;
-    if (epoll_ctl(self->epollfd, EPOLL_CTL_ADD, server_socket, &ev) == -1) {
+    if (server_socket >= 0 && epoll_ctl(self->epollfd, EPOLL_CTL_ADD, server_socket, &ev) == -1) {
+        perror("poll-epoll: epoll_ctl: server");
+        EpollPoller_deinit(self);
         return -1;
     }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = self->eventfd;
+    if (epoll_ctl(self->epollfd, EPOLL_CTL_ADD, self->eventfd, &ev) == -1) {
+        perror("poll-epoll: epoll_ctl: eventfd");
+        EpollPoller_deinit(self);
+        return -1;
+    }
+
     self->server_socket = server_socket;
+    self->accept_ready = 0;
+    self->iterator_nfds = 0;
+    self->iterator_cur = 0;
+    self->fd_max_value = server_socket;
 
     return 0;
 }
 
-void EpollPoller_deinit(void * this)
+int EpollPoller_wait(void * this, int timeout_ms)
 {
     struct EpollPoller* self = this;
 
-    free(self->epoll_events);
+    self->accept_ready = 0;
+    self->iterator_nfds = epoll_wait(self->epollfd, self->epoll_events, self->max_events, timeout_ms);
+    if (self->iterator_nfds == -1) {
+        self->iterator_nfds = 0;
+        return -1;
+    }
+
+    // pick out the listener and the wakeup channel, the rest are connectors
+    for (int i = 0; i < self->iterator_nfds; i++) {
+        int fd = self->epoll_events[i].data.fd;
+        if (fd == self->server_socket) {
+            self->accept_ready = 1;
+        } else if (fd == self->eventfd) {
+            uint64_t count;
+            if (read(self->eventfd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+                perror("poll-epoll: eventfd read:");
+            }
+        }
+    }
+
+    return 0;
 }
 
-int EpollPoller_wait(void * this)
+int EpollPoller_addfd(void * this, int fd)
 {
     struct EpollPoller* self = this;
+    struct epoll_event ev;
 
-    self->iterator_nfds = epoll_wait(self->epollfd, self->epoll_events, self->max_events, -1);
-    // TODO return check
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLL_CONNECTOR_EVENTS;
+    ev.data.fd = fd;
+    if (epoll_ctl(self->epollfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        return -1;
+    }
+
+    self->fd_max_value = (self->fd_max_value < fd)? fd: self->fd_max_value;
 
     return 0;
 }
 
-// TODO: for epoll this will called invariant of connection of server socket, need to optimize
 int EpollPoller_try_acceptfd(void * this, int * sockfd)
 {
     struct EpollPoller* self = this;
@@ -512,19 +1483,24 @@ int EpollPoller_try_acceptfd(void * this, int * sockfd)
     struct sockaddr_storage connector_addr;
     socklen_t connector_addr_size = sizeof(connector_addr);
 
+    if (!self->accept_ready) {
+        return 0;
+    }
+
     int connector_socket = accept4(self->server_socket, (struct sockaddr *)&connector_addr, 
-                                    &connector_addr_size, SOCK_NONBLOCK);
-    if (connector_socket == -1) {
+                                    &connector_addr_size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (connector_socket == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        // drained, or another thread or process won the race for this connection
+        self->accept_ready = 0;
+        return 0;
+    } else if (connector_socket == -1) {
         return -1;
-    } 
+    }
 
-    struct epoll_event ev;
-    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
-    if (epoll_ctl(self->epollfd, EPOLL_CTL_ADD, connector_socket, &ev) == -1) {
+    if (EpollPoller_addfd(self, connector_socket) == -1) {
         close(connector_socket); // TODO: check return of close
         return -1;
     }
-    
     *sockfd = connector_socket;
 
     return 0;
@@ -541,36 +1517,962 @@ int EpollPoller_iterator_getfd(void * this, sock_state_e * sock_state)
 {
     struct EpollPoller* self = this;
 
-    if (self->iterator_cur == self->server_socket) {
-        self->iterator_cur += 1;
+    while (self->iterator_cur < self->iterator_nfds) {
+        struct epoll_event * event = &self->epoll_events[self->iterator_cur];
+        self->iterator_cur += 1;    // increment the iterator for next step
+
+        if (event->data.fd == self->server_socket || event->data.fd == self->eventfd) {
+            continue;
+        }
+
+        sock_state_e temp = SOCK_UNKNOWN;
+        temp = (event->events & EPOLLOUT) ? SOCK_WRITABLE : temp;
+        temp = (event->events & EPOLLIN) ? SOCK_READABLE : temp;
+        temp = (event->events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) ? SOCK_SHUTDOWN : temp;
+        *sock_state = temp;
+
+        return event->data.fd; 
     }
 
-    if (self->iterator_cur >= self->iterator_nfds) {
-        return -1; 
+    return -1;
+}
+
+int EpollPoller_rearmfd(void * this, int fd, sock_state_e want)
+{
+    struct EpollPoller* self = this;
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (want == SOCK_WRITABLE)? EPOLL_CONNECTOR_OUT_EVENTS:
+                (want == SOCK_ERRQUEUE)? EPOLL_CONNECTOR_ERR_EVENTS: EPOLL_CONNECTOR_EVENTS;
+    ev.data.fd = fd;
+
+    return epoll_ctl(self->epollfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void EpollPoller_notify(void * this)
+{
+    struct EpollPoller* self = this;
+    uint64_t one = 1;
+
+    if (write(self->eventfd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        perror("poll-epoll: eventfd write:");
     }
+}
 
-    struct epoll_event * event = &self->epoll_events[self->iterator_cur];
-    
-    sock_state_e temp = SOCK_UNKNOWN;
-    temp = (event->events & EPOLLIN) ? SOCK_READABLE : temp;
-    temp = (event->events & EPOLLOUT) ? SOCK_WRITABLE : temp;
-    temp = (event->events & EPOLLRDHUP) ? SOCK_SHUTDOWN : temp;
-    *sock_state = temp;
+// the listener stays registered, without interest it stops reporting
+int EpollPoller_pauseaccept(void * this, int paused)
+{
+    struct EpollPoller* self = this;
+    struct epoll_event ev;
 
-    self->iterator_cur += 1;    // increment the iterator for next step
-    return event->data.fd; 
+    memset(&ev, 0, sizeof(ev));
+    ev.events = paused? 0: EPOLLIN;
+    ev.data.fd = self->server_socket;
+    self->accept_ready = 0;
+
+    return epoll_ctl(self->epollfd, EPOLL_CTL_MOD, self->server_socket, &ev);
 }
 
 void EpollPoller_releasefd(void * this, int fd)
 {
     struct EpollPoller* self = this;
 
+    // DEVNOTE: close alone is not enough, a forked handler may still hold the file open
     if (epoll_ctl(self->epollfd, EPOLL_CTL_DEL, fd, NULL) == -1) {
-        // TODO print error properly
-        perror("Error when removing fd from control group");
+        perror("poll-epoll: epoll_ctl: del");
+    }
+
+    if (fd == self->fd_max_value) {
+        self->fd_max_value -= 1;
+    }
+}
+
+int EpollPoller_maxfd(void * this)
+{
+    struct EpollPoller* self = this;
+
+    return self->fd_max_value;
+}
+
+struct Poller poller_epoll = {
+    .init = EpollPoller_init,
+    .deinit = EpollPoller_deinit,
+    .wait = EpollPoller_wait,
+    .try_acceptfd = EpollPoller_try_acceptfd,
+    .addfd = EpollPoller_addfd,
+    .iterator_reset = EpollPoller_iterator_reset,
+    .iterator_getfd = EpollPoller_iterator_getfd,
+    .rearmfd = EpollPoller_rearmfd,
+    .notify = EpollPoller_notify,
+    .pauseaccept = EpollPoller_pauseaccept,
+    .recvfd = poll_common_recvfd,
+    .sendfd = poll_common_sendfd,
+    .sendfilefd = poll_common_sendfilefd,
+    .releasefd = EpollPoller_releasefd,
+    .maxfd = EpollPoller_maxfd
+};
+
+/******************************************************************************/
+/* io_uring */
+/******************************************************************************/
+
+// DEVNOTE: The ring owns the data path. The listener has one multishot accept and
+//          every connector one multishot recv, which picks buffers from a ring of
+//          kernel-provided buffers. Received buffers are parked per fd until the
+//          worker copies them out through recvfd, which recycles them. sendfd writes
+//          straight from the worker while the socket has room, only a full socket
+//          gets a SENDMSG on the ring, and the job parks until the reactor reaps its
+//          completion. The next sendfd picks up its result. A job waiting for
+//          zero-copy completions gets a one-shot POLL_ADD.
+//          sendfile has no ring op and stays a syscall. Readiness is reported once per
+//          rearm, like EPOLLONESHOT, and only for what the job waits for.
+//          The submission queue, buffer ring and parked buffers are shared with
+//          the workers under one lock. Only the reactor waits and reaps.
+#define URING_ENTRIES 4096
+#define URING_BUF_COUNT 4096        // power of two, at most 32768
+#define URING_BUF_SIZE 2048
+#define URING_BUF_GROUP 0
+#define URING_BUF_NONE 0xffff
+#define URING_MAX_READY 1024
+#define URING_MAX_ACCEPTED 64
+#define URING_CONN_NONE -1
+
+enum uring_op_enum {
+    URING_OP_ACCEPT = 1,
+    URING_OP_RECV,
+    URING_OP_POLL,
+    URING_OP_SEND,
+    URING_OP_WAKE,
+    URING_OP_CANCEL
+};
+
+#define URING_GEN_MASK 0xffffff         // generation bits that fit in user_data
+#define URING_UDATA(op, gen, fd) \
+    (((uint64_t)(op) << 56) | (((uint64_t)(gen) & URING_GEN_MASK) << 32) | (uint32_t)(fd))
+#define URING_UDATA_OP(ud) ((int)((ud) >> 56))
+#define URING_UDATA_GEN(ud) ((uint32_t)(((ud) >> 32) & URING_GEN_MASK))
+#define URING_UDATA_FD(ud) ((int)(uint32_t)(ud))
+
+struct UringConn {
+    uint32_t gen;                       // stale completions of a reused fd are dropped, wraps at URING_GEN_MASK
+    int next_rearmed;                   // intrusive list, lock
+    int next_starved;                   // intrusive list, lock
+    uint16_t head_bid;                  // parked buffers, lock
+    uint16_t tail_bid;
+    uint16_t head_off;
+    uint8_t armed;
+    uint8_t live;
+    uint8_t eof;
+    uint8_t starved;
+    uint8_t listed_rearmed;
+    uint8_t listed_starved;
+    uint8_t want;                       // sock_state_e of the last rearm, lock
+    uint8_t polling;                    // a POLL_ADD is outstanding, lock
+    uint8_t sending;                    // a SENDMSG is outstanding, lock
+    uint8_t sent;                       // its completion is in send_res, lock
+    int send_res;
+    int err;
+};
+
+struct UringBuf {
+    uint16_t next;
+    uint16_t len;
+};
+
+struct UringPoller {
+    // rings
+    int ring_fd;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned cq_mask;
+    unsigned sq_pending;
+    unsigned * sq_head;
+    unsigned * sq_tail;
+    unsigned * sq_array;
+    unsigned * cq_head;
+    unsigned * cq_tail;
+    struct io_uring_sqe * sqes;
+    struct io_uring_cqe * cqes;
+    void * ring_ptr;
+    size_t ring_size;
+    size_t sqes_size;
+    // provided buffers
+    struct io_uring_buf_ring * buf_ring;
+    char * buf_base;
+    struct UringBuf * bufs;
+    size_t buf_ring_size;
+    uint16_t buf_tail;
+    // connections
+    struct UringConn * conns;
+    int conn_max;
+    int rearmed_head;
+    int starved_head;
+    // loop state, reactor only
+    int accepted[URING_MAX_ACCEPTED];
+    int accepted_head;
+    int accepted_count;
+    int accept_armed;       // lock, a multishot accept is outstanding
+    int accept_paused;      // lock
+    int * ready;
+    int ready_count;
+    int iterator_cur;
+    int server_socket;
+    int fd_max_value;
+    pthread_mutex_t lock;   // DEVNOTE: held across io_uring_enter, so not a spinlock
+};
+
+_Static_assert(sizeof(struct UringPoller) <= IOLOOP_INST_SIZE_MAX, "UringPoller exceeds IOLOOP_INST_SIZE_MAX");
+
+static int uring_setup(unsigned entries, struct io_uring_params * p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+// waits for a completion at most timeout_ms, 0 when it ran out
+static int uring_enter_timeout(int fd, int timeout_ms)
+{
+    struct __kernel_timespec ts = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+    struct io_uring_getevents_arg arg = { 0, 0, 0, (uint64_t)(uintptr_t)&ts };
+
+    int rc = (int)syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                          &arg, sizeof(arg));
+
+    return (rc == -1 && errno == ETIME)? 0: rc;
+}
+
+static int uring_register(int fd, unsigned opcode, void * arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// lock held
+static int uring_submit(struct UringPoller * self)
+{
+    while (self->sq_pending > 0) {
+        int rc = uring_enter(self->ring_fd, self->sq_pending, 0, 0);
+        if (rc == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        self->sq_pending -= (unsigned)rc;
+    }
+
+    return 0;
+}
+
+// lock held
+static struct io_uring_sqe * uring_sqe_get(struct UringPoller * self)
+{
+    unsigned tail = *self->sq_tail;
+
+    if (tail - __atomic_load_n(self->sq_head, __ATOMIC_ACQUIRE) >= self->sq_entries) {
+        if (uring_submit(self) == -1) {
+            return NULL;
+        }
+    }
+
+    struct io_uring_sqe * sqe = &self->sqes[tail & self->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    self->sq_array[tail & self->sq_mask] = tail & self->sq_mask;
+    __atomic_store_n(self->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    self->sq_pending += 1;
+
+    return sqe;
+}
+
+// lock held
+static int uring_prep(struct UringPoller * self, uint8_t opcode, int fd, uint64_t user_data)
+{
+    struct io_uring_sqe * sqe = uring_sqe_get(self);
+    if (NULL == sqe) {
+        return -1;
+    }
+
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+    if (opcode == IORING_OP_ACCEPT) {
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    } else if (opcode == IORING_OP_RECV) {
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BUF_GROUP;
+    } else if (opcode == IORING_OP_POLL_ADD) {
+        // POLLERR is always reported, it is all a zero-copy completion raises
+        sqe->poll32_events = (self->conns[fd].want == SOCK_WRITABLE)? POLLOUT: POLLERR;
+    }
+
+    return 0;
+}
+
+// lock held
+static void uring_buf_recycle(struct UringPoller * self, uint16_t bid)
+{
+    struct io_uring_buf * buf = &self->buf_ring->bufs[self->buf_tail & (URING_BUF_COUNT - 1)];
+
+    buf->addr = (uint64_t)(uintptr_t)(self->buf_base + (size_t)bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    self->buf_tail += 1;
+    __atomic_store_n(&self->buf_ring->tail, self->buf_tail, __ATOMIC_RELEASE);
+
+    // a recycled buffer lets one starved connector receive again
+    while (self->starved_head != URING_CONN_NONE) {
+        int fd = self->starved_head;
+        struct UringConn * conn = &self->conns[fd];
+        self->starved_head = conn->next_starved;
+        conn->listed_starved = 0;
+        if (conn->live && conn->starved) {
+            conn->starved = 0;
+            uring_prep(self, IORING_OP_RECV, fd, URING_UDATA(URING_OP_RECV, conn->gen, fd));
+            break;
+        }
+    }
+}
+
+// lock held
+static void uring_conn_rearmed(struct UringPoller * self, int fd)
+{
+    struct UringConn * conn = &self->conns[fd];
+
+    if (!conn->listed_rearmed) {
+        conn->listed_rearmed = 1;
+        conn->next_rearmed = self->rearmed_head;
+        self->rearmed_head = fd;
+    }
+}
+
+// lock held
+static void uring_ready(struct UringPoller * self, int fd)
+{
+    struct UringConn * conn = &self->conns[fd];
+
+    if (conn->armed) {
+        conn->armed = 0;
+        self->ready[self->ready_count++] = fd;
+    }
+}
+
+// lock held
+static void uring_complete(struct UringPoller * self, struct io_uring_cqe * cqe)
+{
+    int op = URING_UDATA_OP(cqe->user_data);
+    int fd = URING_UDATA_FD(cqe->user_data);
+    struct UringConn * conn = (op == URING_OP_RECV || op == URING_OP_POLL || op == URING_OP_SEND)?
+                              &self->conns[fd]: NULL;
+    int stale = (NULL != conn) && (!conn->live || conn->gen != URING_UDATA_GEN(cqe->user_data));
+
+    if (op == URING_OP_ACCEPT) {
+        if (cqe->res >= 0) {
+            int slot = (self->accepted_head + self->accepted_count) % URING_MAX_ACCEPTED;
+            self->accepted[slot] = cqe->res;
+            self->accepted_count += 1;
+        } else if (cqe->res != -ECANCELED) {
+            fprintf(stderr, "poll-uring: accept:: %s\n", strerror(-cqe->res));
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            self->accept_armed = 0;
+            if (!self->accept_paused && 
+                uring_prep(self, IORING_OP_ACCEPT, self->server_socket, URING_UDATA(URING_OP_ACCEPT, 0, 0)) == 0) {
+                self->accept_armed = 1;
+            }
+        }
+    } else if (op == URING_OP_RECV) {
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            uint16_t bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            if (stale || cqe->res <= 0) {
+                uring_buf_recycle(self, bid);
+            } else {
+                self->bufs[bid].len = (uint16_t)cqe->res;
+                self->bufs[bid].next = URING_BUF_NONE;
+                if (conn->head_bid == URING_BUF_NONE) {
+                    conn->head_bid = bid;
+                    conn->head_off = 0;
+                } else {
+                    self->bufs[conn->tail_bid].next = bid;
+                }
+                conn->tail_bid = bid;
+            }
+        }
+        if (stale) {
+            return;
+        }
+        if (cqe->res == 0) {
+            conn->eof = 1;
+        } else if (cqe->res == -ENOBUFS) {
+            // multishot stopped, resume once a buffer comes back
+            conn->starved = 1;
+            if (!conn->listed_starved) {
+                conn->listed_starved = 1;
+                conn->next_starved = self->starved_head;
+                self->starved_head = fd;
+            }
+            return;
+        } else if (cqe->res < 0) {
+            conn->err = -cqe->res;
+        } else if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            uring_prep(self, IORING_OP_RECV, fd, URING_UDATA(URING_OP_RECV, conn->gen, fd));
+        }
+        // stays parked while the job waits to send, rearming for reading picks it up
+        if (conn->want == SOCK_READABLE) {
+            uring_ready(self, fd);
+        }
+    } else if (op == URING_OP_POLL) {
+        if (stale) {
+            return;
+        }
+        conn->polling = 0;
+        if (conn->want != SOCK_READABLE) {
+            uring_ready(self, fd);
+        }
+    } else if (op == URING_OP_SEND) {
+        if (stale) {
+            return;
+        }
+        conn->sending = 0;
+        conn->sent = 1;
+        conn->send_res = cqe->res;
+        if (conn->want != SOCK_READABLE) {
+            uring_ready(self, fd);
+        }
+    }
+    // URING_OP_WAKE and URING_OP_CANCEL only interrupt the wait
+}
+
+void UringPoller_deinit(void * this)
+{
+    struct UringPoller* self = this;
+
+    close(self->ring_fd);
+    munmap(self->ring_ptr, self->ring_size);
+    munmap(self->sqes, self->sqes_size);
+    munmap(self->buf_ring, self->buf_ring_size);
+    pthread_mutex_destroy(&self->lock);
+    free(self->buf_base);
+    free(self->bufs);
+    free(self->conns);
+    free(self->ready);
+}
+
+int UringPoller_init(void * this, int server_socket)
+{
+    struct UringPoller* self = this;
+    struct io_uring_params params;
+    struct rlimit nofile;
+
+    memset(self, 0, sizeof(*self));
+    self->ring_fd = -1;
+    self->ring_ptr = MAP_FAILED;
+    self->sqes = MAP_FAILED;
+    self->buf_ring = MAP_FAILED;
+    self->rearmed_head = URING_CONN_NONE;
+    self->starved_head = URING_CONN_NONE;
+    self->server_socket = server_socket;
+    self->fd_max_value = server_socket;
+    pthread_mutex_init(&self->lock, NULL);
+
+    // per-fd state, the fd table can't grow past the soft limit
+    if (getrlimit(RLIMIT_NOFILE, &nofile) == -1) {
+        perror("poll-uring: getrlimit:");
+        goto FAIL;
+    }
+    self->conn_max = (nofile.rlim_cur < INT_MAX)? (int)nofile.rlim_cur: INT_MAX;
+    self->conns = calloc((size_t)self->conn_max, sizeof(struct UringConn));
+    self->ready = malloc(sizeof(int) * URING_MAX_READY);
+    self->bufs = malloc(sizeof(struct UringBuf) * URING_BUF_COUNT);
+    self->buf_base = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+    if (NULL == self->conns || NULL == self->ready || NULL == self->bufs || NULL == self->buf_base) {
+        perror("poll-uring: malloc:");
+        goto FAIL;
+    }
+
+    // rings
+    memset(&params, 0, sizeof(params));
+    self->ring_fd = uring_setup(URING_ENTRIES, &params);
+    if (self->ring_fd == -1) {
+        perror("poll-uring: io_uring_setup:");
+        goto FAIL;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP) ||
+        !(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_SUBMIT_STABLE)) {
+        fprintf(stderr, "poll-uring: io_uring_setup:: kernel too old\n");
+        goto FAIL;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    self->ring_size = (sq_size > cq_size)? sq_size: cq_size;
+    self->ring_ptr = mmap(NULL, self->ring_size, PROT_READ | PROT_WRITE, 
+                          MAP_SHARED | MAP_POPULATE, self->ring_fd, IORING_OFF_SQ_RING);
+    if (self->ring_ptr == MAP_FAILED) {
+        perror("poll-uring: mmap: ring");
+        goto FAIL;
     }
+    self->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    self->sqes = mmap(NULL, self->sqes_size, PROT_READ | PROT_WRITE, 
+                      MAP_SHARED | MAP_POPULATE, self->ring_fd, IORING_OFF_SQES);
+    if (self->sqes == MAP_FAILED) {
+        perror("poll-uring: mmap: sqes");
+        goto FAIL;
+    }
+
+    char * ring = self->ring_ptr;
+    self->sq_head = (unsigned *)(ring + params.sq_off.head);
+    self->sq_tail = (unsigned *)(ring + params.sq_off.tail);
+    self->sq_array = (unsigned *)(ring + params.sq_off.array);
+    self->sq_mask = *(unsigned *)(ring + params.sq_off.ring_mask);
+    self->sq_entries = params.sq_entries;
+    self->cq_head = (unsigned *)(ring + params.cq_off.head);
+    self->cq_tail = (unsigned *)(ring + params.cq_off.tail);
+    self->cq_mask = *(unsigned *)(ring + params.cq_off.ring_mask);
+    self->cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+
+    // provided buffers
+    self->buf_ring_size = sizeof(struct io_uring_buf) * URING_BUF_COUNT;
+    self->buf_ring = mmap(NULL, self->buf_ring_size, PROT_READ | PROT_WRITE, 
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (self->buf_ring == MAP_FAILED) {
+        perror("poll-uring: mmap: buffers");
+        goto FAIL;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)self->buf_ring;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BUF_GROUP;
+    if (uring_register(self->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+        perror("poll-uring: io_uring_register: buffers");
+        goto FAIL;
+    }
+    for (int bid = 0; bid < URING_BUF_COUNT; bid++) {
+        uring_buf_recycle(self, (uint16_t)bid);
+    }
+
+    for (int fd = 0; fd < self->conn_max; fd++) {
+        self->conns[fd].head_bid = URING_BUF_NONE;
+    }
+
+    // one multishot accept for the lifetime of the listener, if there is one
+    if (server_socket < 0) {
+        self->accept_paused = 1;
+        return 0;
+    }
+    if (uring_prep(self, IORING_OP_ACCEPT, server_socket, URING_UDATA(URING_OP_ACCEPT, 0, 0)) == -1 ||
+        uring_submit(self) == -1) {
+        perror("poll-uring: accept:");
+        goto FAIL;
+    }
+    self->accept_armed = 1;
+
+    return 0;
+
+FAIL:
+    UringPoller_deinit(self);
+    return -1;
 }
 
+int UringPoller_wait(void * this, int timeout_ms)
+{
+    struct UringPoller* self = this;
+
+    self->ready_count = 0;
+    self->iterator_cur = 0;
+
+    // flush queued submissions, pick up rearmed connectors with data parked
+    pthread_mutex_lock(&self->lock);
+    uring_submit(self);
+    while (self->rearmed_head != URING_CONN_NONE && self->ready_count < URING_MAX_READY) {
+        int fd = self->rearmed_head;
+        struct UringConn * conn = &self->conns[fd];
+        self->rearmed_head = conn->next_rearmed;
+        conn->listed_rearmed = 0;
+        if (conn->live && ((conn->want == SOCK_READABLE && 
+            (conn->head_bid != URING_BUF_NONE || conn->eof || conn->err)) || (conn->want != SOCK_READABLE && conn->sent))) {
+            uring_ready(self, fd);
+        }
+    }
+    pthread_mutex_unlock(&self->lock);
+
+    int cq_empty = (*self->cq_head == __atomic_load_n(self->cq_tail, __ATOMIC_ACQUIRE));
+    if (cq_empty && self->ready_count == 0 && self->accepted_count == 0) {
+        int rc = (timeout_ms < 0)? uring_enter(self->ring_fd, 0, 1, IORING_ENTER_GETEVENTS):
+                                   uring_enter_timeout(self->ring_fd, timeout_ms);
+        if (rc == -1) {
+            return -1;
+        }
+    }
+
+    // reap, leaving the rest in the ring once the loop can't take more
+    pthread_mutex_lock(&self->lock);
+    unsigned head = *self->cq_head;
+    unsigned tail = __atomic_load_n(self->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && self->ready_count < URING_MAX_READY && self->accepted_count < URING_MAX_ACCEPTED) {
+        uring_complete(self, &self->cqes[head & self->cq_mask]);
+        head += 1;
+    }
+    __atomic_store_n(self->cq_head, head, __ATOMIC_RELEASE);
+    uring_submit(self);
+    pthread_mutex_unlock(&self->lock);
+
+    return 0;
+}
+
+// the recv goes out with the next wait, together with everything else queued
+int UringPoller_addfd(void * this, int fd)
+{
+    struct UringPoller* self = this;
+
+    if (fd >= self->conn_max) {
+        errno = EMFILE;
+        return -1;
+    }
+
+    pthread_mutex_lock(&self->lock);
+    struct UringConn * conn = &self->conns[fd];
+    conn->gen = (conn->gen + 1) & URING_GEN_MASK;
+    conn->live = 1;
+    conn->armed = 1;
+    conn->eof = 0;
+    conn->err = 0;
+    conn->starved = 0;
+    conn->want = SOCK_READABLE;
+    conn->polling = 0;
+    conn->sending = 0;
+    conn->sent = 0;
+    conn->head_bid = URING_BUF_NONE;
+    conn->tail_bid = URING_BUF_NONE;
+    conn->head_off = 0;
+    int rc = uring_prep(self, IORING_OP_RECV, fd, URING_UDATA(URING_OP_RECV, conn->gen, fd));
+    pthread_mutex_unlock(&self->lock);
+    if (rc == -1) {
+        conn->live = 0;
+        return -1;
+    }
+
+    self->fd_max_value = (self->fd_max_value < fd)? fd: self->fd_max_value;
+
+    return 0;
+}
+
+int UringPoller_try_acceptfd(void * this, int * sockfd)
+{
+    struct UringPoller* self = this;
+
+    if (self->accepted_count == 0) {
+        return 0;
+    }
+
+    int fd = self->accepted[self->accepted_head];
+    self->accepted_head = (self->accepted_head + 1) % URING_MAX_ACCEPTED;
+    self->accepted_count -= 1;
+
+    if (UringPoller_addfd(self, fd) == -1) {
+        close(fd);
+        return -1;
+    }
+    *sockfd = fd;
+
+    return 0;
+}
+
+void UringPoller_iterator_reset(void * this)
+{
+    struct UringPoller* self = this;
+
+    self->iterator_cur = 0;
+}
+
+int UringPoller_iterator_getfd(void * this, sock_state_e * sock_state)
+{
+    struct UringPoller* self = this;
+
+    if (self->iterator_cur >= self->ready_count) {
+        return -1;
+    }
+
+    int fd = self->ready[self->iterator_cur];
+    struct UringConn * conn = &self->conns[fd];
+    self->iterator_cur += 1;
+
+    *sock_state = (conn->eof || conn->err)? SOCK_SHUTDOWN: (sock_state_e)conn->want;
+
+    return fd;
+}
+
+int UringPoller_rearmfd(void * this, int fd, sock_state_e want)
+{
+    struct UringPoller* self = this;
+    int rc = 0;
+
+    pthread_mutex_lock(&self->lock);
+    struct UringConn * conn = &self->conns[fd];
+    conn->armed = 1;
+    conn->want = (uint8_t)want;
+    if (want != SOCK_READABLE && conn->sent) {
+        // the send completed before the job parked, no completion is coming anymore
+        uring_conn_rearmed(self, fd);
+        rc = uring_prep(self, IORING_OP_NOP, -1, URING_UDATA(URING_OP_WAKE, 0, 0));
+        rc = (rc == 0)? uring_submit(self): rc;
+    } else if (want != SOCK_READABLE && !conn->sending) {
+        // one poll at a time, a stale one still completes and the job just asks again
+        if (!conn->polling) {
+            rc = uring_prep(self, IORING_OP_POLL_ADD, fd, URING_UDATA(URING_OP_POLL, conn->gen, fd));
+            conn->polling = (rc == 0);
+            rc = (rc == 0)? uring_submit(self): rc;
+        }
+    } else if (conn->head_bid != URING_BUF_NONE || conn->eof || conn->err) {
+        // no completion is coming for data that is already parked, wake the reactor
+        uring_conn_rearmed(self, fd);
+        rc = uring_prep(self, IORING_OP_NOP, -1, URING_UDATA(URING_OP_WAKE, 0, 0));
+        rc = (rc == 0)? uring_submit(self): rc;
+    }
+    pthread_mutex_unlock(&self->lock);
+
+    return rc;
+}
+
+void UringPoller_notify(void * this)
+{
+    struct UringPoller* self = this;
+
+    pthread_mutex_lock(&self->lock);
+    if (uring_prep(self, IORING_OP_NOP, -1, URING_UDATA(URING_OP_WAKE, 0, 0)) == -1 || 
+        uring_submit(self) == -1) {
+        perror("poll-uring: notify:");
+    }
+    pthread_mutex_unlock(&self->lock);
+}
+
+// DEVNOTE: Completions already posted before the cancel are still admitted, the kernel
+//          accepts ahead of the reactor. A resume racing the cancel's completion leaves
+//          the re-arm to uring_complete.
+int UringPoller_pauseaccept(void * this, int paused)
+{
+    struct UringPoller* self = this;
+    int rc = 0;
+
+    pthread_mutex_lock(&self->lock);
+    self->accept_paused = paused;
+    if (paused && self->accept_armed) {
+        struct io_uring_sqe * sqe = uring_sqe_get(self);
+        if (NULL == sqe) {
+            rc = -1;
+        } else {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = URING_UDATA(URING_OP_ACCEPT, 0, 0);
+            sqe->user_data = URING_UDATA(URING_OP_CANCEL, 0, 0);
+        }
+    } else if (!paused && !self->accept_armed) {
+        rc = uring_prep(self, IORING_OP_ACCEPT, self->server_socket, URING_UDATA(URING_OP_ACCEPT, 0, 0));
+        self->accept_armed = (rc == 0);
+    }
+    rc = (rc == 0)? uring_submit(self): rc;
+    pthread_mutex_unlock(&self->lock);
+
+    return rc;
+}
+
+ssize_t UringPoller_recvfd(void * this, int fd, void * buffer, size_t n)
+{
+    struct UringPoller* self = this;
+    size_t copied = 0;
+
+    pthread_mutex_lock(&self->lock);
+    struct UringConn * conn = &self->conns[fd];
+    while (copied < n && conn->head_bid != URING_BUF_NONE) {
+        uint16_t bid = conn->head_bid;
+        size_t avail = (size_t)(self->bufs[bid].len - conn->head_off);
+        size_t take = (avail < n - copied)? avail: n - copied;
+
+        memcpy((char *)buffer + copied, self->buf_base + (size_t)bid * URING_BUF_SIZE + conn->head_off, take);
+        copied += take;
+        conn->head_off = (uint16_t)(conn->head_off + take);
+        if (take == avail) {
+            conn->head_bid = self->bufs[bid].next;
+            conn->head_off = 0;
+            uring_buf_recycle(self, bid);
+        }
+    }
+    int eof = conn->eof;
+    int err = conn->err;
+    uring_submit(self);
+    pthread_mutex_unlock(&self->lock);
+
+    if (copied > 0) {
+        return (ssize_t)copied;
+    } else if (err != 0) {
+        errno = err;
+        return -1;
+    } else if (eof) {
+        return 0;
+    }
+
+    errno = EAGAIN;
+    return -1;
+}
+
+// DEVNOTE: A socket with room takes the vector in a plain non-blocking sendmsg, a
+//          response rarely needs more. Once it is full the rest goes to the ring as one
+//          SENDMSG, which waits for room in the kernel, and the call reports EAGAIN.
+//          The job parks and the call after the completion returns its result.
+//          One SENDMSG stands in for a chain of IOSQE_IO_LINK'd SENDs: a full socket
+//          takes short sends, and a short send in a chain cancels the links behind
+//          it. The vector carries the iovecs of a response and of a pipelined batch
+//          alike, in one op with one completion.
+//          The msghdr lives on this stack, IORING_FEAT_SUBMIT_STABLE has the kernel copy
+//          it during the submit, the iovec's buffers stay put while the job is parked.
+ssize_t UringPoller_sendfd(void * this, int fd, const struct iovec * iov, int iovcnt, int flags)
+{
+    struct UringPoller* self = this;
+    struct UringConn * conn = &self->conns[fd];
+    struct msghdr msg;
+    ssize_t rc = -1;
+    int err = EAGAIN;
+
+    pthread_mutex_lock(&self->lock);
+    if (conn->sent) {
+        conn->sent = 0;
+        rc = (conn->send_res < 0)? -1: conn->send_res;
+        err = (conn->send_res < 0)? -conn->send_res: 0;
+    }
+    int sending = conn->sending;
+    pthread_mutex_unlock(&self->lock);
+
+    // only this job sends on the fd, nothing can start a send behind our back
+    if (rc != -1 || err != EAGAIN || sending) {
+        if (rc == -1) {
+            errno = err;
+        }
+        return rc;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (struct iovec *)iov;
+    msg.msg_iovlen = (size_t)iovcnt;
+    do {
+        rc = sendmsg(fd, &msg, flags | MSG_NOSIGNAL | MSG_DONTWAIT);
+    } while (rc == -1 && errno == EINTR);
+    if (rc != -1 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+        return rc;      // a partial write is consumed by the caller, its next call finds the socket full
+    }
+
+    pthread_mutex_lock(&self->lock);
+    struct io_uring_sqe * sqe = uring_sqe_get(self);
+    if (NULL == sqe) {
+        err = errno;
+    } else {
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)(uintptr_t)&msg;
+        sqe->len = 1;
+        sqe->msg_flags = (uint32_t)(flags | MSG_NOSIGNAL);
+        sqe->user_data = URING_UDATA(URING_OP_SEND, conn->gen, fd);
+        if (uring_submit(self) == -1) {
+            // still unconsumed and the last one queued, it must not outlive msg
+            err = errno;
+            sqe->opcode = IORING_OP_NOP;
+            sqe->fd = -1;
+            sqe->user_data = URING_UDATA(URING_OP_WAKE, 0, 0);
+        } else {
+            conn->sending = 1;
+        }
+    }
+    pthread_mutex_unlock(&self->lock);
+
+    errno = err;
+    return -1;
+}
+
+void UringPoller_releasefd(void * this, int fd)
+{
+    struct UringPoller* self = this;
+
+    pthread_mutex_lock(&self->lock);
+    struct UringConn * conn = &self->conns[fd];
+    while (conn->head_bid != URING_BUF_NONE) {
+        uint16_t bid = conn->head_bid;
+        conn->head_bid = self->bufs[bid].next;
+        uring_buf_recycle(self, bid);
+    }
+    // DEVNOTE: the multishot recv holds a file reference, close alone won't end it
+    if (!conn->eof && !conn->err && !conn->starved) {
+        struct io_uring_sqe * sqe = uring_sqe_get(self);
+        if (NULL != sqe) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = URING_UDATA(URING_OP_RECV, conn->gen, fd);
+            sqe->user_data = URING_UDATA(URING_OP_CANCEL, 0, 0);
+        }
+    }
+    // a pending poll holds one too
+    if (conn->polling) {
+        struct io_uring_sqe * sqe = uring_sqe_get(self);
+        if (NULL != sqe) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = URING_UDATA(URING_OP_POLL, conn->gen, fd);
+            sqe->user_data = URING_UDATA(URING_OP_CANCEL, 0, 0);
+        }
+        conn->polling = 0;
+    }
+    // and a send still waiting for room, a shed job is reaped with one out and its
+    // buffers are free already, the shutdown keeps them from going out until the cancel
+    if (conn->sending) {
+        shutdown(fd, SHUT_RDWR);
+        struct io_uring_sqe * sqe = uring_sqe_get(self);
+        if (NULL != sqe) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = URING_UDATA(URING_OP_SEND, conn->gen, fd);
+            sqe->user_data = URING_UDATA(URING_OP_CANCEL, 0, 0);
+        }
+        conn->sending = 0;
+    }
+    conn->live = 0;
+    conn->armed = 0;
+    conn->starved = 0;
+    uring_submit(self);
+    pthread_mutex_unlock(&self->lock);
+
+    if (fd == self->fd_max_value) {
+        self->fd_max_value -= 1;
+    }
+}
+
+int UringPoller_maxfd(void * this)
+{
+    struct UringPoller* self = this;
+
+    return self->fd_max_value;
+}
+
+struct Poller poller_uring = {
+    .init = UringPoller_init,
+    .deinit = UringPoller_deinit,
+    .wait = UringPoller_wait,
+    .try_acceptfd = UringPoller_try_acceptfd,
+    .addfd = UringPoller_addfd,
+    .iterator_reset = UringPoller_iterator_reset,
+    .iterator_getfd = UringPoller_iterator_getfd,
+    .rearmfd = UringPoller_rearmfd,
+    .notify = UringPoller_notify,
+    .pauseaccept = UringPoller_pauseaccept,
+    .recvfd = UringPoller_recvfd,
+    .sendfd = UringPoller_sendfd,
+    .sendfilefd = poll_common_sendfilefd,
+    .releasefd = UringPoller_releasefd,
+    .maxfd = UringPoller_maxfd
+};
+
 /***********************************************************************************/
 
 int ioloop_poller_get(ioloop_type_e type, struct Poller * pl)
@@ -580,8 +2482,15 @@ int ioloop_poller_get(ioloop_type_e type, struct Poller * pl)
         pl->deinit = AcceptPoller_deinit;
         pl->wait = AcceptPoller_wait;
         pl->try_acceptfd = AcceptPoller_try_acceptfd;
+        pl->addfd = AcceptPoller_addfd;
         pl->iterator_reset = AcceptPoller_iterator_reset;
         pl->iterator_getfd = AcceptPoller_iterator_getfd;
+        pl->rearmfd = AcceptPoller_rearmfd;
+        pl->notify = AcceptPoller_notify;
+        pl->pauseaccept = AcceptPoller_pauseaccept;
+        pl->recvfd = poll_common_recvfd;
+        pl->sendfd = poll_common_sendfd;
+        pl->sendfilefd = poll_common_sendfilefd;
         pl->releasefd = AcceptPoller_releasefd;
         pl->maxfd =  AcceptPoller_maxfd;
     } else if  (type == IOLOOP_SELECT) {
@@ -589,8 +2498,15 @@ int ioloop_poller_get(ioloop_type_e type, struct Poller * pl)
         pl->deinit          = SelectPoller_deinit;
         pl->wait            = SelectPoller_wait;
         pl->try_acceptfd    = SelectPoller_try_acceptfd;
+        pl->addfd           = SelectPoller_addfd;
         pl->iterator_reset  = SelectPoller_iterator_reset;
         pl->iterator_getfd  = SelectPoller_iterator_getfd;
+        pl->rearmfd         = SelectPoller_rearmfd;
+        pl->notify          = SelectPoller_notify;
+        pl->pauseaccept     = SelectPoller_pauseaccept;
+        pl->recvfd          = poll_common_recvfd;
+        pl->sendfd          = poll_common_sendfd;
+        pl->sendfilefd      = poll_common_sendfilefd;
         pl->releasefd       = SelectPoller_releasefd;
         pl->maxfd           = SelectPoller_maxfd;
     } else if  (type == IOLOOP_EPOLL) {
@@ -598,10 +2514,33 @@ int ioloop_poller_get(ioloop_type_e type, struct Poller * pl)
         pl->deinit          = EpollPoller_deinit;
         pl->wait            = EpollPoller_wait;
         pl->try_acceptfd    = EpollPoller_try_acceptfd;
+        pl->addfd           = EpollPoller_addfd;
         pl->iterator_reset  = EpollPoller_iterator_reset;
         pl->iterator_getfd  = EpollPoller_iterator_getfd;
+        pl->rearmfd         = EpollPoller_rearmfd;
+        pl->notify          = EpollPoller_notify;
+        pl->pauseaccept     = EpollPoller_pauseaccept;
+        pl->recvfd          = poll_common_recvfd;
+        pl->sendfd          = poll_common_sendfd;
+        pl->sendfilefd      = poll_common_sendfilefd;
         pl->releasefd       = EpollPoller_releasefd;
         pl->maxfd           = EpollPoller_maxfd;
+    } else if  (type == IOLOOP_URING) {
+        pl->init            = UringPoller_init;
+        pl->deinit          = UringPoller_deinit;
+        pl->wait            = UringPoller_wait;
+        pl->try_acceptfd    = UringPoller_try_acceptfd;
+        pl->addfd           = UringPoller_addfd;
+        pl->iterator_reset  = UringPoller_iterator_reset;
+        pl->iterator_getfd  = UringPoller_iterator_getfd;
+        pl->rearmfd         = UringPoller_rearmfd;
+        pl->notify          = UringPoller_notify;
+        pl->pauseaccept     = UringPoller_pauseaccept;
+        pl->recvfd          = UringPoller_recvfd;
+        pl->sendfd          = UringPoller_sendfd;
+        pl->sendfilefd      = poll_common_sendfilefd;
+        pl->releasefd       = UringPoller_releasefd;
+        pl->maxfd           = UringPoller_maxfd;
     } else {
         return -1;
     }
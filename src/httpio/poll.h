@@ -3,11 +3,16 @@
 
 #include "handler.h"
 
+// system
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
 #ifdef __cplusplus
 namespace c10m_ioloop {
 #endif
 
-#define IOLOOP_INST_SIZE_MAX (512)
+#define IOLOOP_INST_SIZE_MAX (1024)
 
 // primitive types
 
@@ -16,7 +21,8 @@ typedef enum ioloop_type_enum {
    IOLOOP_SELECT,
    IOLOOP_POLL,
    IOLOOP_SIG,
-   IOLOOP_EPOLL
+   IOLOOP_EPOLL,
+   IOLOOP_URING
 } ioloop_type_e;
 
 typedef enum sock_state_enum {
@@ -24,6 +30,7 @@ typedef enum sock_state_enum {
     SOCK_WRITABLE,
     SOCK_OOB,
     SOCK_SHUTDOWN,
+    SOCK_ERRQUEUE,      // zero-copy completions to pick up
     SOCK_UNKNOWN
 } sock_state_e;
 
@@ -32,17 +39,39 @@ typedef enum sock_state_enum {
 
 // aggregate types
 
+// DEVNOTE: init with a server_socket of -1 polls no listener, the caller adds the sockets
+//          it connects itself through addfd. They are reported like accepted ones.
 struct Poller {
     int (*init)(void* self, int server_socket);
     void (*deinit)(void* self);
-    int (*wait)(void* self);
+    int (*wait)(void* self, int timeout_ms);   // -1 blocks until an event or a notify
     int (*try_acceptfd)(void* self, int * sockfd);
+    int (*addfd)(void* self, int fd);       // tracks a connector the caller opened, armed for reading
     void (*iterator_reset)(void* self);
     int (*iterator_getfd)(void* self, sock_state_e * state);
+    int (*rearmfd)(void* self, int fd, sock_state_e want);  // thread-safe, the fd is reported again once want is met
+    void (*notify)(void* self);             // thread-safe, wakes up a pending wait
+    int (*pauseaccept)(void* self, int paused);     // stops or resumes polling the listener
+    ssize_t (*recvfd)(void* self, int fd, void * buf, size_t n);                   // thread-safe
+    ssize_t (*sendfd)(void* self, int fd, const struct iovec * iov, int iovcnt, int flags);  // thread-safe, one attempt
+    ssize_t (*sendfilefd)(void* self, int fd, int in_fd, off_t offset, size_t count);       // thread-safe, one attempt
     void (*releasefd)(void* self, int fd);
     int (*maxfd)(void* self);
 };
 
+struct jobpool;
+
+// one reactor of a sharded ioloop, nothing in here is shared with other shards
+struct poll_shard {
+    int server_socket;
+    struct Poller * poller_class;
+    void * poller_inst;
+    struct jobpool * pool;
+    pthread_t thread;
+    int cpu;                // the reactor runs on, -1 when unpinned
+    int rc;
+};
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -50,7 +79,9 @@ extern "C" {
 
 // protoypes
 
-int poll_ioloop(int server_socket, struct Poller * poller_class, void * poller_inst);
+int poll_ioloop(int server_socket, struct Poller * poller_class, void * poller_inst, struct jobpool * pool);
+
+int poll_ioloop_sharded(struct poll_shard * shards, int count);
 
 int ioloop_poller_get(ioloop_type_e type, struct Poller * pl);
 
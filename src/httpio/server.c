@@ -1,15 +1,53 @@
+#define _GNU_SOURCE // memmem, O_PATH
 // freestanding
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 // systems
 #include <errno.h>
+#include <fcntl.h>
+#include <linux/openat2.h>
+#include <pthread.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 // libraries
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 // local
 #include "server.h"
+#include "bufpool.h"
+#include "jobpool.h"
+#include "metrics.h"
+#include "trace.h"
 
 #define SERVER_TRACE 0
 #define SERVER_BLOCK 0
+#define SERVER_HTTP_HEAD_TEMPLATE_MAX 128    // status line and static headers
+
+// 0 keeps the parser on the scalar scanner, for comparison
+#ifndef SERVER_HTTP_SIMD
+#define SERVER_HTTP_SIMD 1
+#endif
+
+// path answered with the metrics of all threads, "" serves it like any other path
+#ifndef SERVER_HTTP_STATS_PATH
+#define SERVER_HTTP_STATS_PATH "/_stats"
+#endif
+
+_Static_assert(SERVER_HTTP_HEAD_MAX <= UINT16_MAX, "server_http_span offsets are 16 bit");
+_Static_assert(SERVER_HTTP_HEAD_MAX <= 
+               1 << (BUFPOOL_CLASS_MIN_SHIFT + (BUFPOOL_CLASSES - 1) * BUFPOOL_CLASS_STEP_SHIFT),
+               "a request head fits the largest buffer");
 
 #if 0
 static
@@ -26,141 +64,1218 @@ void busy_wait(unsigned int profile) {
 #endif
 
 
-static char* default_request_response = 
-"HTTP/1.0 200 OK\r\n"
-"Content-type: text/html\r\n"
-"Content-Length: 146\r\n"
-"\r\n"
-"<html>\n                     "
-" <body>\n                    "
-"  <h1>Hello Client %08x!</h1>\n"
-" </body>\n                   "
-"</html>\n                    ";
+static const char default_body[] = 
+"<html>\n"
+" <body>\n"
+"  <h1>Hello Client!</h1>\n"
+" </body>\n"
+"</html>\n";
+
+
+/******************************************************************************/
+/* response templates */
+/******************************************************************************/
+
+// status line and the headers every response with it carries, serialized at startup
+struct server_http_template {
+    int status;
+    const char * reason;
+    const char * headers;       // static header lines, or NULL
+    size_t len;
+    char head[SERVER_HTTP_HEAD_TEMPLATE_MAX];
+};
+
+static struct server_http_template server_template_ok = { 200, "OK", "Content-Type: text/html\r\n", 0, {0} };
+static struct server_http_template server_template_file = { 200, "OK", NULL, 0, {0} };
+static struct server_http_template server_template_not_modified = { 304, "Not Modified", NULL, 0, {0} };
+static struct server_http_template server_template_bad_request = { 400, "Bad Request", NULL, 0, {0} };
+static struct server_http_template server_template_forbidden = { 403, "Forbidden", NULL, 0, {0} };
+static struct server_http_template server_template_not_found = { 404, "Not Found", NULL, 0, {0} };
+static struct server_http_template server_template_bad_method = { 405, "Method Not Allowed", "Allow: GET, HEAD\r\n", 0, {0} };
+static struct server_http_template server_template_too_large = { 431, "Request Header Fields Too Large", NULL, 0, {0} };
+static struct server_http_template server_template_internal = { 500, "Internal Server Error", NULL, 0, {0} };
+static struct server_http_template server_template_stats = { 200, "OK", "Content-Type: text/plain; version=0.0.4\r\n", 0, {0} };
+
+#define SERVER_HTTP_DATE_SLOTS 4    // power of two
+#define SERVER_HTTP_DATE_LEN (sizeof("Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n") - 1)
+
+// DEVNOTE: The Date header is formatted by whichever worker first sees a new second,
+//          into the slot for that second. Responses point at the slot, which is only
+//          rewritten SERVER_HTTP_DATE_SLOTS seconds later, long after their writev.
+static char server_date[SERVER_HTTP_DATE_SLOTS][SERVER_HTTP_DATE_LEN + 1];
+static _Atomic long server_date_sec = -1;
+static _Atomic int server_date_slot = 0;
+
+static const char server_digit_pairs[] = 
+"00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+// decimal digits of v at dst, two at a time, returns their count
+static size_t server_http_utoa(char * dst, uint64_t v)
+{
+    char tmp[20];
+    char * p = tmp + sizeof(tmp);
+
+    while (v >= 100) {
+        const char * pair = &server_digit_pairs[(v % 100) * 2];
+        v /= 100;
+        p -= 2;
+        p[0] = pair[0];
+        p[1] = pair[1];
+    }
+    if (v >= 10) {
+        p -= 2;
+        p[0] = server_digit_pairs[v * 2];
+        p[1] = server_digit_pairs[v * 2 + 1];
+    } else {
+        *--p = (char)('0' + v);
+    }
+
+    size_t n = (size_t)(tmp + sizeof(tmp) - p);
+    memcpy(dst, p, n);
+
+    return n;
+}
+
+static void server_http_template_init(struct server_http_template * template)
+{
+    int len = snprintf(template->head, sizeof(template->head), "HTTP/1.1 %d %s\r\nServer: httpio\r\n%s",
+                       template->status, template->reason, (NULL != template->headers)? template->headers: "");
+    template->len = (size_t)len;
+}
+
+// the current Date header line, a coarse clock read unless the second just turned
+static const char * server_http_date(void)
+{
+    struct timespec now;
+    struct tm tm;
+
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+
+    long sec = atomic_load_explicit(&server_date_sec, memory_order_relaxed);
+    if (sec != (long)now.tv_sec && 
+            atomic_compare_exchange_strong_explicit(&server_date_sec, &sec, (long)now.tv_sec,
+                memory_order_relaxed, memory_order_relaxed)) {
+        int slot = (int)(now.tv_sec & (SERVER_HTTP_DATE_SLOTS - 1));
+        gmtime_r(&now.tv_sec, &tm);
+        strftime(server_date[slot], sizeof(server_date[slot]), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+        atomic_store_explicit(&server_date_slot, slot, memory_order_release);
+    }
+
+    return server_date[atomic_load_explicit(&server_date_slot, memory_order_acquire)];
+}
+
+__attribute__((constructor))
+static void server_http_templates_init(void)
+{
+    server_http_template_init(&server_template_ok);
+    server_http_template_init(&server_template_file);
+    server_http_template_init(&server_template_not_modified);
+    server_http_template_init(&server_template_bad_request);
+    server_http_template_init(&server_template_forbidden);
+    server_http_template_init(&server_template_not_found);
+    server_http_template_init(&server_template_bad_method);
+    server_http_template_init(&server_template_too_large);
+    server_http_template_init(&server_template_internal);
+    server_http_template_init(&server_template_stats);
+    server_http_date();
+}
+
+// queue status, Date, headers and the connection tail, headers must outlive the flush
+static void server_http_respond_head(struct server_http_response * response, const struct server_http_template * template,
+                                     const char * headers, size_t headers_len, bool keep_alive)
+{
+    static const char keep_alive_tail[] = "Connection: keep-alive\r\n\r\n";
+    static const char close_tail[] = "Connection: close\r\n\r\n";
+
+    struct iovec * iov = &response->iov[response->iovcnt];
+
+    iov[0].iov_base = (void *)template->head;
+    iov[0].iov_len = template->len;
+    iov[1].iov_base = (void *)server_http_date();
+    iov[1].iov_len = SERVER_HTTP_DATE_LEN;
+    iov[2].iov_base = (void *)headers;
+    iov[2].iov_len = headers_len;
+    iov[3].iov_base = (void *)(keep_alive? keep_alive_tail: close_tail);
+    iov[3].iov_len = keep_alive? sizeof(keep_alive_tail) - 1: sizeof(close_tail) - 1;
+    response->iovcnt += 4;
+    response->count += 1;
+}
 
-// read avaiable bytes
-static ssize_t reada(int fd, void *buffer, size_t n)
+// queue a response with its body in memory, only the Content-Length is written here
+static void server_http_respond(struct server_http_response * response, const struct server_http_template * template,
+                                const void * body, size_t body_len, bool keep_alive)
 {
-    ssize_t numRead;                    /* # of bytes fetched by last read() */
+    static const char content_length[] = "Content-Length: ";
+
+    char * framing = response->buf + response->used;
+    size_t len = 0;
+
+    memcpy(framing, content_length, sizeof(content_length) - 1);
+    len += sizeof(content_length) - 1;
+    len += server_http_utoa(framing + len, body_len);
+    framing[len++] = '\r';
+    framing[len++] = '\n';
+    response->used += len;
+
+    server_http_respond_head(response, template, framing, len, keep_alive);
+    if (body_len > 0) {
+        response->iov[response->iovcnt].iov_base = (void *)body;
+        response->iov[response->iovcnt].iov_len = body_len;
+        response->iovcnt += 1;
+    }
+}
+
+
+/******************************************************************************/
+/* character classes */
+/******************************************************************************/
+
+// DEVNOTE: A class is a bitmap indexed by the low nibble with one bit per high nibble
+//          0-7, the vector scanners look it up with one byte shuffle per nibble. Bytes
+//          from 0x80 up belong to a class only if it takes obs-text.
+struct server_http_class {
+    uint8_t lo[16];
+    bool high;
+};
+
+static struct server_http_class server_class_token;    // method, header names
+static struct server_http_class server_class_target;   // request-target
+static struct server_http_class server_class_value;    // header values
 
-    while(1) {
-        numRead = read(fd, buffer, n);
-        if (numRead == 0) {               /* EOF */
-            return 0;
-        } else if (numRead == -1) {
-            if (errno == EINTR)
-                continue;               /* Interrupted --> restart read() */
-            else
-                return -1;              /* Some other error */
-        } else {
-            break;                      /* All avaiable data read/buffer full */
+typedef size_t (*server_scan_fn)(const struct server_http_class * cls, const char * p, size_t n);
+
+static inline bool server_class_has(const struct server_http_class * cls, uint8_t c)
+{
+    return (c & 0x80)? cls->high: ((cls->lo[c & 0x0f] >> (c >> 4)) & 1) != 0;
+}
+
+static void server_class_add(struct server_http_class * cls, uint8_t first, uint8_t last)
+{
+    for (unsigned c = first; c <= last; c++) {
+        cls->lo[c & 0x0f] = (uint8_t)(cls->lo[c & 0x0f] | (1u << (c >> 4)));
+    }
+}
+
+// index of the first byte outside cls, n when there is none
+static size_t server_scan_scalar(const struct server_http_class * cls, const char * p, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (!server_class_has(cls, (uint8_t)p[i])) {
+            return i;
         }
     }
 
-    return numRead;                     /* Must be 'n' bytes if we get here */
+    return n;
 }
 
-#if 0
-static ssize_t readn(int fd, void *buffer, size_t n)
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static size_t server_scan_sse42(const struct server_http_class * cls, const char * p, size_t n)
 {
-    ssize_t numRead;                    /* # of bytes fetched by last read() */
-    size_t totRead;                     /* Total # of bytes read so far */
-    char *buf;
+    const __m128i lo_tbl = _mm_loadu_si128((const __m128i *)cls->lo);
+    const __m128i hi_tbl = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i high = cls->high? _mm_set1_epi8((char)0x80): _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i lo = _mm_shuffle_epi8(lo_tbl, _mm_and_si128(v, nibble));
+        __m128i hi = _mm_shuffle_epi8(hi_tbl, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        __m128i out = _mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128());
+        unsigned miss = (unsigned)_mm_movemask_epi8(out) & ~(unsigned)_mm_movemask_epi8(_mm_and_si128(v, high));
+        if (miss != 0) {
+            return i + (size_t)__builtin_ctz(miss);
+        }
+    }
+
+    return i + server_scan_scalar(cls, p + i, n - i);
+}
 
-    buf = buffer;                       /* No pointer arithmetic on "void *" */
-    for (totRead = 0; totRead < n; ) {
-        numRead = read(fd, buf, n - totRead);
+__attribute__((target("avx2")))
+static size_t server_scan_avx2(const struct server_http_class * cls, const char * p, size_t n)
+{
+    const __m256i lo_tbl = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)cls->lo));
+    const __m256i hi_tbl = _mm256_broadcastsi128_si256(
+            _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i high = cls->high? _mm256_set1_epi8((char)0x80): _mm256_setzero_si256();
+    size_t i = 0;
 
-        if (numRead == 0)               /* EOF */
-            return totRead;             /* May be 0 if this is first read() */
-        if (numRead == -1) {
-            if (errno == EINTR)
-                continue;               /* Interrupted --> restart read() */
-            else
-                return -1;              /* Some other error */
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i lo = _mm256_shuffle_epi8(lo_tbl, _mm256_and_si256(v, nibble));
+        __m256i hi = _mm256_shuffle_epi8(hi_tbl, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        __m256i out = _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256());
+        unsigned miss = (unsigned)_mm256_movemask_epi8(out) & ~(unsigned)_mm256_movemask_epi8(_mm256_and_si256(v, high));
+        if (miss != 0) {
+            return i + (size_t)__builtin_ctz(miss);
         }
-        totRead += numRead;
-        buf += numRead;
     }
-    return totRead;                     /* Must be 'n' bytes if we get here */
+
+    return i + server_scan_scalar(cls, p + i, n - i);
 }
 #endif
 
+static server_scan_fn server_scan = server_scan_scalar;
+
+// build the classes and pick the widest scanner the cpu runs
+__attribute__((constructor))
+static void server_http_classes_init(void)
+{
+    static const char token_extra[] = "!#$%&'*+-.^_`|~";
+
+    for (const char * c = token_extra; *c != '\0'; c++) {
+        server_class_add(&server_class_token, (uint8_t)*c, (uint8_t)*c);
+    }
+    server_class_add(&server_class_token, '0', '9');
+    server_class_add(&server_class_token, 'A', 'Z');
+    server_class_add(&server_class_token, 'a', 'z');
+
+    server_class_add(&server_class_target, 0x21, 0x7e);
+
+    server_class_add(&server_class_value, 0x20, 0x7e);
+    server_class_add(&server_class_value, '\t', '\t');
+    server_class_value.high = true;
+
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (SERVER_HTTP_SIMD && __builtin_cpu_supports("avx2")) {
+        server_scan = server_scan_avx2;
+    } else if (SERVER_HTTP_SIMD && __builtin_cpu_supports("sse4.2")) {
+        server_scan = server_scan_sse42;
+    }
+#endif
+}
+
 
-static ssize_t writen(int fd, const void *buffer, size_t n)
+/******************************************************************************/
+/* parser */
+/******************************************************************************/
+
+enum server_parse_state_enum {
+    PARSE_METHOD,
+    PARSE_TARGET,
+    PARSE_VERSION,
+    PARSE_LINE_LF,
+    PARSE_HEADER_START,
+    PARSE_HEADER_NAME,
+    PARSE_HEADER_OWS,
+    PARSE_HEADER_VALUE,
+    PARSE_HEADER_LF,
+    PARSE_END_LF
+};
+
+// parser state only, the buffer and what's in it stay
+static void server_http_request_reset(struct server_http_request * request)
+{
+    request->minor_version = 0;
+    request->keep_alive = 0;
+    request->status = 0;
+    request->header_count = 0;
+    request->parse_state = PARSE_METHOD;
+    request->parse_pos = 0;
+    request->parse_mark = 0;
+    request->head_len = 0;
+    request->body_len = 0;
+    request->body_left = 0;
+}
+
+void server_http_request_init(struct server_http_request * request)
 {
-    ssize_t numWritten;                 /* # of bytes written by last write() */
-    size_t totWritten;                  /* Total # of bytes written so far */
-    const char *buf;
+    server_http_request_reset(request);
+    request->len = 0;
+    request->cap = 0;
+    request->buf = NULL;
+    request->iobuf = NULL;
+}
 
-    buf = buffer;                       /* No pointer arithmetic on "void *" */
-    for (totWritten = 0; totWritten < n; ) {
-        numWritten = write(fd, buf, n - totWritten);
+// give the buffer back, whatever is still in it is dropped
+void server_http_request_release(struct server_http_request * request)
+{
+    if (NULL != request->iobuf) {
+        bufpool_put(request->iobuf);
+    }
+    request->len = 0;
+    request->cap = 0;
+    request->buf = NULL;
+    request->iobuf = NULL;
+}
 
-        if (numWritten <= 0) {
-            if (numWritten == -1 && errno == EINTR)
-                continue;               /* Interrupted --> restart write() */
-            else
-                return -1;              /* Some other error */
+static struct server_http_span server_http_span_make(size_t from, size_t to)
+{
+    struct server_http_span span = { (uint16_t)from, (uint16_t)(to - from) };
+
+    return span;
+}
+
+static bool server_http_span_ieq(const struct server_http_request * request, struct server_http_span span, 
+                                 const char * lower)
+{
+    size_t n = strlen(lower);
+
+    if (span.len != n) {
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        char c = request->buf[span.off + i];
+        c = (c >= 'A' && c <= 'Z')? (char)(c + ('a' - 'A')): c;
+        if (c != lower[i]) {
+            return false;
         }
-        totWritten += numWritten;
-        buf += numWritten;
     }
-    return (ssize_t)totWritten;                  /* Must be 'n' bytes if we get here */
+
+    return true;
 }
 
-server_state_e server_http_process_request(int connector_fd, struct server_http_request * request)
+static server_parse_e server_http_fail(struct server_http_request * request, int status)
 {
-    char req_str[1024];
-    ssize_t req_len = 0;
+    request->status = status;
 
-    req_len = reada(connector_fd, req_str, sizeof (req_str) - 1);
-    if (req_len >= 1024) {
-        return SERVER_ERROR;
-    } else if (req_len == 0) {
-        return SERVER_CLIENT_CLOSED;
-    } else if (req_len == -1) {
-        return SERVER_CLIENT_ERROR;
+    return SERVER_PARSE_ERROR;
+}
+
+// HTTP/1.1 keeps the connection by default, HTTP/1.0 only when asked
+// DEVNOTE: A chunked body can't be skipped without decoding it, the connection is
+//          closed after the response instead.
+static server_parse_e server_http_connection(struct server_http_request * request)
+{
+    request->keep_alive = (request->minor_version >= 1);
+
+    for (int i = 0; i < request->header_count; i++) {
+        struct server_http_header * header = &request->headers[i];
+        if (server_http_span_ieq(request, header->name, "connection")) {
+            if (server_http_span_ieq(request, header->value, "close")) {
+                request->keep_alive = 0;
+            } else if (server_http_span_ieq(request, header->value, "keep-alive")) {
+                request->keep_alive = 1;
+            }
+        } else if (server_http_span_ieq(request, header->name, "transfer-encoding")) {
+            request->keep_alive = 0;
+        } else if (server_http_span_ieq(request, header->name, "content-length")) {
+            const char * digits = request->buf + header->value.off;
+            size_t body_len = 0;
+            if (header->value.len == 0 || header->value.len > 18) {
+                return server_http_fail(request, 400);
+            }
+            for (int j = 0; j < header->value.len; j++) {
+                if (digits[j] < '0' || digits[j] > '9') {
+                    return server_http_fail(request, 400);
+                }
+                body_len = body_len * 10 + (size_t)(digits[j] - '0');
+            }
+            request->body_len = body_len;
+        }
     }
 
-    if (SERVER_TRACE) {
-        req_str[1024 -1] = '\0';
-        printf("%s", req_str);
+    return SERVER_PARSE_DONE;
+}
+
+// feed what's in buf, AGAIN asks for more bytes and a call once they are appended
+server_parse_e server_http_parse(struct server_http_request * request)
+{
+    const char * buf = request->buf;
+    size_t len = request->len;
+    size_t pos = request->parse_pos;
+    size_t mark = request->parse_mark;
+    int state = request->parse_state;
+    server_parse_e rc = SERVER_PARSE_AGAIN;
+
+    while (pos < len) {
+        switch (state) {
+        case PARSE_METHOD:
+            pos += server_scan(&server_class_token, buf + pos, len - pos);
+            if (pos == len) {
+                break;
+            } else if (buf[pos] != ' ' || pos == mark) {
+                return server_http_fail(request, 400);
+            }
+            request->method = server_http_span_make(mark, pos);
+            mark = ++pos;
+            state = PARSE_TARGET;
+            break;
+
+        case PARSE_TARGET:
+            pos += server_scan(&server_class_target, buf + pos, len - pos);
+            if (pos == len) {
+                break;
+            } else if (buf[pos] != ' ' || pos == mark) {
+                return server_http_fail(request, 400);
+            }
+            request->path = server_http_span_make(mark, pos);
+            mark = ++pos;
+            state = PARSE_VERSION;
+            break;
+
+        case PARSE_VERSION:
+            // "HTTP/1.x"
+            if (len - mark < 8) {
+                pos = len;
+                break;
+            } else if (memcmp(buf + mark, "HTTP/1.", 7) != 0 || buf[mark + 7] < '0' || buf[mark + 7] > '9') {
+                return server_http_fail(request, 400);
+            }
+            request->version = server_http_span_make(mark, mark + 8);
+            request->minor_version = buf[mark + 7] - '0';
+            pos = mark + 8;
+            state = PARSE_LINE_LF;
+            break;
+
+        case PARSE_LINE_LF:
+        case PARSE_HEADER_LF:
+            // bare LF is tolerated, anything else after CR is not
+            if (buf[pos] == '\r' && pos + 1 == len) {
+                goto EXIT; // look at the CR again with the next bytes
+            } else if (buf[pos] == '\r' && buf[pos + 1] == '\n') {
+                pos += 2;
+            } else if (buf[pos] == '\n') {
+                pos += 1;
+            } else {
+                return server_http_fail(request, 400);
+            }
+            state = PARSE_HEADER_START;
+            break;
+
+        case PARSE_HEADER_START:
+            if (buf[pos] == '\r' || buf[pos] == '\n') {
+                state = PARSE_END_LF;
+            } else if (request->header_count == SERVER_HTTP_MAX_HEADERS) {
+                return server_http_fail(request, 431);
+            } else {
+                // obs-fold continuation lines fail on the name
+                mark = pos;
+                state = PARSE_HEADER_NAME;
+            }
+            break;
+
+        case PARSE_HEADER_NAME:
+            pos += server_scan(&server_class_token, buf + pos, len - pos);
+            if (pos == len) {
+                break;
+            } else if (buf[pos] != ':' || pos == mark) {
+                return server_http_fail(request, 400);
+            }
+            request->headers[request->header_count].name = server_http_span_make(mark, pos);
+            mark = ++pos;
+            state = PARSE_HEADER_OWS;
+            break;
+
+        case PARSE_HEADER_OWS:
+            while (pos < len && (buf[pos] == ' ' || buf[pos] == '\t')) {
+                pos += 1;
+            }
+            if (pos == len) {
+                break;
+            }
+            mark = pos;
+            state = PARSE_HEADER_VALUE;
+            break;
+
+        case PARSE_HEADER_VALUE:
+            pos += server_scan(&server_class_value, buf + pos, len - pos);
+            if (pos == len) {
+                break;
+            } else if (buf[pos] != '\r' && buf[pos] != '\n') {
+                return server_http_fail(request, 400);
+            } else {
+                size_t end = pos;
+                while (end > mark && (buf[end - 1] == ' ' || buf[end - 1] == '\t')) {
+                    end -= 1;
+                }
+                request->headers[request->header_count].value = server_http_span_make(mark, end);
+                request->header_count += 1;
+                state = PARSE_HEADER_LF;
+            }
+            break;
+
+        case PARSE_END_LF:
+            if (buf[pos] == '\r' && pos + 1 == len) {
+                goto EXIT;
+            } else if (buf[pos] == '\r' && buf[pos + 1] == '\n') {
+                pos += 2;
+            } else if (buf[pos] == '\n') {
+                pos += 1;
+            } else {
+                return server_http_fail(request, 400);
+            }
+            request->head_len = pos;
+            rc = server_http_connection(request);
+            goto EXIT;
+
+        default:
+            return server_http_fail(request, 400);
+        }
+    }
+
+EXIT:
+    if (rc == SERVER_PARSE_AGAIN && len == SERVER_HTTP_HEAD_MAX) {
+        return server_http_fail(request, 431);
+    }
+    request->parse_pos = pos;
+    request->parse_mark = mark;
+    request->parse_state = state;
+
+    return rc;
+}
+
+
+/******************************************************************************/
+/* static files */
+/******************************************************************************/
+
+#define SERVER_STATIC_PATH_MAX 256
+#define SERVER_STATIC_SHARDS 16         // power of two, each with its own lock and LRU
+#define SERVER_STATIC_SHARD_ENTRIES 64  // open fds kept per shard
+#define SERVER_STATIC_BUCKETS 128       // power of two, per shard
+#define SERVER_STATIC_TTL 2             // seconds an entry is served before it is reopened
+#define SERVER_STATIC_HEADERS_MAX 192
+
+// DEVNOTE: An entry keeps the file open along with its response headers, serialized
+//          when it was loaded. A response holds a reference while it sends, so an
+//          evicted entry is only closed once its last response is out.
+struct server_static_entry {
+    struct server_static_entry * hnext;     // bucket chain, shard lock
+    struct server_static_entry * prev;      // LRU, most recent first, shard lock
+    struct server_static_entry * next;
+    uint64_t hash;
+    int refs;                               // the cache's own and in-flight responses, shard lock
+    bool cached;                            // shard lock
+    int fd;
+    off_t size;
+    long expires;                           // monotonic seconds
+    size_t headers_len;                     // Content-Type, ETag, Content-Length
+    size_t etag_off;                        // ETag header line within headers
+    size_t etag_len;
+    char headers[SERVER_STATIC_HEADERS_MAX];
+    size_t path_len;
+    char path[SERVER_STATIC_PATH_MAX];
+};
+
+struct server_static_shard {
+    _Alignas(64)
+    pthread_mutex_t lock;
+    struct server_static_entry * buckets[SERVER_STATIC_BUCKETS];
+    struct server_static_entry lru;         // sentinel
+    int count;
+};
+
+static int server_static_root = -1;         // set once before the first request
+static struct server_static_shard server_static_shards[SERVER_STATIC_SHARDS];
+
+static const struct {
+    const char * ext;
+    const char * type;
+} server_static_types[] = {
+    { "html", "text/html" },
+    { "htm", "text/html" },
+    { "css", "text/css" },
+    { "js", "text/javascript" },
+    { "json", "application/json" },
+    { "txt", "text/plain" },
+    { "xml", "application/xml" },
+    { "svg", "image/svg+xml" },
+    { "png", "image/png" },
+    { "jpg", "image/jpeg" },
+    { "jpeg", "image/jpeg" },
+    { "gif", "image/gif" },
+    { "ico", "image/x-icon" },
+    { "webp", "image/webp" },
+    { "wasm", "application/wasm" },
+    { "pdf", "application/pdf" },
+};
+
+// serve files below root instead of the built-in page
+int server_http_static_init(const char * root)
+{
+    server_static_root = open(root, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (server_static_root == -1) {
+        perror("server: static-init: open");
+        return -1;
+    }
+
+    for (int i = 0; i < SERVER_STATIC_SHARDS; i++) {
+        struct server_static_shard * shard = &server_static_shards[i];
+        if (pthread_mutex_init(&shard->lock, NULL) != 0) {
+            perror("server: static-init: mutex");
+            return -1;
+        }
+        shard->lru.prev = &shard->lru;
+        shard->lru.next = &shard->lru;
+        shard->count = 0;
+    }
+
+    return 0;
+}
+
+static const char * server_static_type(const char * path, size_t len)
+{
+    const char * dot = NULL;
+
+    for (size_t i = len; i > 0 && path[i - 1] != '/'; i--) {
+        if (path[i - 1] == '.') {
+            dot = &path[i];
+            break;
+        }
+    }
+    if (NULL != dot) {
+        for (size_t i = 0; i < sizeof(server_static_types) / sizeof(server_static_types[0]); i++) {
+            if (strcasecmp(dot, server_static_types[i].ext) == 0) {
+                return server_static_types[i].type;
+            }
+        }
+    }
+
+    return "application/octet-stream";
+}
+
+static int server_static_hexval(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c = (char)(c | 0x20);
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+
+    return -1;
+}
+
+// the target as a path relative to the root, index.html for directories, -1 if it isn't one
+// DEVNOTE: Segments are percent-decoded before they are looked at, empty and "." ones
+//          are dropped and ".." is refused. openat2 keeps symlinks beneath the root on
+//          top of that.
+static int server_static_resolve(const char * target, size_t len, char * path, size_t path_size)
+{
+    static const char index[] = "index.html";
+    size_t out = 0;
+    size_t seg = 0;             // start of the current segment in path
+    bool dir = true;            // nothing after the last separator
+
+    if (len == 0 || target[0] != '/') {
+        return -1;
     }
 
-    // TODO: Actually process the request
-    request->dummy = 0;
+    for (size_t i = 1; i < len && target[i] != '?' && target[i] != '#'; i++) {
+        char c = target[i];
+        if (c == '/') {
+            size_t n = out - seg;
+            if (n == 2 && path[seg] == '.' && path[seg + 1] == '.') {
+                return -1;
+            } else if (n == 0 || (n == 1 && path[seg] == '.')) {
+                out = seg;
+            } else if (out + 1 < path_size) {
+                path[out++] = '/';
+                seg = out;
+            } else {
+                return -1;
+            }
+            dir = true;
+            continue;
+        }
+
+        if (c == '%') {
+            int hi = (i + 2 < len)? server_static_hexval(target[i + 1]): -1;
+            int lo = (i + 2 < len)? server_static_hexval(target[i + 2]): -1;
+            if (hi < 0 || lo < 0) {
+                return -1;
+            }
+            c = (char)(hi << 4 | lo);
+            if (c == '\0' || c == '/') {
+                return -1;      // an encoded separator must not become one
+            }
+            i += 2;
+        }
+        if (out + 1 >= path_size) {
+            return -1;
+        }
+        path[out++] = c;
+        dir = false;
+    }
+
+    // the last segment has no separator after it
+    size_t n = out - seg;
+    if (n == 2 && path[seg] == '.' && path[seg + 1] == '.') {
+        return -1;
+    } else if (n == 1 && path[seg] == '.') {
+        out = seg;
+        dir = true;
+    }
+
+    if (dir) {
+        if (out + sizeof(index) > path_size) {
+            return -1;
+        }
+        memcpy(path + out, index, sizeof(index) - 1);
+        out += sizeof(index) - 1;
+    }
+    path[out] = '\0';
+
+    return (int)out;
+}
+
+static uint64_t server_static_hash(const char * path, size_t len)
+{
+    uint64_t hash = 14695981039346656037ull;   // FNV-1a
+
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)path[i]) * 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static long server_static_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+    return (long)now.tv_sec;
+}
+
+// below root only, -1 with errno
+static int server_static_open(const char * path)
+{
+    struct open_how how;
+
+    memset(&how, 0, sizeof(how));
+    how.flags = O_RDONLY | O_CLOEXEC;
+    how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+
+    int fd = (int)syscall(SYS_openat2, server_static_root, path, &how, sizeof(how));
+    if (fd == -1 && errno == ENOSYS) {
+        // DEVNOTE: Before 5.6 the lexical checks in server_static_resolve are all there
+        //          is, symlinks inside the root are followed wherever they point.
+        fd = openat(server_static_root, path, O_RDONLY | O_CLOEXEC);
+    }
+
+    // cached files stay clear of the fds select can poll, when the limit leaves room
+    if (fd != -1 && fd < FD_SETSIZE) {
+        int high = fcntl(fd, F_DUPFD_CLOEXEC, FD_SETSIZE);
+        if (high != -1) {
+            close(fd);
+            fd = high;
+        }
+    }
+
+    return fd;
+}
+
+// shard lock held
+static void server_static_unlink(struct server_static_shard * shard, struct server_static_entry * entry)
+{
+    struct server_static_entry ** link = &shard->buckets[entry->hash & (SERVER_STATIC_BUCKETS - 1)];
+
+    while (*link != entry) {
+        link = &(*link)->hnext;
+    }
+    *link = entry->hnext;
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->cached = false;
+    shard->count -= 1;
+}
+
+// shard lock held, the entry goes once nothing refers to it
+static void server_static_unref(struct server_static_entry * entry)
+{
+    entry->refs -= 1;
+    if (entry->refs == 0) {
+        close(entry->fd);
+        free(entry);
+    }
+}
+
+// open and describe path, NULL with the status to answer with
+static struct server_static_entry * server_static_load(const char * path, size_t len, uint64_t hash, int * status)
+{
+    struct stat st;
+    struct server_static_entry * entry = NULL;
+
+    int fd = server_static_open(path);
+    if (fd == -1) {
+        *status = (errno == EACCES)? 403: (errno == EMFILE || errno == ENFILE || errno == ENOMEM)? 500: 404;
+        return NULL;
+    }
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        *status = 404;
+        return NULL;
+    }
+
+    entry = malloc(sizeof(*entry));
+    if (NULL == entry) {
+        close(fd);
+        *status = 500;
+        return NULL;
+    }
+
+    entry->hash = hash;
+    entry->refs = 1;
+    entry->cached = false;
+    entry->fd = fd;
+    entry->size = st.st_size;
+    entry->expires = server_static_now() + SERVER_STATIC_TTL;
+    entry->path_len = len;
+    memcpy(entry->path, path, len + 1);
+
+    // a strong validator from what changes whenever the content does
+    int type_len = snprintf(entry->headers, sizeof(entry->headers), "Content-Type: %s\r\n", 
+                            server_static_type(path, len));
+    int etag_len = snprintf(entry->headers + type_len, sizeof(entry->headers) - (size_t)type_len,
+                            "ETag: \"%lx-%lx-%lx\"\r\n", (unsigned long)st.st_ino, (unsigned long)st.st_size,
+                            (unsigned long)st.st_mtim.tv_sec * 1000000000ul + (unsigned long)st.st_mtim.tv_nsec);
+    entry->etag_off = (size_t)type_len;
+    entry->etag_len = (size_t)etag_len;
+    entry->headers_len = entry->etag_off + entry->etag_len;
+    memcpy(entry->headers + entry->headers_len, "Content-Length: ", 16);
+    entry->headers_len += 16;
+    entry->headers_len += server_http_utoa(entry->headers + entry->headers_len, (uint64_t)st.st_size);
+    entry->headers[entry->headers_len++] = '\r';
+    entry->headers[entry->headers_len++] = '\n';
+
+    return entry;
+}
+
+// the cached entry for path, loaded on a miss or once it expired, NULL with a status
+static struct server_static_entry * server_static_get(const char * path, size_t len, int * status)
+{
+    uint64_t hash = server_static_hash(path, len);
+    struct server_static_shard * shard = &server_static_shards[hash & (SERVER_STATIC_SHARDS - 1)];
+    struct server_static_entry * entry = NULL;
+    long now = server_static_now();
+
+    pthread_mutex_lock(&shard->lock);
+    entry = shard->buckets[hash & (SERVER_STATIC_BUCKETS - 1)];
+    while (NULL != entry && (entry->hash != hash || entry->path_len != len || memcmp(entry->path, path, len) != 0)) {
+        entry = entry->hnext;
+    }
+    if (NULL != entry && entry->expires > now) {
+        entry->prev->next = entry->next;
+        entry->next->prev = entry->prev;
+        entry->next = shard->lru.next;
+        entry->prev = &shard->lru;
+        shard->lru.next->prev = entry;
+        shard->lru.next = entry;
+        entry->refs += 1;
+        pthread_mutex_unlock(&shard->lock);
+        return entry;
+    }
+    if (NULL != entry) {
+        server_static_unlink(shard, entry);
+        server_static_unref(entry);
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    // DEVNOTE: Loaded without the lock, two workers missing on the same path both load it
+    //          and the second one to insert replaces the first.
+    entry = server_static_load(path, len, hash, status);
+    if (NULL == entry) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&shard->lock);
+    struct server_static_entry * old = shard->buckets[hash & (SERVER_STATIC_BUCKETS - 1)];
+    while (NULL != old && (old->hash != hash || old->path_len != len || memcmp(old->path, path, len) != 0)) {
+        old = old->hnext;
+    }
+    if (NULL != old) {
+        server_static_unlink(shard, old);
+        server_static_unref(old);
+    }
+    if (shard->count == SERVER_STATIC_SHARD_ENTRIES) {
+        old = shard->lru.prev;
+        server_static_unlink(shard, old);
+        server_static_unref(old);
+    }
+    entry->hnext = shard->buckets[hash & (SERVER_STATIC_BUCKETS - 1)];
+    shard->buckets[hash & (SERVER_STATIC_BUCKETS - 1)] = entry;
+    entry->next = shard->lru.next;
+    entry->prev = &shard->lru;
+    shard->lru.next->prev = entry;
+    shard->lru.next = entry;
+    entry->cached = true;
+    entry->refs += 1;
+    shard->count += 1;
+    pthread_mutex_unlock(&shard->lock);
+
+    return entry;
+}
+
+static void server_static_put(struct server_static_entry * entry)
+{
+    struct server_static_shard * shard = &server_static_shards[entry->hash & (SERVER_STATIC_SHARDS - 1)];
+
+    pthread_mutex_lock(&shard->lock);
+    server_static_unref(entry);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// If-None-Match naming the entry's tag, or any
+static bool server_static_not_modified(const struct server_http_request * request, const struct server_static_entry * entry)
+{
+    const char * etag = entry->headers + entry->etag_off + 6;  // past "ETag: "
+    size_t etag_len = entry->etag_len - 8;                      // and without the CRLF
+
+    for (int i = 0; i < request->header_count; i++) {
+        const struct server_http_header * header = &request->headers[i];
+        if (!server_http_span_ieq(request, header->name, "if-none-match")) {
+            continue;
+        }
+        const char * value = request->buf + header->value.off;
+        if ((header->value.len == 1 && value[0] == '*') || 
+                memmem(value, header->value.len, etag, etag_len) != NULL) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// answer from the root, the body goes out with sendfile behind every queued header
+static server_state_e server_static_respond(struct jobnode * job, const struct server_http_request * request,
+                                            struct server_http_response * response)
+{
+    char path[SERVER_STATIC_PATH_MAX];
+    const char * method = request->buf + request->method.off;
+    bool head = (request->method.len == 4 && memcmp(method, "HEAD", 4) == 0);
+    bool get = (request->method.len == 3 && memcmp(method, "GET", 3) == 0);
+    int status = 0;
+
+    if (!get && !head) {
+        server_http_respond(response, &server_template_bad_method, NULL, 0, request->keep_alive);
+        return SERVER_OK;
+    }
+
+    int len = server_static_resolve(request->buf + request->path.off, request->path.len, path, sizeof(path));
+    if (len < 0) {
+        server_http_respond(response, &server_template_not_found, NULL, 0, request->keep_alive);
+        return SERVER_OK;
+    }
+
+    struct server_static_entry * entry = server_static_get(path, (size_t)len, &status);
+    if (NULL == entry) {
+        server_http_respond(response, (status == 403)? &server_template_forbidden: 
+                            (status == 500)? &server_template_internal: &server_template_not_found,
+                            NULL, 0, request->keep_alive);
+        return SERVER_OK;
+    }
+
+    // the entry's headers are queued, so everything goes out before it is let go
+    size_t count = 0;
+    if (server_static_not_modified(request, entry)) {
+        server_http_respond_head(response, &server_template_not_modified, entry->headers + entry->etag_off,
+                                 entry->etag_len, request->keep_alive);
+    } else {
+        server_http_respond_head(response, &server_template_file, entry->headers, entry->headers_len,
+                                 request->keep_alive);
+        count = head? 0: (size_t)entry->size;
+    }
+    ssize_t write_len = job_sendfile(job, response->iov, response->iovcnt, entry->fd, 0, count);
+    server_http_response_init(response);
+    server_static_put(entry);
+
+    return (write_len == -1)? SERVER_ERROR: SERVER_OK;
+}
+
+
+/******************************************************************************/
+/* stats */
+/******************************************************************************/
+
+static bool server_stats_match(const struct server_http_request * request)
+{
+    size_t len = sizeof(SERVER_HTTP_STATS_PATH) - 1;
 
-    return SERVER_CLIENT_CLOSE_REQ; // TODO: Fix the return code based on the request
+    return len > 0 && NULL != metrics_region_get() && request->path.len == len &&
+           memcmp(request->buf + request->path.off, SERVER_HTTP_STATS_PATH, len) == 0;
+}
+
+// the metrics of all threads, sent right away with whatever was queued before
+// DEVNOTE: The body is rendered into a pooled buffer, which has to outlive the send.
+static server_state_e server_stats_respond(struct jobnode * job, const struct server_http_request * request,
+                                           struct server_http_response * response)
+{
+    struct iobuf * body = bufpool_get(bufpool_class_size(BUFPOOL_CLASSES - 1));
+    if (NULL == body) {
+        server_http_respond(response, &server_template_internal, NULL, 0, request->keep_alive);
+        return SERVER_OK;
+    }
+
+    size_t len = metrics_format(metrics_region_get(), body->data, body->size);
+    len = (len < body->size)? len: body->size - 1;      // cut short, still text
+    server_http_respond(response, &server_template_stats, body->data, len, request->keep_alive);
+    server_state_e state = server_http_response_flush(job, response);
+    bufpool_put(body);
+
+    return state;
+}
+
+
+/******************************************************************************/
+/* request / response */
+/******************************************************************************/
+
+// drop body bytes at the front of buf, nothing here reads request bodies
+static void server_http_discard(struct server_http_request * request)
+{
+    size_t n = (request->body_left < request->len)? request->body_left: request->len;
+
+    if (n > 0) {
+        memmove(request->buf, request->buf + n, request->len - n);
+        request->len -= n;
+        request->body_left -= n;
+    }
+}
+
+// start on the next pipelined request, whatever followed this one moves to the front
+void server_http_request_next(struct server_http_request * request)
+{
+    size_t head_len = request->head_len;
+    size_t body_len = request->body_len;
+    size_t len = request->len;
+
+    server_http_request_reset(request);
+    memmove(request->buf, request->buf + head_len, len - head_len);
+    request->len = len - head_len;
+    request->body_left = body_len;
+    server_http_discard(request);
+
+    if (request->len == 0) {
+        server_http_request_release(request);
+    }
 }
 
+// room to receive into, a buffer on the first read and a larger one once it is full
+static int server_http_request_reserve(struct server_http_request * request)
+{
+    struct iobuf * iobuf = NULL;
+
+    if (NULL == request->iobuf) {
+        iobuf = bufpool_get(bufpool_class_size(0));
+    } else if (request->len == request->cap) {
+        iobuf = bufpool_grow(request->iobuf, request->len, request->cap + 1);
+    } else {
+        return 0;
+    }
+    if (NULL == iobuf) {
+        return -1;
+    }
+
+    request->iobuf = iobuf;
+    request->buf = iobuf->data;
+    request->cap = (iobuf->size < SERVER_HTTP_HEAD_MAX)? iobuf->size: SERVER_HTTP_HEAD_MAX;
 
-server_state_e server_http_process_response(int connector_fd, const struct server_http_request * request)
+    return 0;
+}
+
+// read until the request head is complete, the coroutine suspends while there is nothing
+// DEVNOTE: Without wait, a recv finding nothing returns SERVER_CLIENT_IDLE instead, so
+//          the caller can flush its responses or let go of the connection first.
+server_state_e server_http_process_request(struct jobnode * job, struct server_http_request * request, bool wait)
 {
-    static int rsp_count = 0;
+    server_parse_e parsed = SERVER_PARSE_AGAIN;
 
-    char resp_str[1024];
-    ssize_t write_len = 0;
-    int resp_len = -1;
+    // a pipelined request may be buffered already
+    if (request->len > 0) {
+        parsed = server_http_parse(request);
+    }
 
-    if (request->dummy != 0) {
-        // TODO: Actually do something
+    while (parsed == SERVER_PARSE_AGAIN) {
+        if (server_http_request_reserve(request) == -1) {
+            return SERVER_CLIENT_ERROR;
+        }
+        char * tail = request->buf + request->len;
+        size_t room = request->cap - request->len;
+        ssize_t req_len = wait? job_recv(job, tail, room): job_try_recv(job, tail, room);
+        if (req_len == 0) {
+            return SERVER_CLIENT_CLOSED;
+        } else if (req_len == -1 && !wait && job_io_again()) {
+            if (request->len == 0) {
+                server_http_request_release(request);
+            }
+            return SERVER_CLIENT_IDLE;
+        } else if (req_len == -1) {
+            return SERVER_CLIENT_ERROR;
+        }
+        request->len += (size_t)req_len;
+        server_http_discard(request);
+
+        parsed = server_http_parse(request);
+    }
+
+    // the next head gets its own read deadline, see job_block
+    job->timeout = JOB_TIMEOUT_NONE;
+
+    if (SERVER_TRACE) {
+        printf("%.*s", (int)request->head_len, request->buf);
+    }
+
+    trace_record(job->trace_id, TRACE_PARSED, request->head_len);
+    if (parsed == SERVER_PARSE_ERROR) {
         return SERVER_ERROR;
     }
 
-    rsp_count++;
+    return request->keep_alive? SERVER_CLIENT_KEEPALIVE: SERVER_CLIENT_CLOSE_REQ;
+}
+
+
+void server_http_response_init(struct server_http_response * response)
+{
+    response->count = 0;
+    response->iovcnt = 0;
+    response->used = 0;
+}
+
+// write out the gathered responses in one go
+server_state_e server_http_response_flush(struct jobnode * job, struct server_http_response * response)
+{
+    if (response->count == 0) {
+        return SERVER_OK;
+    }
+
+    ssize_t write_len = job_send(job, response->iov, response->iovcnt);
+    server_http_response_init(response);
+    trace_record(job->trace_id, TRACE_FLUSHED, (write_len > 0)? (uint64_t)write_len: 0);
+
+    return (write_len == -1)? SERVER_ERROR: SERVER_OK;
+}
+
+// queue the response to request, flushing first when the batch is full
+server_state_e server_http_process_response(struct jobnode * job, const struct server_http_request * request,
+                                            struct server_http_response * response)
+{
+    if (response->count == SERVER_HTTP_PIPELINE_MAX) {
+        if (server_http_response_flush(job, response) != SERVER_OK) {
+            return SERVER_ERROR;
+        }
+    }
+
+    metrics_add(METRIC_REQUESTS, 1);
+    if (request->status != 0) {
+        metrics_add(METRIC_BAD_REQUESTS, 1);
+        server_http_respond(response, (request->status == 431)? &server_template_too_large: &server_template_bad_request,
+                            NULL, 0, false);
+        return SERVER_OK;
+    }
+
+    if (server_stats_match(request)) {
+        return server_stats_respond(job, request, response);
+    }
 
     //busy_wait(0xfff);
     if (SERVER_BLOCK) {
         // TODO: blocking call        
     }
 
-    resp_len = snprintf(resp_str, sizeof(resp_str), default_request_response, rsp_count);
-    write_len = writen(connector_fd, resp_str, resp_len);
-    if (write_len == -1) {
-        return SERVER_ERROR;
+    if (server_static_root != -1) {
+        return server_static_respond(job, request, response);
     }
 
-    return SERVER_OK; // TODO: Return proper code 
+    server_http_respond(response, &server_template_ok, default_body, sizeof(default_body) - 1, request->keep_alive);
+
+    return SERVER_OK;
 }
 
 #if 0
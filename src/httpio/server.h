@@ -1,6 +1,16 @@
 #ifndef C10M_SERVER__HTTP_H_
 #define C10M_SERVER__HTTP_H_
 
+// == includes ==
+
+// system
+#include <sys/uio.h>
+// freestanding
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
 #ifdef __cplusplus
 namespace c10m_server {
 #endif
@@ -13,21 +23,97 @@ typedef enum server_state_enum {
     SERVER_OK = 0,
     SERVER_CLIENT_KEEPALIVE = 1,
     SERVER_CLIENT_CLOSED,
-    SERVER_CLIENT_CLOSE_REQ
+    SERVER_CLIENT_CLOSE_REQ,
+    SERVER_CLIENT_IDLE          // nothing to read yet, only when not asked to wait
 } server_state_e;
 
+#define SERVER_HTTP_HEAD_MAX 32768     // request line and headers, at most 64KiB and the largest buffer
+#define SERVER_HTTP_MAX_HEADERS 32
+#define SERVER_HTTP_PIPELINE_MAX 16    // responses gathered into one writev
+#define SERVER_HTTP_RESPONSE_IOV 5     // status and static headers, Date, framing, connection, body
+#define SERVER_HTTP_FRAMING_MAX 64     // Content-Length and Connection of one response
+
+typedef enum server_parse_enum {
+    SERVER_PARSE_ERROR = -1,
+    SERVER_PARSE_DONE = 0,
+    SERVER_PARSE_AGAIN
+} server_parse_e;
+
 // aggregate types
+
+// zero-copy, offsets into server_http_request.buf, which moves when it grows
+struct server_http_span {
+    uint16_t off;
+    uint16_t len;
+};
+
+struct server_http_header {
+    struct server_http_span name;
+    struct server_http_span value;
+};
+
+// DEVNOTE: The parser is resumable, each call continues from parse_pos with whatever
+//          was appended to buf since, so no byte is scanned twice. The buffer comes
+//          from the bufpool once there is something to read and goes back as soon as
+//          it is empty, so an idle connection holds none.
 struct server_http_request {
-    int dummy;
+    struct server_http_span method;
+    struct server_http_span path;
+    struct server_http_span version;
+    int minor_version;
+    int keep_alive;
+    int status;                 // 0, or the error status to answer with
+    int header_count;
+    struct server_http_header headers[SERVER_HTTP_MAX_HEADERS];
+    // parser
+    int parse_state;
+    size_t parse_pos;
+    size_t parse_mark;          // start of the token being parsed
+    size_t head_len;            // request head including the blank line, once parsed
+    size_t body_len;            // Content-Length, the body is read and dropped
+    size_t body_left;           // body bytes still to drop before the next request
+    size_t len;                 // bytes received into buf
+    size_t cap;                 // of buf
+    char * buf;                 // iobuf's data, NULL without one
+    struct iobuf * iobuf;
 };
 
+// DEVNOTE: Responses to pipelined requests are gathered here and go out in one writev
+//          once the pipeline is drained or the batch is full. Only the framing headers
+//          are written per response, everything else points at shared fragments.
+struct server_http_response {
+    int count;                  // responses
+    int iovcnt;
+    size_t used;                // of buf
+    struct iovec iov[SERVER_HTTP_PIPELINE_MAX * SERVER_HTTP_RESPONSE_IOV];
+    char buf[SERVER_HTTP_PIPELINE_MAX * SERVER_HTTP_FRAMING_MAX];
+};
+
+struct jobnode;
+struct iobuf;
+
 // inlines
 
 // prototypes      
 
-server_state_e server_http_process_request(int connector_fd, struct server_http_request *request);
+int server_http_static_init(const char * root);
+
+void server_http_request_init(struct server_http_request * request);
+
+void server_http_request_release(struct server_http_request * request);
+
+server_parse_e server_http_parse(struct server_http_request * request);
+
+void server_http_request_next(struct server_http_request * request);
+
+void server_http_response_init(struct server_http_response * response);
+
+server_state_e server_http_response_flush(struct jobnode * job, struct server_http_response * response);
+
+server_state_e server_http_process_request(struct jobnode * job, struct server_http_request *request, bool wait);
 
-server_state_e server_http_process_response(int connector_fd, const struct server_http_request *request);
+server_state_e server_http_process_response(struct jobnode * job, const struct server_http_request *request,
+                                            struct server_http_response * response);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,131 @@
+// Timer
+// ===========================================================================
+
+#include "timer.h"
+
+// cstd
+#include <string.h>
+
+
+void timer_wheel_init(struct timer_wheel * wheel, uint64_t now)
+{
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->now = now;
+}
+
+// node fires once advance reaches expire, right on the next advance when that is past
+void timer_wheel_add(struct timer_wheel * wheel, struct timer_node * node, uint64_t expire)
+{
+    uint64_t max = ((uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+
+    expire = (expire < wheel->now)? wheel->now: expire;
+    expire = (expire - wheel->now > max)? wheel->now + max: expire;
+
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && expire - wheel->now >= (uint64_t)1 << (TIMER_WHEEL_BITS * (level + 1))) {
+        level += 1;
+    }
+    uint32_t idx = (uint32_t)(expire >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+
+    struct timer_node ** head = &wheel->slots[level][idx];
+    node->expire = expire;
+    node->slot = (uint32_t)level * TIMER_WHEEL_SLOTS + idx;
+    node->next = *head;
+    node->pprev = head;
+    if (NULL != *head) {
+        (*head)->pprev = &node->next;
+    }
+    *head = node;
+    wheel->occupied[level] |= (uint64_t)1 << idx;
+    wheel->count += 1;
+}
+
+// nothing for a node not in the wheel
+void timer_wheel_del(struct timer_wheel * wheel, struct timer_node * node)
+{
+    if (NULL == node->pprev) {
+        return;
+    }
+
+    *node->pprev = node->next;
+    if (NULL != node->next) {
+        node->next->pprev = node->pprev;
+    }
+    node->pprev = NULL;
+    node->next = NULL;
+
+    uint32_t level = node->slot / TIMER_WHEEL_SLOTS;
+    uint32_t idx = node->slot % TIMER_WHEEL_SLOTS;
+    if (NULL == wheel->slots[level][idx]) {
+        wheel->occupied[level] &= ~((uint64_t)1 << idx);
+    }
+    wheel->count -= 1;
+}
+
+// take the slot's nodes out of the wheel, linked through next
+static struct timer_node * timer_wheel_take(struct timer_wheel * wheel, int level, uint32_t idx)
+{
+    struct timer_node * list = wheel->slots[level][idx];
+
+    wheel->slots[level][idx] = NULL;
+    wheel->occupied[level] &= ~((uint64_t)1 << idx);
+    for (struct timer_node * node = list; NULL != node; node = node->next) {
+        node->pprev = NULL;
+        wheel->count -= 1;
+    }
+
+    return list;
+}
+
+// run the ticks up to and including now, the nodes which expired linked through next
+// DEVNOTE: The nodes are out of the wheel, the caller may add them again while walking
+//          the list as long as it reads next first.
+struct timer_node * timer_wheel_advance(struct timer_wheel * wheel, uint64_t now)
+{
+    struct timer_node * expired = NULL;
+    struct timer_node ** tail = &expired;
+
+    while (wheel->now <= now) {
+        if (wheel->count == 0) {
+            wheel->now = now + 1;   // nothing to cascade or fire on the way
+            break;
+        }
+
+        // a level wrapped, bring the next slot of the one above down
+        uint32_t idx = (uint32_t)wheel->now & TIMER_WHEEL_MASK;
+        for (int level = 1; idx == 0 && level < TIMER_WHEEL_LEVELS; level++) {
+            idx = (uint32_t)(wheel->now >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+            struct timer_node * node = timer_wheel_take(wheel, level, idx);
+            while (NULL != node) {
+                struct timer_node * next = node->next;
+                timer_wheel_add(wheel, node, node->expire);
+                node = next;
+            }
+        }
+
+        struct timer_node * list = timer_wheel_take(wheel, 0, (uint32_t)wheel->now & TIMER_WHEEL_MASK);
+        *tail = list;
+        while (NULL != *tail) {
+            tail = &(*tail)->next;
+        }
+        wheel->now += 1;
+    }
+
+    return expired;
+}
+
+// the tick by which advance has a timer to fire or a level to cascade, TIMER_NONE when empty
+uint64_t timer_wheel_next(const struct timer_wheel * wheel)
+{
+    if (wheel->count == 0) {
+        return TIMER_NONE;
+    }
+
+    uint32_t idx = (uint32_t)wheel->now & TIMER_WHEEL_MASK;
+    uint64_t ahead = wheel->occupied[0] >> idx;
+    if (ahead != 0) {
+        return wheel->now + (uint64_t)__builtin_ctzll(ahead);
+    }
+
+    return (wheel->now | TIMER_WHEEL_MASK) + 1;
+}
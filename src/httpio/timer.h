@@ -0,0 +1,73 @@
+#ifndef C10M_TIMER__TIMER_H_
+#define C10M_TIMER__TIMER_H_
+
+// == includes ==
+
+// freestanding
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+namespace c10m_timer {
+#endif
+
+
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS 4        // 2^24 ticks ahead, later timers fire early at the far end
+#define TIMER_NONE UINT64_MAX
+
+
+
+// aggregate types
+
+// DEVNOTE: Intrusive, embedded in whatever it times. pprev points at the link that points
+//          at the node, so it leaves its slot without knowing the head.
+struct timer_node {
+    struct timer_node * next;
+    struct timer_node ** pprev;     // NULL while not in a wheel
+    uint64_t expire;                // tick
+    uint32_t slot;                  // level * TIMER_WHEEL_SLOTS + index
+};
+
+// DEVNOTE: Hierarchical timing wheel, every level has TIMER_WHEEL_SLOTS slots each
+//          covering TIMER_WHEEL_SLOTS times the ticks of a slot below. Adding and removing
+//          are O(1). A timer sits in the lowest level that reaches its tick and moves down
+//          a level whenever the level below wraps, at most TIMER_WHEEL_LEVELS - 1 times.
+//          Not thread-safe, a wheel belongs to one thread.
+struct timer_wheel {
+    uint64_t now;                   // next tick to run, all before it have fired
+    size_t count;
+    uint64_t occupied[TIMER_WHEEL_LEVELS];  // a bit per non-empty slot
+    struct timer_node * slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// protoypes
+
+void timer_wheel_init(struct timer_wheel * wheel, uint64_t now);
+
+void timer_wheel_add(struct timer_wheel * wheel, struct timer_node * node, uint64_t expire);
+
+void timer_wheel_del(struct timer_wheel * wheel, struct timer_node * node);
+
+struct timer_node * timer_wheel_advance(struct timer_wheel * wheel, uint64_t now);
+
+uint64_t timer_wheel_next(const struct timer_wheel * wheel);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif // namespace
+
+#endif // C10M_TIMER__TIMER_H_
@@ -0,0 +1,338 @@
+// Topology
+// ===========================================================================
+
+#define _GNU_SOURCE // needed for sched.h
+#include "topology.h"
+
+// cstd
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+// system
+#include <dirent.h>
+#include <sched.h>
+
+
+// where the cpu and node directories are
+#ifndef TOPOLOGY_SYSFS_ROOT
+#define TOPOLOGY_SYSFS_ROOT "/sys/devices/system"
+#endif
+
+
+struct topology_cpu {
+    int cpu;
+    int node;
+    int package;
+    int core_id;        // unique within its package only
+    int core;           // index of its physical core, over all packages
+    int thread;         // index among the SMT siblings of its core
+};
+
+// DEVNOTE: Sorted by node, package and core, so the siblings of a core are next to each
+//          other and a node's cores are contiguous. Empty while pinning is off.
+static struct topology_cpu topology_cpus[CPU_SETSIZE];
+static int topology_count = 0;
+static int topology_cores = 0;
+static int topology_nodes[CPU_SETSIZE];     // distinct nodes in order
+static int topology_node_count = 0;
+static bool topology_reserved[CPU_SETSIZE]; // per core, a reactor runs on one of its threads
+static int topology_reactors = 0;
+static int topology_workers[CPU_SETSIZE];   // per node, workers placed so far
+static int topology_spill = 0;              // workers placed off their reactor's node
+
+
+// "0-3,8,10-11" as in sysfs and taskset, -1 when malformed
+static int topology_parse_list(const char * text, cpu_set_t * set)
+{
+    const char * p = text;
+
+    CPU_ZERO(set);
+    while (*p != '\0' && *p != '\n') {
+        char * end = NULL;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p) {
+            return -1;
+        }
+        p = end;
+        if (*p == '-') {
+            p += 1;
+            last = strtol(p, &end, 10);
+            if (end == p) {
+                return -1;
+            }
+            p = end;
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE) {
+            return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            CPU_SET((size_t)cpu, set);
+        }
+        if (*p == ',') {
+            p += 1;
+        } else if (*p != '\0' && *p != '\n') {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int topology_read_int(int cpu, const char * name, int fallback)
+{
+    char path[256];
+    int value = fallback;
+
+    snprintf(path, sizeof(path), TOPOLOGY_SYSFS_ROOT "/cpu/cpu%d/topology/%s", cpu, name);
+    FILE * f = fopen(path, "r");
+    if (NULL == f) {
+        return fallback;
+    }
+    if (fscanf(f, "%d", &value) != 1) {
+        value = fallback;
+    }
+    fclose(f);
+
+    return value;
+}
+
+// the node of every cpu from the node directories, all on node 0 without them
+static void topology_read_nodes(int * nodes)
+{
+    char path[512];
+    char list[4096];
+    cpu_set_t set;
+    int node;
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        nodes[cpu] = 0;
+    }
+
+    DIR * dir = opendir(TOPOLOGY_SYSFS_ROOT "/node");
+    if (NULL == dir) {
+        return;
+    }
+    struct dirent * entry;
+    while (NULL != (entry = readdir(dir))) {
+        if (sscanf(entry->d_name, "node%d", &node) != 1) {
+            continue;
+        }
+        snprintf(path, sizeof(path), TOPOLOGY_SYSFS_ROOT "/node/%s/cpulist", entry->d_name);
+        FILE * f = fopen(path, "r");
+        if (NULL == f) {
+            continue;
+        }
+        if (NULL != fgets(list, sizeof(list), f) && topology_parse_list(list, &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                nodes[cpu] = CPU_ISSET((size_t)cpu, &set)? node: nodes[cpu];
+            }
+        }
+        fclose(f);
+    }
+    closedir(dir);
+}
+
+static int topology_compare(const void * a, const void * b)
+{
+    const struct topology_cpu * x = a;
+    const struct topology_cpu * y = b;
+
+    if (x->node != y->node) {
+        return (x->node < y->node)? -1: 1;
+    }
+    if (x->package != y->package) {
+        return (x->package < y->package)? -1: 1;
+    }
+    if (x->core_id != y->core_id) {
+        return (x->core_id < y->core_id)? -1: 1;
+    }
+    return (x->cpu < y->cpu)? -1: (x->cpu > y->cpu);
+}
+
+// pin threads to the cpus in the list, or all the process may use, leave them be for NULL
+// DEVNOTE: The list only narrows down the cpus, the placement still goes by topology.
+//          Cpus outside the process's affinity mask, from taskset or a cgroup, are an error.
+int topology_init(const char * cpus)
+{
+    cpu_set_t allowed;
+    cpu_set_t wanted;
+    static int nodes[CPU_SETSIZE];
+
+    if (NULL == cpus || cpus[0] == '\0') {
+        return 0;
+    }
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+        perror("topology: getaffinity");
+        return -1;
+    }
+    if (strcmp(cpus, TOPOLOGY_CPUS_ALL) == 0) {
+        wanted = allowed;
+    } else if (topology_parse_list(cpus, &wanted) == -1) {
+        fprintf(stderr, "topology: invalid cpu list '%s'\n", cpus);
+        return -1;
+    }
+
+    topology_read_nodes(nodes);
+    topology_count = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET((size_t)cpu, &wanted)) {
+            continue;
+        }
+        if (!CPU_ISSET((size_t)cpu, &allowed)) {
+            fprintf(stderr, "topology: cpu %d is not available to the process\n", cpu);
+            return -1;
+        }
+        struct topology_cpu * c = &topology_cpus[topology_count++];
+        c->cpu = cpu;
+        c->node = nodes[cpu];
+        c->package = topology_read_int(cpu, "physical_package_id", 0);
+        c->core_id = topology_read_int(cpu, "core_id", cpu);
+    }
+    if (topology_count == 0) {
+        fprintf(stderr, "topology: no cpus in '%s'\n", cpus);
+        return -1;
+    }
+    qsort(topology_cpus, (size_t)topology_count, sizeof(topology_cpus[0]), topology_compare);
+
+    topology_cores = 0;
+    topology_node_count = 0;
+    for (int i = 0; i < topology_count; i++) {
+        struct topology_cpu * c = &topology_cpus[i];
+        const struct topology_cpu * prev = (i > 0)? &topology_cpus[i - 1]: NULL;
+        bool sibling = NULL != prev && prev->node == c->node && prev->package == c->package &&
+                       prev->core_id == c->core_id;
+        c->core = sibling? prev->core: topology_cores++;
+        c->thread = sibling? prev->thread + 1: 0;
+        if (NULL == prev || prev->node != c->node) {
+            topology_nodes[topology_node_count++] = c->node;
+        }
+    }
+
+    printf("topology: pinning to %d cpus, %d cores, %d nodes\n", topology_count, topology_cores, topology_node_count);
+
+    return 0;
+}
+
+// the cpu for the next reactor, -1 when pinning is off
+// DEVNOTE: Reactors go round the nodes and take a physical core each, the SMT siblings
+//          of that core stay idle so nothing competes with the ioloop for the core.
+//          With more reactors than cores they share.
+int topology_reactor_next(void)
+{
+    if (topology_count == 0) {
+        return -1;
+    }
+
+    int node = topology_nodes[topology_reactors % topology_node_count];
+    topology_reactors += 1;
+
+    // on its node first, on any node when that one is taken
+    for (int any = 0; any < 2; any++) {
+        for (int i = 0; i < topology_count; i++) {
+            struct topology_cpu * c = &topology_cpus[i];
+            if (c->thread == 0 && !topology_reserved[c->core] && (any || c->node == node)) {
+                topology_reserved[c->core] = true;
+                printf("topology: reactor on cpu %d, core %d, node %d\n", c->cpu, c->core, c->node);
+                return c->cpu;
+            }
+        }
+    }
+
+    const struct topology_cpu * c = &topology_cpus[(topology_reactors - 1) % topology_count];
+    printf("topology: reactor on cpu %d, shared\n", c->cpu);
+
+    return c->cpu;
+}
+
+// the k-th cpu for workers on node, or on any node for -1, every core's first thread
+// before any second one, -1 when there is none
+static int topology_worker_pick(int node, int k)
+{
+    int picks[CPU_SETSIZE];
+    int count = 0;
+    int threads = 1;
+
+    for (int thread = 0; thread < threads; thread++) {
+        for (int i = 0; i < topology_count; i++) {
+            const struct topology_cpu * c = &topology_cpus[i];
+            threads = (c->thread >= threads)? c->thread + 1: threads;
+            if (c->thread == thread && !topology_reserved[c->core] && (node == -1 || c->node == node)) {
+                picks[count++] = c->cpu;
+            }
+        }
+    }
+
+    return (count > 0)? picks[k % count]: -1;
+}
+
+// the cpu for the next worker of the reactor on reactor_cpu, -1 to leave it unpinned
+// DEVNOTE: Workers stay on their reactor's node, off every core a reactor runs on, and
+//          only double up on SMT siblings once each core has one. A node without such
+//          cores spills its workers over the other nodes.
+int topology_worker_next(int reactor_cpu)
+{
+    int node = -1;
+
+    if (topology_count == 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < topology_count; i++) {
+        node = (topology_cpus[i].cpu == reactor_cpu)? topology_cpus[i].node: node;
+    }
+
+    int cpu = (node != -1)? topology_worker_pick(node, topology_workers[node]++): -1;
+    if (cpu == -1) {
+        cpu = topology_worker_pick(-1, topology_spill++);
+    }
+    if (cpu == -1) {
+        printf("topology: worker unpinned, the reactors take every core\n");
+    } else {
+        printf("topology: worker on cpu %d\n", cpu);
+    }
+
+    return cpu;
+}
+
+// threads created with attr run on cpu, nothing for -1
+int topology_attr_set(pthread_attr_t * attr, int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0) {
+        return 0;
+    }
+
+    CPU_ZERO(&set);
+    CPU_SET((size_t)cpu, &set);
+    int ret = pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+    if (ret != 0) {
+        fprintf(stderr, "topology: attr-affinity:: %s\n", strerror(ret));
+        return -1;
+    }
+
+    return 0;
+}
+
+// the calling thread runs on cpu from here on, nothing for -1
+int topology_pin_self(int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0) {
+        return 0;
+    }
+
+    CPU_ZERO(&set);
+    CPU_SET((size_t)cpu, &set);
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) {
+        fprintf(stderr, "topology: affinity:: %s\n", strerror(ret));
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef C10M_TOPOLOGY__TOPOLOGY_H_
+#define C10M_TOPOLOGY__TOPOLOGY_H_
+
+// == includes ==
+
+// system
+#include <pthread.h>
+
+
+#ifdef __cplusplus
+namespace c10m_topology {
+#endif
+
+
+#define TOPOLOGY_CPUS_ALL "all"     // every CPU the process may run on
+
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// protoypes
+
+int topology_init(const char * cpus);
+
+int topology_reactor_next(void);
+
+int topology_worker_next(int reactor_cpu);
+
+int topology_attr_set(pthread_attr_t * attr, int cpu);
+
+int topology_pin_self(int cpu);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif // namespace
+
+#endif // C10M_TOPOLOGY__TOPOLOGY_H_
@@ -0,0 +1,258 @@
+// Trace
+// ===========================================================================
+
+#include "trace.h"
+
+// cstd
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+// system
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// a record as copied out of a ring
+struct trace_copy {
+    uint64_t ticks;
+    uint64_t word;
+};
+
+static const char * trace_path = NULL;     // NULL when tracing is off
+static unsigned int trace_every = 0;        // one in this many connections is sampled
+static uint64_t trace_ticks0 = 0;           // trace_ticks() at init
+static uint64_t trace_ns0 = 0;              // CLOCK_MONOTONIC at init
+static _Atomic uint32_t trace_next_id = 0;
+static struct trace_ring * _Atomic trace_rings[TRACE_THREADS_MAX];
+static _Atomic uint32_t trace_ring_next = 0;
+
+static _Thread_local struct trace_ring * trace_self = NULL;
+static _Thread_local bool trace_untraced = false;
+
+
+static uint64_t trace_now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// tracing to the file at path for one in sample connections, off when either is unset
+int trace_init(const char * path, unsigned int sample)
+{
+    if (NULL == path || path[0] == '\0' || sample == 0) {
+        return 0;
+    }
+
+    trace_every = sample;
+    trace_ns0 = trace_now_ns();
+    trace_ticks0 = trace_ticks();
+    trace_path = path;
+
+    return 0;
+}
+
+// the id of a newly accepted connection, 0 unless it is sampled
+// DEVNOTE: Each reactor counts its own connections, so only the sampled ones touch the
+//          shared id counter.
+uint32_t trace_sample(void)
+{
+    static _Thread_local unsigned int countdown = 0;
+
+    if (NULL == trace_path) {
+        return 0;
+    }
+    if (countdown > 0) {
+        countdown -= 1;
+        return 0;
+    }
+    countdown = trace_every - 1;
+
+    uint32_t id = atomic_fetch_add_explicit(&trace_next_id, 1, memory_order_relaxed) + 1;
+
+    return (id != 0)? id: atomic_fetch_add_explicit(&trace_next_id, 1, memory_order_relaxed) + 1;
+}
+
+// the calling thread's ring, set up on its first record
+static struct trace_ring * trace_ring_new(void)
+{
+    static atomic_bool warned = false;
+
+    if (trace_untraced) {
+        return NULL;
+    }
+
+    uint32_t idx = atomic_fetch_add_explicit(&trace_ring_next, 1, memory_order_relaxed);
+    struct trace_ring * ring = (idx < TRACE_THREADS_MAX)? aligned_alloc(_Alignof(struct trace_ring), sizeof(*ring)): NULL;
+    if (NULL == ring) {
+        if (!atomic_exchange(&warned, true)) {
+            fprintf(stderr, "trace: no ring for thread %u, it goes untraced\n", idx);
+        }
+        trace_untraced = true;
+        return NULL;
+    }
+
+    atomic_init(&ring->head, 0);
+    ring->tid = (int)syscall(SYS_gettid);
+    atomic_store_explicit(&trace_rings[idx], ring, memory_order_release);
+    trace_self = ring;
+
+    return ring;
+}
+
+void trace_write(uint32_t id, trace_event_e event, uint64_t arg)
+{
+    struct trace_ring * ring = trace_self;
+
+    if (NULL == ring) {
+        ring = trace_ring_new();
+        if (NULL == ring) {
+            return;
+        }
+    }
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    struct trace_record * record = &ring->records[head & (TRACE_RING_SIZE - 1)];
+    arg = (arg < TRACE_ARG_MAX)? arg: TRACE_ARG_MAX;
+
+    // a reader seeing the new contents of the record also sees head as it is now
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&record->ticks, trace_ticks(), memory_order_relaxed);
+    atomic_store_explicit(&record->word, ((uint64_t)id << 32) | ((uint64_t)event << 24) | arg, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// copy out what ring holds, sets from to the first of the count copies which are whole
+// DEVNOTE: While head is h the writer may be overwriting record h - TRACE_RING_SIZE, so
+//          every record copied from before h - TRACE_RING_SIZE + 1 of the head read after
+//          the copy is dropped.
+static size_t trace_ring_copy(const struct trace_ring * ring, struct trace_copy * out, size_t * from)
+{
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t first = (head > TRACE_RING_SIZE)? head - TRACE_RING_SIZE: 0;
+
+    for (uint64_t i = first; i < head; i++) {
+        const struct trace_record * record = &ring->records[i & (TRACE_RING_SIZE - 1)];
+        out[i - first].ticks = atomic_load_explicit(&record->ticks, memory_order_relaxed);
+        out[i - first].word = atomic_load_explicit(&record->word, memory_order_relaxed);
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t now = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint64_t valid = (now + 1 > TRACE_RING_SIZE)? now + 1 - TRACE_RING_SIZE: 0;
+    *from = (valid > first)? (size_t)(valid - first): 0;
+
+    return (size_t)(head - first);
+}
+
+static void trace_emit(FILE * f, bool * first, const char * name, const char * cat, char ph, uint32_t id,
+                       int tid, double ts, const char * arg_name, uint64_t arg)
+{
+    fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"id\":%u,\"pid\":%d,\"tid\":%d,\"ts\":%.3f",
+            (*first)? "": ",\n", name, cat, ph, id, (int)getpid(), tid, ts);
+    if (NULL != arg_name) {
+        fprintf(f, ",\"args\":{\"%s\":%llu}", arg_name, (unsigned long long)arg);
+    }
+    fprintf(f, "}");
+    *first = false;
+}
+
+// DEVNOTE: Every connection is an async track of its own, keyed by its id. The
+//          connection, queued and run spans each get a category, so they don't have
+//          to nest where a job is shed or the ring dropped one end.
+static void trace_emit_record(FILE * f, bool * first, int tid, double ts, uint64_t word)
+{
+    uint32_t id = (uint32_t)(word >> 32);
+    trace_event_e event = (trace_event_e)((word >> 24) & 0xff);
+    uint64_t arg = word & TRACE_ARG_MAX;
+
+    switch (event) {
+        case TRACE_ACCEPT:
+            trace_emit(f, first, "connection", "conn", 'b', id, tid, ts, "fd", arg);
+            break;
+        case TRACE_QUEUED:
+            trace_emit(f, first, "queued", "queue", 'b', id, tid, ts, NULL, 0);
+            break;
+        case TRACE_DEQUEUED:
+            trace_emit(f, first, "queued", "queue", 'e', id, tid, ts, NULL, 0);
+            trace_emit(f, first, "run", "run", 'b', id, tid, ts, NULL, 0);
+            break;
+        case TRACE_PARSED:
+            trace_emit(f, first, "parsed", "conn", 'n', id, tid, ts, "head_bytes", arg);
+            break;
+        case TRACE_FLUSHED:
+            trace_emit(f, first, "flushed", "conn", 'n', id, tid, ts, "bytes", arg);
+            break;
+        case TRACE_RETURNED:
+            trace_emit(f, first, "run", "run", 'e', id, tid, ts, "suspended", arg);
+            break;
+        case TRACE_DONE:
+            trace_emit(f, first, "connection", "conn", 'e', id, tid, ts, NULL, 0);
+            break;
+        default:
+            break;
+    }
+}
+
+// write every ring out as a Chrome trace, -1 when the file could not be written
+// DEVNOTE: Runs on a reactor and stalls it for the dump. The file is written next to
+//          path and renamed over it, a viewer never loads half a trace.
+int trace_dump(void)
+{
+    static atomic_flag dumping = ATOMIC_FLAG_INIT;
+    char tmp_path[4096];
+    bool first = true;
+    int ret = 0;
+
+    if (NULL == trace_path) {
+        return 0;
+    }
+    if (atomic_flag_test_and_set(&dumping)) {
+        return 0;       // another reactor is at it
+    }
+
+    struct trace_copy * copy = malloc(sizeof(struct trace_copy) * TRACE_RING_SIZE);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", trace_path);
+    FILE * f = (NULL != copy)? fopen(tmp_path, "w"): NULL;
+    if (NULL == f) {
+        perror("trace: dump");
+        free(copy);
+        atomic_flag_clear(&dumping);
+        return -1;
+    }
+
+    // the ticks rate over everything since init
+    uint64_t ticks = trace_ticks();
+    uint64_t ns = trace_now_ns();
+    double ns_per_tick = (ticks > trace_ticks0)? (double)(ns - trace_ns0) / (double)(ticks - trace_ticks0): 1.0;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    uint32_t count = atomic_load_explicit(&trace_ring_next, memory_order_relaxed);
+    count = (count < TRACE_THREADS_MAX)? count: TRACE_THREADS_MAX;
+    for (uint32_t r = 0; r < count; r++) {
+        const struct trace_ring * ring = atomic_load_explicit(&trace_rings[r], memory_order_acquire);
+        if (NULL == ring) {
+            continue;
+        }
+        size_t from = 0;
+        size_t n = trace_ring_copy(ring, copy, &from);
+        for (size_t i = from; i < n; i++) {
+            double ts = (double)(int64_t)(copy[i].ticks - trace_ticks0) * ns_per_tick / 1000.0;
+            trace_emit_record(f, &first, ring->tid, ts, copy[i].word);
+        }
+    }
+    fprintf(f, "\n]}\n");
+
+    if (fclose(f) != 0 || rename(tmp_path, trace_path) == -1) {
+        perror("trace: dump");
+        ret = -1;
+    }
+    free(copy);
+    atomic_flag_clear(&dumping);
+
+    return ret;
+}
@@ -0,0 +1,110 @@
+#ifndef C10M_TRACE__TRACE_H_
+#define C10M_TRACE__TRACE_H_
+
+// == includes ==
+
+// freestanding
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+// system
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+
+#ifdef __cplusplus
+namespace c10m_trace {
+#endif
+
+
+#define TRACE_RING_SIZE 16384       // records per thread, a power of 2, the oldest are overwritten
+#define TRACE_THREADS_MAX 256       // threads with a ring, later threads go untraced
+#define TRACE_ARG_MAX 0xffffffU     // args are cut to 24 bits
+
+typedef enum trace_event_enum {
+    TRACE_ACCEPT,       // reactor, arg the fd
+    TRACE_QUEUED,       // reactor, BLOCKED -> QUEUED
+    TRACE_DEQUEUED,     // worker, picked the job up
+    TRACE_PARSED,       // worker, a request head is complete, arg its length
+    TRACE_FLUSHED,      // worker, responses written, arg the bytes
+    TRACE_RETURNED,     // worker, the handler returned, arg 1 when it only suspended
+    TRACE_DONE,         // any, the connection is let go
+    TRACE_EVENTS
+} trace_event_e;
+
+
+
+// aggregate types
+
+// DEVNOTE: A record is two words so a reader racing the writer sees each one whole,
+//          the second packs the connection id, the event and its arg.
+struct trace_record {
+    _Atomic uint64_t ticks;
+    _Atomic uint64_t word;
+};
+
+// DEVNOTE: Single writer, any number of readers. head counts every record ever written,
+//          record i sits at i % TRACE_RING_SIZE. A reader copies the ring and then drops
+//          whatever the writer may have overwritten meanwhile, see trace_ring_copy.
+struct trace_ring {
+    _Alignas(64)
+    _Atomic uint64_t head;
+    int tid;                    // immutable
+    _Alignas(64)
+    struct trace_record records[TRACE_RING_SIZE];
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// prototypes
+
+void trace_write(uint32_t id, trace_event_e event, uint64_t arg);
+
+// inlines
+
+// raw ticks, turned into time only when dumping
+// DEVNOTE: The TSC is a few cycles and needs no vDSO call, it only works out across cores
+//          with an invariant TSC, which every x86 server of the last decade has.
+static inline uint64_t trace_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#endif
+}
+
+// record event for the connection id, nothing for connections which aren't sampled
+static inline void trace_record(uint32_t id, trace_event_e event, uint64_t arg)
+{
+    if (id != 0) {
+        trace_write(id, event, arg);
+    }
+}
+
+int trace_init(const char * path, unsigned int sample);
+
+uint32_t trace_sample(void);
+
+int trace_dump(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif // namespace
+
+#endif // C10M_TRACE__TRACE_H_
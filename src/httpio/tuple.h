@@ -11,10 +11,17 @@ struct TupleClass {
     char *service;
     int (*create)(int *server_coket, const char *node, const char* service);
     int (*delete)(int server_coket);
+    int (*steer)(const int *server_sockets, const int *cpus, int count); // NULL without a reuseport group
 };
 
 enum TupleClassType {
-    TUPLE_INET
+    TUPLE_INET,
+    TUPLE_INET_REUSEPORT
+};
+
+enum TupleSteerType {
+    TUPLE_STEER_HASH,   // the kernel hashes connections over the listeners
+    TUPLE_STEER_CPU     // to the listener whose reactor runs on the cpu of the connection's softirq
 };
 
 #ifdef __cplusplus
@@ -6,7 +6,9 @@
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
+#include <linux/filter.h>
 // libraries
 #include <stdio.h>
 #include <string.h>
@@ -42,7 +44,7 @@ char *tuple_sockaddr_str(struct sockaddr *sa, char* dst, size_t dst_size)
 }
 
 
-int tuple_inetsock_create(int *server_socket, const char *node, const char* service)
+static int tuple_inetsock_bind(int *server_socket, const char *node, const char* service, int reuseport)
 {
     int rc = -1;
     const int yes = 1;
@@ -51,6 +53,7 @@ int tuple_inetsock_create(int *server_socket, const char *node, const char* serv
 
     int server_sock = -1;
     struct addrinfo server_addr;
+    struct sockaddr_storage server_sockaddr;    // outlives result_list, bind comes after the free
     struct addrinfo server_addr_hints;
     struct addrinfo *result_list = NULL;
 
@@ -73,20 +76,22 @@ int tuple_inetsock_create(int *server_socket, const char *node, const char* serv
     }
 
     // tuple info filter - should be only one result based on the information passed
-    if (result_list != NULL) {
-        if (result_list->ai_next != NULL) {
-            freeaddrinfo(result_list);
-            fprintf(stderr, "server-create: addr-list:: More than one possible server address");
-            return -1;
-        } else {
-            memset(&server_addr, 0, sizeof(server_addr));
-            server_addr.ai_family = result_list->ai_family;
-            server_addr.ai_socktype = result_list->ai_socktype;
-            server_addr.ai_protocol = result_list->ai_protocol;
-            server_addr.ai_addr = result_list->ai_addr;
-            server_addr.ai_addrlen = result_list->ai_addrlen;
-            freeaddrinfo(result_list);
-        }
+    if (result_list == NULL) {
+        fprintf(stderr, "server-create: addr-list:: No possible server address\n");
+        return -1;
+    } else if (result_list->ai_next != NULL) {
+        freeaddrinfo(result_list);
+        fprintf(stderr, "server-create: addr-list:: More than one possible server address");
+        return -1;
+    } else {
+        memset(&server_addr, 0, sizeof(server_addr));
+        memcpy(&server_sockaddr, result_list->ai_addr, result_list->ai_addrlen);
+        server_addr.ai_family = result_list->ai_family;
+        server_addr.ai_socktype = result_list->ai_socktype;
+        server_addr.ai_protocol = result_list->ai_protocol;
+        server_addr.ai_addr = (struct sockaddr *)&server_sockaddr;
+        server_addr.ai_addrlen = result_list->ai_addrlen;
+        freeaddrinfo(result_list);
     }
 
     // tuple binding - `protocol` is binded to socket
@@ -104,6 +109,24 @@ int tuple_inetsock_create(int *server_socket, const char *node, const char* serv
         return -1;
     }
 
+    // accepted sockets inherit it, a response split over two writes must not wait on an ack
+    rc = setsockopt(server_sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(int));
+    if (rc == -1) {
+        close(server_sock);
+        perror("server-create: setsockopt: nodelay");
+        return -1;
+    }
+
+    // tuple binding - every shard binds its own socket, the kernel balances between them
+    if (reuseport) {
+        rc = setsockopt(server_sock, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int));
+        if (rc == -1) {
+            close(server_sock);
+            perror("server-create: setsockopt: reuseport");
+            return -1;
+        }
+    }
+
     // tuple binding - `dst_addr`, `dst_port` is binded socket
     rc = bind(server_sock, server_addr.ai_addr, server_addr.ai_addrlen);
     if (rc == -1) {
@@ -123,6 +146,62 @@ int tuple_inetsock_create(int *server_socket, const char *node, const char* serv
 }
 
 
+int tuple_inetsock_create(int *server_socket, const char *node, const char* service)
+{
+    return tuple_inetsock_bind(server_socket, node, service, 0);
+}
+
+
+int tuple_inetsock_reuseport_create(int *server_socket, const char *node, const char* service)
+{
+    return tuple_inetsock_bind(server_socket, node, service, 1);
+}
+
+
+// DEVNOTE: A reuseport group's listeners are indexed in the order they started listening,
+//          which is what the CBPF program returns. They are put in the group here, in the
+//          order of the shards, the ioloops' own listen only sets the backlog after that.
+//          The program maps the cpu a SYN is processed on to the listener of the reactor
+//          pinned to it, any other cpu returns past the last listener and the kernel falls
+//          back to its hash.
+int tuple_inetsock_reuseport_steer(const int *server_sockets, const int *cpus, int count)
+{
+    int rc = -1;
+    int len = 0;
+    struct sock_filter code[BPF_MAXINSNS];
+    struct sock_fprog prog;
+
+    for (int i = 0; i < count; i++) {
+        rc = listen(server_sockets[i], SOMAXCONN);
+        if (rc == -1) {
+            perror("server-steer: listen:");
+            return -1;
+        }
+    }
+
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (__u32)(SKF_AD_OFF + SKF_AD_CPU));
+    for (int i = 0; i < count && len < BPF_MAXINSNS - 3; i++) {
+        if (cpus[i] < 0) {
+            continue;
+        }
+        code[len++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (__u32)cpus[i], 0, 1);
+        code[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, (__u32)i);
+    }
+    code[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, (__u32)count);
+
+    prog.len = (unsigned short)len;
+    prog.filter = code;
+    rc = setsockopt(server_sockets[0], SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+    if (rc == -1) {
+        perror("server-steer: setsockopt: reuseport-cbpf");
+        return -1;
+    }
+    fprintf(stdout, "server-steer: %d listeners steered by cpu\n", count);
+
+    return 0;
+}
+
+
 int tuple_inetsock_delete(int server_socket)
 {
     return close(server_socket);
@@ -134,6 +213,11 @@ int tuple_class_get(enum TupleClassType type, struct TupleClass* tc)
     if (type == TUPLE_INET) {
         tc->create = tuple_inetsock_create;
         tc->delete = tuple_inetsock_delete;
+        tc->steer = NULL;
+    } else if (type == TUPLE_INET_REUSEPORT) {
+        tc->create = tuple_inetsock_reuseport_create;
+        tc->delete = tuple_inetsock_delete;
+        tc->steer = tuple_inetsock_reuseport_steer;
     } else {
         return -1;
     }
@@ -0,0 +1,753 @@
+#define _GNU_SOURCE // because of strcasestr
+// freestanding
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+// system
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+// libraries
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+// local
+#include "httpio/histogram.h"
+#include "httpio/poll.h"
+
+
+// DEVNOTE: Every thread drives its share of the connections through its own instance
+//          of one of the server's pollers, opened without a listener. Closed-loop keeps
+//          one request in flight per connection and sends the next one as soon as the
+//          response is complete. Open-loop sends at a constant rate on whichever
+//          connection is idle, requests due while all of them are busy wait in a queue,
+//          and latency counts from when a request was due, not from when it got a
+//          connection, so a stalled server can't hide its stall. Idle only connects and
+//          holds the connections open, for measuring what they cost the server. A
+//          connection the server closes or breaks counts as an error and is reopened,
+//          one that fails to open is retried every LOADGEN_RETRY_NS.
+#define LOADGEN_HEADERS_MAX 1024        // response headers, the body is only counted
+#define LOADGEN_DRAIN_MAX 16384
+#define LOADGEN_PENDING_MAX (1 << 20)   // open-loop requests waiting for a connection, per thread
+#define LOADGEN_TICK_OPEN_NS 100000     // how often the pollers are woken up to send
+#define LOADGEN_TICK_CLOSED_NS 10000000 // how often the pollers are woken up to see the end
+#define LOADGEN_RETRY_NS 100000000      // how often connections which failed to open are retried
+#define LOADGEN_SOURCE_CONNS 20000      // per loopback source address, below the ephemeral range
+#define LOADGEN_THREADS_MAX 1024
+
+enum loadgen_conn_state {
+    LOADGEN_CONNECTING,
+    LOADGEN_IDLE,
+    LOADGEN_SENDING,
+    LOADGEN_RECEIVING
+};
+
+struct loadgen_conn {
+    int fd;
+    uint8_t state;                      // loadgen_conn_state
+    uint8_t listed_idle;                // on the idle stack, maybe not idle anymore
+    uint16_t sent;
+    uint16_t received;                  // bytes of the response headers in buf
+    long body_left;                     // -1 until the headers are complete
+    uint64_t start_ns;                  // when the request in flight was due
+    struct loadgen_conn * next_idle;    // open-loop, idle stack
+    struct loadgen_conn * next_closed;  // failed to open, retry stack
+    char buf[LOADGEN_HEADERS_MAX];
+};
+
+struct loadgen_opts {
+    const char * host;
+    int port;
+    int conns;
+    int seconds;
+    const char * path;
+    bool csv;
+    int threads;
+    ioloop_type_e poller;
+    int sources;                        // loopback source addresses, 0 to let the kernel pick
+    double rate;                        // requests/s over all threads, 0 for closed-loop
+    const char * hist_path;
+    bool idle;                          // connect and send nothing
+};
+
+struct loadgen_thread {
+    pthread_t thread;
+    int id;
+    struct Poller poller_class;
+    void * poller_inst;
+    struct loadgen_conn * conns;
+    int conn_count;
+    int conn_first;                     // global index of conns[0], picks the source address
+    double rate;                        // requests/s of this thread, 0 for closed-loop
+    uint64_t next_due_ns;               // open-loop, next request to schedule
+    uint64_t * pending;                 // open-loop ring of due times
+    size_t pending_head;
+    size_t pending_count;
+    struct loadgen_conn * idle;         // open-loop, connections without a request
+    struct loadgen_conn * closed;       // connections to open again
+    uint64_t retry_ns;                  // when closed is tried next
+    uint64_t connected;
+    uint64_t requests;
+    uint64_t errors;
+    uint64_t dropped;                   // open-loop, due with the pending ring full
+    struct histogram hist;              // latency in ns
+};
+
+static volatile sig_atomic_t loadgen_run = 1;
+static uint64_t loadgen_end_ns = 0;
+
+static struct loadgen_opts loadgen_opts = {
+    "127.0.0.1", 8888, 64, 10, "/", false, 1, IOLOOP_EPOLL, 0, 0, NULL, false
+};
+static char loadgen_request[512];
+static size_t loadgen_request_len = 0;
+static struct sockaddr_in loadgen_addr;
+static struct loadgen_conn ** loadgen_fds = NULL;  // fd to its connection, over all threads
+static int loadgen_fds_max = 0;
+
+
+static void loadgen_sigint_handler(int signal)
+{
+    (void)signal;
+    loadgen_run = 0;
+}
+
+static uint64_t loadgen_now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * UINT64_C(1000000000) + (uint64_t)now.tv_nsec;
+}
+
+
+/******************************************************************************/
+/* connections */
+/******************************************************************************/
+
+// the idx-th connection's source, spread over 127.0.0.1 onwards
+static int loadgen_conn_bind(int fd, int idx)
+{
+    const int yes = 1;
+    struct sockaddr_in src;
+
+    if (loadgen_opts.sources <= 0) {
+        return 0;
+    }
+
+    // the port is picked at connect, so it only has to be unique per destination
+    setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &yes, sizeof(yes));
+
+    memset(&src, 0, sizeof(src));
+    src.sin_family = AF_INET;
+    src.sin_addr.s_addr = htonl(INADDR_LOOPBACK + (uint32_t)(idx % loadgen_opts.sources));
+    src.sin_port = 0;
+
+    return bind(fd, (struct sockaddr *)&src, sizeof(src));
+}
+
+static int loadgen_conn_open(struct loadgen_thread * lt, struct loadgen_conn * conn)
+{
+    const int yes = 1;
+
+    conn->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (conn->fd == -1) {
+        perror("loadgen: socket:");
+        return -1;
+    }
+    if (conn->fd >= loadgen_fds_max) {
+        fprintf(stderr, "loadgen: fd %d over RLIMIT_NOFILE\n", conn->fd);
+        goto FAIL;
+    }
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+    if (loadgen_conn_bind(conn->fd, lt->conn_first + (int)(conn - lt->conns)) == -1) {
+        perror("loadgen: bind:");
+        goto FAIL;
+    }
+    if (connect(conn->fd, (struct sockaddr *)&loadgen_addr, sizeof(loadgen_addr)) == -1 && errno != EINPROGRESS) {
+        perror("loadgen: connect:");
+        goto FAIL;
+    }
+    conn->state = LOADGEN_CONNECTING;
+    conn->sent = 0;
+    conn->received = 0;
+    conn->body_left = -1;
+
+    loadgen_fds[conn->fd] = conn;
+    if (lt->poller_class.addfd(lt->poller_inst, conn->fd) == -1 ||
+        lt->poller_class.rearmfd(lt->poller_inst, conn->fd, SOCK_WRITABLE) == -1) {
+        perror("loadgen: poller:");
+        loadgen_fds[conn->fd] = NULL;
+        goto FAIL;
+    }
+
+    return 0;
+
+FAIL:
+    close(conn->fd);
+    conn->fd = -1;
+    return -1;
+}
+
+static void loadgen_conn_close(struct loadgen_thread * lt, struct loadgen_conn * conn)
+{
+    if (conn->fd != -1) {
+        loadgen_fds[conn->fd] = NULL;
+        lt->poller_class.releasefd(lt->poller_inst, conn->fd);
+        close(conn->fd);
+        conn->fd = -1;
+    }
+}
+
+// open conn again, or leave it closed to be retried once the retry time comes
+static void loadgen_conn_reopen(struct loadgen_thread * lt, struct loadgen_conn * conn)
+{
+    loadgen_conn_close(lt, conn);
+    if (loadgen_conn_open(lt, conn) == -1) {
+        lt->errors += 1;
+        conn->next_closed = lt->closed;
+        lt->closed = conn;
+    }
+}
+
+// the response body length once the headers are in, -1 while they are not
+static long loadgen_body_length(struct loadgen_conn * conn)
+{
+    conn->buf[conn->received] = '\0';
+    char * end = strstr(conn->buf, "\r\n\r\n");
+    if (NULL == end) {
+        return -1;
+    }
+
+    long header_len = (long)(end - conn->buf) + 4;
+    long content_len = 0;
+    char * cl = strcasestr(conn->buf, "\r\nContent-Length:");
+    if (NULL != cl && cl < end) {
+        content_len = strtol(cl + 17, NULL, 10);
+    }
+
+    // the body already read is part of what arrived with the headers
+    return content_len - ((long)conn->received - header_len);
+}
+
+static void loadgen_conn_request(struct loadgen_conn * conn, uint64_t due_ns)
+{
+    conn->state = LOADGEN_SENDING;
+    conn->sent = 0;
+    conn->start_ns = due_ns;
+}
+
+// the next request for an idle connection, 0 when there is none yet
+static int loadgen_conn_next(struct loadgen_thread * lt, struct loadgen_conn * conn)
+{
+    if (loadgen_opts.idle) {
+        conn->state = LOADGEN_IDLE;
+        return 0;
+    }
+
+    if (lt->rate <= 0) {
+        loadgen_conn_request(conn, loadgen_now_ns());
+        return 1;
+    }
+
+    if (lt->pending_count > 0) {
+        loadgen_conn_request(conn, lt->pending[lt->pending_head]);
+        lt->pending_head = (lt->pending_head + 1) % LOADGEN_PENDING_MAX;
+        lt->pending_count -= 1;
+        return 1;
+    }
+
+    // a connection reopened while listed is still listed once
+    conn->state = LOADGEN_IDLE;
+    if (!conn->listed_idle) {
+        conn->listed_idle = 1;
+        conn->next_idle = lt->idle;
+        lt->idle = conn;
+    }
+
+    return 0;
+}
+
+// move conn along as far as the socket allows, -1 when it has to be reopened
+static int loadgen_conn_step(struct loadgen_thread * lt, struct loadgen_conn * conn)
+{
+    struct Poller * pc = &lt->poller_class;
+    char drain[LOADGEN_DRAIN_MAX];
+
+    while (1) {
+        if (conn->state == LOADGEN_CONNECTING) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 || err != 0) {
+                return -1;
+            }
+            lt->connected += 1;
+            if (!loadgen_conn_next(lt, conn)) {
+                // an idle connection still hears about the server closing it
+                return pc->rearmfd(lt->poller_inst, conn->fd, SOCK_READABLE);
+            }
+        } else if (conn->state == LOADGEN_IDLE) {
+            // nothing was asked, anything readable is the server going away
+            return -1;
+        } else if (conn->state == LOADGEN_SENDING) {
+            struct iovec iov = { loadgen_request + conn->sent, loadgen_request_len - conn->sent };
+            ssize_t rc = pc->sendfd(lt->poller_inst, conn->fd, &iov, 1, 0);
+            if (rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return pc->rearmfd(lt->poller_inst, conn->fd, SOCK_WRITABLE);
+            } else if (rc == -1) {
+                return -1;
+            }
+            conn->sent = (uint16_t)(conn->sent + rc);
+            if (conn->sent == loadgen_request_len) {
+                conn->state = LOADGEN_RECEIVING;
+                conn->received = 0;
+                conn->body_left = -1;
+            }
+        } else {
+            // the headers are kept to find the length, the body is only counted
+            char * dst = (conn->body_left >= 0)? drain: conn->buf + conn->received;
+            size_t n = (conn->body_left >= 0)? sizeof(drain): sizeof(conn->buf) - 1 - conn->received;
+            if (n == 0) {
+                return -1;      // headers larger than anything the server sends
+            }
+            ssize_t rc = pc->recvfd(lt->poller_inst, conn->fd, dst, n);
+            if (rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return pc->rearmfd(lt->poller_inst, conn->fd, SOCK_READABLE);
+            } else if (rc <= 0) {
+                return -1;
+            }
+            if (conn->body_left >= 0) {
+                conn->body_left -= rc;
+            } else {
+                conn->received = (uint16_t)(conn->received + rc);
+                conn->body_left = loadgen_body_length(conn);
+            }
+            if (conn->body_left < -1) {
+                return -1;      // more than the announced length, out of step with the server
+            } else if (conn->body_left == 0) {
+                lt->requests += 1;
+                histogram_record(&lt->hist, loadgen_now_ns() - conn->start_ns);
+                if (!loadgen_conn_next(lt, conn)) {
+                    return pc->rearmfd(lt->poller_inst, conn->fd, SOCK_READABLE);
+                }
+            }
+        }
+    }
+}
+
+
+/******************************************************************************/
+/* threads */
+/******************************************************************************/
+
+// queue the open-loop requests that came due, and start them on idle connections
+static void loadgen_thread_schedule(struct loadgen_thread * lt, uint64_t now_ns)
+{
+    double interval_ns = 1e9 / lt->rate;
+
+    while (lt->next_due_ns <= now_ns) {
+        if (lt->pending_count == LOADGEN_PENDING_MAX) {
+            lt->dropped += 1;
+        } else {
+            lt->pending[(lt->pending_head + lt->pending_count) % LOADGEN_PENDING_MAX] = lt->next_due_ns;
+            lt->pending_count += 1;
+        }
+        lt->next_due_ns += (uint64_t)interval_ns;
+    }
+
+    while (lt->pending_count > 0 && NULL != lt->idle) {
+        struct loadgen_conn * conn = lt->idle;
+        lt->idle = conn->next_idle;
+        conn->listed_idle = 0;
+        if (conn->fd == -1 || conn->state != LOADGEN_IDLE) {
+            continue;       // closed since it was listed, it lists itself again once idle
+        }
+        loadgen_conn_next(lt, conn);
+        if (loadgen_conn_step(lt, conn) == -1) {
+            lt->errors += 1;
+            loadgen_conn_reopen(lt, conn);
+        }
+    }
+}
+
+// open the connections which failed to open the last time
+static void loadgen_thread_retry(struct loadgen_thread * lt, uint64_t now_ns)
+{
+    struct loadgen_conn * conn = lt->closed;
+
+    lt->closed = NULL;
+    lt->retry_ns = now_ns + LOADGEN_RETRY_NS;
+    while (NULL != conn) {
+        struct loadgen_conn * next = conn->next_closed;
+        loadgen_conn_reopen(lt, conn);
+        conn = next;
+    }
+}
+
+static void * loadgen_thread_run(void * param)
+{
+    struct loadgen_thread * lt = param;
+    struct Poller * pc = &lt->poller_class;
+    sock_state_e state;
+
+    for (int i = 0; i < lt->conn_count; i++) {
+        lt->conns[i].fd = -1;
+        loadgen_conn_reopen(lt, &lt->conns[i]);
+    }
+    lt->next_due_ns = loadgen_now_ns();
+    lt->retry_ns = lt->next_due_ns + LOADGEN_RETRY_NS;
+
+    while (loadgen_run) {
+        if (pc->wait(lt->poller_inst, -1) == -1 && errno != EINTR) {
+            perror("loadgen: poller_wait:");
+            break;
+        }
+        uint64_t now_ns = loadgen_now_ns();
+        if (now_ns >= loadgen_end_ns) {
+            break;
+        }
+
+        pc->iterator_reset(lt->poller_inst);
+        int fd = pc->iterator_getfd(lt->poller_inst, &state);
+        while (fd >= 0) {
+            struct loadgen_conn * conn = (fd < loadgen_fds_max)? loadgen_fds[fd]: NULL;
+            if (NULL != conn && loadgen_conn_step(lt, conn) == -1) {
+                lt->errors += 1;
+                if (loadgen_run) {
+                    loadgen_conn_reopen(lt, conn);
+                } else {
+                    loadgen_conn_close(lt, conn);
+                }
+            }
+            fd = pc->iterator_getfd(lt->poller_inst, &state);
+        }
+
+        if (NULL != lt->closed && now_ns >= lt->retry_ns) {
+            loadgen_thread_retry(lt, now_ns);
+        }
+
+        if (lt->rate > 0) {
+            loadgen_thread_schedule(lt, now_ns);
+        }
+    }
+
+    for (int i = 0; i < lt->conn_count; i++) {
+        loadgen_conn_close(lt, &lt->conns[i]);
+    }
+
+    return NULL;
+}
+
+// DEVNOTE: The pollers only wake up for socket events, this bounds how late the
+//          open-loop schedule and the end of the run can be noticed.
+static void * loadgen_ticker_run(void * param)
+{
+    struct loadgen_thread * lts = param;
+    long tick_ns = (loadgen_opts.rate > 0)? LOADGEN_TICK_OPEN_NS: LOADGEN_TICK_CLOSED_NS;
+    struct timespec tick = { 0, tick_ns };
+
+    while (loadgen_run && loadgen_now_ns() < loadgen_end_ns) {
+        nanosleep(&tick, NULL);
+        for (int i = 0; i < loadgen_opts.threads; i++) {
+            lts[i].poller_class.notify(lts[i].poller_inst);
+        }
+    }
+    // one last round, a thread may have gone back to waiting just before the end
+    for (int i = 0; i < loadgen_opts.threads; i++) {
+        lts[i].poller_class.notify(lts[i].poller_inst);
+    }
+
+    return NULL;
+}
+
+
+/******************************************************************************/
+/* main */
+/******************************************************************************/
+
+static void loadgen_usage(FILE * out, const char * prog)
+{
+    fprintf(out,
+            "usage: %s [options]\n"
+            "  -H, --host ADDR          IPv4 address of the server, default 127.0.0.1\n"
+            "  -p, --port PORT          default 8888\n"
+            "  -c, --connections N      concurrent keep-alive connections, default 64\n"
+            "  -d, --duration SECONDS   default 10\n"
+            "  -P, --path PATH          request target, default /\n"
+            "  -t, --threads N          default 1\n"
+            "  -i, --poller NAME        select | epoll | uring, default epoll\n"
+            "  -s, --sources N          loopback source addresses from 127.0.0.1, default enough\n"
+            "                           for %d connections each, 0 lets the kernel pick\n"
+            "  -r, --rate N             open-loop requests/s over all connections, default closed-loop\n"
+            "  -o, --histogram FILE     write the latency distribution in HdrHistogram format\n"
+            "      --idle               only open the connections and hold them, no requests\n"
+            "      --csv                print one CSV row with a header instead of a summary\n",
+            prog, LOADGEN_SOURCE_CONNS);
+}
+
+static int loadgen_args(int argc, char* argv[], struct loadgen_opts * opts)
+{
+    static const struct option options[] = {
+        { "host", required_argument, NULL, 'H' },
+        { "port", required_argument, NULL, 'p' },
+        { "connections", required_argument, NULL, 'c' },
+        { "duration", required_argument, NULL, 'd' },
+        { "path", required_argument, NULL, 'P' },
+        { "threads", required_argument, NULL, 't' },
+        { "poller", required_argument, NULL, 'i' },
+        { "sources", required_argument, NULL, 's' },
+        { "rate", required_argument, NULL, 'r' },
+        { "histogram", required_argument, NULL, 'o' },
+        { "csv", no_argument, NULL, 'C' },
+        { "idle", no_argument, NULL, 'I' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+
+    opts->sources = -1;     // not given
+    while ((opt = getopt_long(argc, argv, "H:p:c:d:P:t:i:s:r:o:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 'H': opts->host = optarg; break;
+            case 'p': opts->port = atoi(optarg); break;
+            case 'c': opts->conns = atoi(optarg); break;
+            case 'd': opts->seconds = atoi(optarg); break;
+            case 'P': opts->path = optarg; break;
+            case 't': opts->threads = atoi(optarg); break;
+            case 's': opts->sources = atoi(optarg); break;
+            case 'r': opts->rate = atof(optarg); break;
+            case 'o': opts->hist_path = optarg; break;
+            case 'C': opts->csv = true; break;
+            case 'I': opts->idle = true; break;
+            case 'i':
+                if (strcmp(optarg, "select") == 0) {
+                    opts->poller = IOLOOP_SELECT;
+                } else if (strcmp(optarg, "epoll") == 0) {
+                    opts->poller = IOLOOP_EPOLL;
+                } else if (strcmp(optarg, "uring") == 0) {
+                    opts->poller = IOLOOP_URING;
+                } else {
+                    loadgen_usage(stderr, argv[0]);
+                    return -1;
+                }
+                break;
+            case 'h':
+                loadgen_usage(stdout, argv[0]);
+                exit(0);
+            default:
+                loadgen_usage(stderr, argv[0]);
+                return -1;
+        }
+    }
+
+    if (optind < argc || opts->port <= 0 || opts->port > 65535 || opts->conns <= 0 || opts->seconds <= 0 ||
+        opts->threads <= 0 || opts->threads > LOADGEN_THREADS_MAX || opts->rate < 0 || (opts->idle && opts->rate > 0) ||
+        opts->sources > (1 << 24) - 2) {
+        loadgen_usage(stderr, argv[0]);
+        return -1;
+    }
+    opts->threads = (opts->threads > opts->conns)? opts->conns: opts->threads;
+
+    return 0;
+}
+
+// lift the soft fd limit to the hard one, the pollers size their tables on it
+static int loadgen_nofile(void)
+{
+    struct rlimit nofile;
+
+    if (getrlimit(RLIMIT_NOFILE, &nofile) == -1) {
+        return -1;
+    }
+    if (nofile.rlim_cur < nofile.rlim_max) {
+        nofile.rlim_cur = nofile.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &nofile);
+        getrlimit(RLIMIT_NOFILE, &nofile);
+    }
+    loadgen_fds_max = (nofile.rlim_cur < INT_MAX)? (int)nofile.rlim_cur: INT_MAX;
+    loadgen_fds = calloc((size_t)loadgen_fds_max, sizeof(struct loadgen_conn *));
+
+    return (NULL == loadgen_fds)? -1: 0;
+}
+
+static int loadgen_threads_init(struct loadgen_thread * lts)
+{
+    int per = loadgen_opts.conns / loadgen_opts.threads;
+    int extra = loadgen_opts.conns % loadgen_opts.threads;
+    int first = 0;
+
+    for (int i = 0; i < loadgen_opts.threads; i++) {
+        struct loadgen_thread * lt = &lts[i];
+        lt->id = i;
+        lt->conn_count = per + ((i < extra)? 1: 0);
+        lt->conn_first = first;
+        first += lt->conn_count;
+        lt->rate = loadgen_opts.rate * (double)lt->conn_count / (double)loadgen_opts.conns;
+        histogram_init(&lt->hist);
+
+        if (ioloop_poller_get(loadgen_opts.poller, &lt->poller_class) != 0) {
+            fprintf(stderr, "loadgen: no matching poller\n");
+            return -1;
+        }
+        lt->poller_inst = malloc(IOLOOP_INST_SIZE_MAX);
+        lt->conns = calloc((size_t)lt->conn_count, sizeof(struct loadgen_conn));
+        lt->pending = (lt->rate > 0)? malloc(sizeof(uint64_t) * LOADGEN_PENDING_MAX): NULL;
+        if (NULL == lt->poller_inst || NULL == lt->conns || (lt->rate > 0 && NULL == lt->pending)) {
+            perror("loadgen: malloc:");
+            return -1;
+        }
+        if (lt->poller_class.init(lt->poller_inst, -1) == -1) {
+            fprintf(stderr, "loadgen: poller init failed\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void loadgen_report(struct loadgen_thread * lts, double seconds)
+{
+    struct histogram * hist = malloc(sizeof(struct histogram));
+    uint64_t connected = 0;
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    uint64_t dropped = 0;
+
+    if (NULL == hist) {
+        perror("loadgen: malloc:");
+        return;
+    }
+    histogram_init(hist);
+    for (int i = 0; i < loadgen_opts.threads; i++) {
+        histogram_merge(hist, &lts[i].hist);
+        connected += lts[i].connected;
+        requests += lts[i].requests;
+        errors += lts[i].errors;
+        dropped += lts[i].dropped;
+    }
+    double rps = (seconds > 0)? (double)requests / seconds: 0;
+
+    if (loadgen_opts.idle) {
+        printf("loadgen: %llu connections opened, %llu errors in %.2fs\n",
+               (unsigned long long)connected, (unsigned long long)errors, seconds);
+    } else if (loadgen_opts.csv) {
+        printf("requests,errors,seconds,rps,p50_us,p90_us,p99_us,p999_us,max_us\n");
+        printf("%llu,%llu,%.3f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+               (unsigned long long)requests, (unsigned long long)(errors + dropped), seconds, rps,
+               (double)histogram_percentile(hist, 50) / 1e3, (double)histogram_percentile(hist, 90) / 1e3,
+               (double)histogram_percentile(hist, 99) / 1e3, (double)histogram_percentile(hist, 99.9) / 1e3,
+               (double)hist->max / 1e3);
+    } else {
+        printf("loadgen: %llu requests, %llu errors, %llu dropped in %.2fs, %.1f requests/s\n",
+               (unsigned long long)requests, (unsigned long long)errors, (unsigned long long)dropped, seconds, rps);
+        printf("loadgen: latency us p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f p99.99=%.1f max=%.1f mean=%.1f\n",
+               (double)histogram_percentile(hist, 50) / 1e3, (double)histogram_percentile(hist, 90) / 1e3,
+               (double)histogram_percentile(hist, 99) / 1e3, (double)histogram_percentile(hist, 99.9) / 1e3,
+               (double)histogram_percentile(hist, 99.99) / 1e3, (double)hist->max / 1e3,
+               histogram_mean(hist) / 1e3);
+    }
+
+    if (NULL != loadgen_opts.hist_path) {
+        FILE * f = fopen(loadgen_opts.hist_path, "w");
+        if (NULL == f || histogram_print(hist, f, 1e3) == -1) {
+            perror("loadgen: histogram:");
+        }
+        if (NULL != f) {
+            fclose(f);
+        }
+    }
+    free(hist);
+}
+
+int main(int argc, char* argv[])
+{
+    if (loadgen_args(argc, argv, &loadgen_opts) == -1) {
+        return EXIT_FAILURE;
+    }
+
+    memset(&loadgen_addr, 0, sizeof(loadgen_addr));
+    loadgen_addr.sin_family = AF_INET;
+    loadgen_addr.sin_port = htons((uint16_t)loadgen_opts.port);
+    if (inet_pton(AF_INET, loadgen_opts.host, &loadgen_addr.sin_addr) != 1) {
+        fprintf(stderr, "loadgen: invalid host '%s'\n", loadgen_opts.host);
+        return EXIT_FAILURE;
+    }
+
+    // a loopback target can be reached from all of 127.0.0.0/8, one address runs out of ports
+    bool loopback = (ntohl(loadgen_addr.sin_addr.s_addr) >> 24) == 127;
+    if (loadgen_opts.sources < 0) {
+        loadgen_opts.sources = loopback? (loadgen_opts.conns + LOADGEN_SOURCE_CONNS - 1) / LOADGEN_SOURCE_CONNS: 0;
+    } else if (loadgen_opts.sources > 0 && !loopback) {
+        fprintf(stderr, "loadgen: --sources needs a loopback host\n");
+        return EXIT_FAILURE;
+    }
+
+    int len = snprintf(loadgen_request, sizeof(loadgen_request), "GET %s HTTP/1.1\r\nHost: %s:%d\r\n\r\n",
+                       loadgen_opts.path, loadgen_opts.host, loadgen_opts.port);
+    if (len < 0 || (size_t)len >= sizeof(loadgen_request)) {
+        fprintf(stderr, "loadgen: path too long\n");
+        return EXIT_FAILURE;
+    }
+    loadgen_request_len = (size_t)len;
+
+    if (loadgen_nofile() == -1) {
+        perror("loadgen: nofile:");
+        return EXIT_FAILURE;
+    }
+
+    struct loadgen_thread * lts = calloc((size_t)loadgen_opts.threads, sizeof(struct loadgen_thread));
+    if (NULL == lts || loadgen_threads_init(lts) == -1) {
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGINT, loadgen_sigint_handler);
+    signal(SIGPIPE, SIG_IGN);
+
+    uint64_t begin_ns = loadgen_now_ns();
+    loadgen_end_ns = begin_ns + (uint64_t)loadgen_opts.seconds * UINT64_C(1000000000);
+
+    pthread_t ticker;
+    if (pthread_create(&ticker, NULL, loadgen_ticker_run, lts) != 0) {
+        fprintf(stderr, "loadgen: ticker thread failed\n");
+        return EXIT_FAILURE;
+    }
+    int started = 0;
+    for (; started < loadgen_opts.threads; started++) {
+        if (pthread_create(&lts[started].thread, NULL, loadgen_thread_run, &lts[started]) != 0) {
+            fprintf(stderr, "loadgen: thread %d failed\n", started);
+            loadgen_run = 0;
+            break;
+        }
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(lts[i].thread, NULL);
+    }
+    double seconds = (double)(loadgen_now_ns() - begin_ns) / 1e9;
+    loadgen_run = 0;
+    pthread_join(ticker, NULL);
+
+    loadgen_report(lts, seconds);
+
+    for (int i = 0; i < loadgen_opts.threads; i++) {
+        lts[i].poller_class.deinit(lts[i].poller_inst);
+        free(lts[i].poller_inst);
+        free(lts[i].conns);
+        free(lts[i].pending);
+    }
+    free(lts);
+    free(loadgen_fds);
+
+    return EXIT_SUCCESS;
+}
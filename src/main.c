@@ -1,12 +1,21 @@
 // freestanding6
+#include <stddef.h>
 // system
+#include <getopt.h>
+#include <unistd.h>
 // libraries
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 // local
 #include "httpio/poll.h"
 #include "httpio/handler.h"
 #include "httpio/jobpool.h"
+#include "httpio/metrics.h"
+#include "httpio/server.h"
+#include "httpio/topology.h"
+#include "httpio/trace.h"
 #include "httpio/tuple.h"
 
 /* DEFAULT CONFIG */
@@ -23,87 +32,542 @@
 #endif
 
 #define TUPLE_NODE NULL
+
+#ifndef TUPLE_SERVICE
 #define TUPLE_SERVICE "8888"
+#endif
+
+// workers per reactor, 0 lets the lifecycle or the shard split decide
+#ifndef HANDLER_THREADS
+#define HANDLER_THREADS 0
+#endif
+
+// upper bound on connection fds, 0 takes the RLIMIT_NOFILE hard limit
+#ifndef MAX_CON
+#define MAX_CON 0
+#endif
+
+// directory served for GET and HEAD, NULL answers every request with the built-in page
+#ifndef STATIC_ROOT
+#define STATIC_ROOT NULL
+#endif
+
+// responses of at least this many bytes are sent with MSG_ZEROCOPY, 0 always copies
+#ifndef ZEROCOPY_MIN
+#define ZEROCOPY_MIN 0
+#endif
+
+// 1 runs a single ioloop, 0 starts one SO_REUSEPORT reactor per online core
+#ifndef REACTOR_SHARDS
+#define REACTOR_SHARDS 1
+#endif
+
+// file the metrics are kept in for outside readers, NULL keeps them in anonymous memory
+#ifndef METRICS_FILE
+#define METRICS_FILE NULL
+#endif
+
+// file sampled connections are traced to on SIGUSR2 and exit, NULL leaves tracing off
+#ifndef TRACE_FILE
+#define TRACE_FILE NULL
+#endif
+
+// one in this many connections is traced
+#ifndef TRACE_SAMPLE
+#define TRACE_SAMPLE 64
+#endif
+
+// how connections are spread over the shards' listeners, TUPLE_STEER_CPU pins the reactors
+#ifndef TUPLE_STEER
+#define TUPLE_STEER TUPLE_STEER_HASH
+#endif
+
+// cpus reactors and workers are pinned to, "all" for every one available, NULL leaves them unpinned
+#ifndef CPU_LIST
+#define CPU_LIST NULL
+#endif
+
+// ms a client gets to send a whole request head, 0 waits forever
+#ifndef HEADER_TIMEOUT_MS
+#define HEADER_TIMEOUT_MS 20000
+#endif
+
+// ms a keep-alive connection may sit idle between requests, 0 keeps it forever
+#ifndef IDLE_TIMEOUT_MS
+#define IDLE_TIMEOUT_MS 60000
+#endif
+
+// ms a response may make no progress on a full send buffer, 0 waits forever
+#ifndef WRITE_TIMEOUT_MS
+#define WRITE_TIMEOUT_MS 60000
+#endif
+
 
-#define MAX_CON 10000
+#define HANDLER_THREADS_MAX 4096
 
+/* RUNTIME CONFIG */
+// DEVNOTE: The macros above are the defaults. A config file and the command line
+//          override them in the order they are given, so later settings win.
+struct conf_settings {
+    enum TupleClassType tuple_type;
+    ioloop_type_e ioloop_type;
+    handler_lifecycle_e lifecycle;
+    int max_con;
+    const char * service;
+    int threads;
+    int shards;
+    const char * static_root;
+    size_t zerocopy_min;
+    const char * metrics_file;
+    const char * trace_file;
+    unsigned int trace_sample;
+    const char * cpus;
+    enum TupleSteerType steer;
+    unsigned long header_timeout;
+    unsigned long idle_timeout;
+    unsigned long write_timeout;
+};
+
+static struct conf_settings settings = {
+    TUPLE_TYPE, IOLOOP_TYPE, HANDLER_LIFECYCLE, MAX_CON, TUPLE_SERVICE, HANDLER_THREADS,
+    REACTOR_SHARDS, STATIC_ROOT, ZEROCOPY_MIN, METRICS_FILE, TRACE_FILE, TRACE_SAMPLE,
+    CPU_LIST, TUPLE_STEER, HEADER_TIMEOUT_MS, IDLE_TIMEOUT_MS, WRITE_TIMEOUT_MS
+};
+
+struct conf_name {
+    const char * name;
+    int value;
+};
+
+static const struct conf_name conf_tuples[] = {
+    { "inet", TUPLE_INET },
+    { "reuseport", TUPLE_INET_REUSEPORT },
+    { NULL, 0 }
+};
+
+static const struct conf_name conf_steers[] = {
+    { "hash", TUPLE_STEER_HASH },
+    { "cpu", TUPLE_STEER_CPU },
+    { NULL, 0 }
+};
+
+static const struct conf_name conf_ioloops[] = {
+    { "accept", IOLOOP_ACCEPT },
+    { "select", IOLOOP_SELECT },
+    { "epoll", IOLOOP_EPOLL },
+    { "uring", IOLOOP_URING },
+    { NULL, 0 }
+};
+
+static const struct conf_name conf_lifecycles[] = {
+    { "uniprocess", PROCESS_UNIPROCESS },
+    { "fork", PROCESS_FORK },
+    { "threadpool", PROCESS_THREADPOOL },
+    { "worksteal", PROCESS_WORKSTEAL },
+    { NULL, 0 }
+};
+
+static const struct option conf_options[] = {
+    { "config", required_argument, NULL, 'c' },
+    { "tuple", required_argument, NULL, 't' },
+    { "ioloop", required_argument, NULL, 'i' },
+    { "lifecycle", required_argument, NULL, 'l' },
+    { "max-con", required_argument, NULL, 'm' },
+    { "port", required_argument, NULL, 'p' },
+    { "threads", required_argument, NULL, 'w' },
+    { "shards", required_argument, NULL, 's' },
+    { "static-root", required_argument, NULL, 'r' },
+    { "zerocopy-min", required_argument, NULL, 'z' },
+    { "metrics-file", required_argument, NULL, 'M' },
+    { "trace-file", required_argument, NULL, 'T' },
+    { "trace-sample", required_argument, NULL, 'S' },
+    { "cpus", required_argument, NULL, 'C' },
+    { "steer", required_argument, NULL, 'e' },
+    { "header-timeout", required_argument, NULL, 'H' },
+    { "idle-timeout", required_argument, NULL, 'k' },
+    { "write-timeout", required_argument, NULL, 'W' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+};
 
 /* CONFIG RESULT */
 static struct TupleClass tuple;
 static struct handler_lifecycle handler;
 static struct Poller ioloop_type;
-static void *ioloop_inst = NULL;
+static struct poll_shard *shards = NULL;
+static int shard_count = 1;
+static int shard_threads = 0;
+
+
+static void conf_usage(FILE * out, const char * prog)
+{
+    fprintf(out,
+            "usage: %s [options]\n"
+            "  -c, --config FILE        key = value lines, keys are the long option names\n"
+            "  -t, --tuple NAME         inet | reuseport\n"
+            "  -i, --ioloop NAME        accept | select | epoll | uring\n"
+            "  -l, --lifecycle NAME     uniprocess | fork | threadpool | worksteal\n"
+            "  -m, --max-con N          connection fds, 0 for the RLIMIT_NOFILE hard limit\n"
+            "  -p, --port PORT          port to listen on\n"
+            "  -w, --threads N          workers per reactor, 0 to pick automatically\n"
+            "  -s, --shards N           reactors, 0 for one per online core\n"
+            "  -r, --static-root DIR    directory served for GET and HEAD\n"
+            "  -z, --zerocopy-min N     response size from which MSG_ZEROCOPY is used, 0 to always copy\n"
+            "  -M, --metrics-file FILE  keep the metrics in FILE for c10m-stats, /dev/shm for one\n"
+            "  -T, --trace-file FILE    trace sampled connections to FILE on SIGUSR2 and exit, Chrome trace JSON\n"
+            "  -S, --trace-sample N     trace one in N connections, 1 for all\n"
+            "  -C, --cpus LIST          pin reactors and workers to the cpus in LIST, 0-3,8 or all\n"
+            "  -e, --steer NAME         hash | cpu, cpu accepts on the reactor of the connection's rx cpu\n"
+            "  -H, --header-timeout MS  close a client not done sending a request head by then, 0 never does\n"
+            "  -k, --idle-timeout MS    close a keep-alive connection idle that long, 0 never does\n"
+            "  -W, --write-timeout MS   close a client not taking any response bytes that long, 0 never does\n",
+            prog);
+}
+
+static int conf_lookup(const struct conf_name * names, const char * name, int * value)
+{
+    for (; NULL != names->name; names++) {
+        if (strcmp(names->name, name) == 0) {
+            *value = names->value;
+            return 0;
+        }
+    }
 
+    return -1;
+}
+
+static int conf_number(const char * text, long min, long max, long * value)
+{
+    char * end = NULL;
+
+    long temp = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || temp < min || temp > max) {
+        return -1;
+    }
+    *value = temp;
+
+    return 0;
+}
 
-void conf(void) {
+static int conf_file(const char * path);
+
+// apply one setting, opt is the short option it belongs to, -1 when arg is invalid
+static int conf_apply(int opt, const char * arg)
+{
+    int value = 0;
+    long number = 0;
+    int ret = 0;
+
+    switch (opt) {
+        case 'c':
+            ret = conf_file(arg);
+            break;
+        case 't':
+            ret = conf_lookup(conf_tuples, arg, &value);
+            settings.tuple_type = (enum TupleClassType)value;
+            break;
+        case 'i':
+            ret = conf_lookup(conf_ioloops, arg, &value);
+            settings.ioloop_type = (ioloop_type_e)value;
+            break;
+        case 'l':
+            ret = conf_lookup(conf_lifecycles, arg, &value);
+            settings.lifecycle = (handler_lifecycle_e)value;
+            break;
+        case 'm':
+            ret = conf_number(arg, 0, INT_MAX, &number);
+            settings.max_con = (int)number;
+            break;
+        case 'p':
+            ret = conf_number(arg, 1, 65535, &number);
+            settings.service = (ret == 0)? strdup(arg): settings.service; // config file lines don't last
+            break;
+        case 'w':
+            ret = conf_number(arg, 0, HANDLER_THREADS_MAX, &number);
+            settings.threads = (int)number;
+            break;
+        case 's':
+            ret = conf_number(arg, 0, HANDLER_THREADS_MAX, &number);
+            settings.shards = (int)number;
+            break;
+        case 'r':
+            settings.static_root = strdup(arg); // config file lines don't last
+            break;
+        case 'z':
+            ret = conf_number(arg, 0, LONG_MAX, &number);
+            settings.zerocopy_min = (size_t)number;
+            break;
+        case 'M':
+            settings.metrics_file = strdup(arg); // config file lines don't last
+            break;
+        case 'T':
+            settings.trace_file = strdup(arg); // config file lines don't last
+            break;
+        case 'S':
+            ret = conf_number(arg, 1, UINT_MAX, &number);
+            settings.trace_sample = (unsigned int)number;
+            break;
+        case 'C':
+            settings.cpus = strdup(arg); // config file lines don't last
+            break;
+        case 'e':
+            ret = conf_lookup(conf_steers, arg, &value);
+            settings.steer = (enum TupleSteerType)value;
+            break;
+        case 'H':
+            ret = conf_number(arg, 0, LONG_MAX, &number);
+            settings.header_timeout = (unsigned long)number;
+            break;
+        case 'k':
+            ret = conf_number(arg, 0, LONG_MAX, &number);
+            settings.idle_timeout = (unsigned long)number;
+            break;
+        case 'W':
+            ret = conf_number(arg, 0, LONG_MAX, &number);
+            settings.write_timeout = (unsigned long)number;
+            break;
+        default:
+            ret = -1;
+    }
+
+    return ret;
+}
+
+// key = value lines, # starts a comment
+static int conf_file(const char * path)
+{
+    char line[1024];
+    int lineno = 0;
+    int ret = 0;
+
+    FILE * f = fopen(path, "r");
+    if (NULL == f) {
+        perror("conf: config-file");
+        return -1;
+    }
+
+    while (ret == 0 && NULL != fgets(line, sizeof(line), f)) {
+        lineno += 1;
+        line[strcspn(line, "#\r\n")] = '\0';
+
+        char * save = NULL;
+        char * key = strtok_r(line, " \t=", &save);
+        if (NULL == key) {
+            continue;       // blank or comment only
+        }
+        char * value = strtok_r(NULL, " \t=", &save);
+
+        const struct option * o = conf_options;
+        while (NULL != o->name && strcmp(o->name, key) != 0) {
+            o++;
+        }
+        if (NULL == o->name || o->has_arg != required_argument || NULL == value) {
+            fprintf(stderr, "conf: %s:%d: unknown setting '%s'\n", path, lineno, key);
+            ret = -1;
+        } else if (conf_apply(o->val, value) != 0) {
+            fprintf(stderr, "conf: %s:%d: invalid value '%s' for %s\n", path, lineno, value, key);
+            ret = -1;
+        }
+    }
+    fclose(f);
+
+    return ret;
+}
+
+static void conf_args(int argc, char* argv[])
+{
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "c:t:i:l:m:p:w:s:r:z:M:T:S:C:e:H:k:W:h", conf_options, NULL)) != -1) {
+        if (opt == 'h') {
+            conf_usage(stdout, argv[0]);
+            exit(0);
+        } else if (opt == '?') {
+            conf_usage(stderr, argv[0]);
+            exit(1);
+        } else if (conf_apply(opt, optarg) != 0) {
+            fprintf(stderr, "conf: invalid value '%s' for -%c\n", optarg, opt);
+            exit(1);
+        }
+    }
+    if (optind < argc) {
+        conf_usage(stderr, argv[0]);
+        exit(1);
+    }
+}
+
+void conf(int argc, char* argv[]) {
 
     int ret = -1;
 
-    // Assign tuple type based on config
-    ret = tuple_class_get(TUPLE_TYPE, &tuple);
+    conf_args(argc, argv);
+
+    // Work out the number of reactors and the workers each of them gets
+    shard_count = settings.shards;
+    if (shard_count <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        shard_count = (cores > 0)? (int)cores: 1;
+    }
+    if (shard_count > 1) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        shard_threads = (cores > shard_count)? (int)(cores - shard_count) / shard_count: 1;
+        shard_threads = (shard_threads > 0)? shard_threads: 1;
+    }
+    shard_threads = (settings.threads > 0)? settings.threads: shard_threads;
+
+    // steering goes by the cpu a reactor runs on, it has to stay there
+    if (settings.steer == TUPLE_STEER_CPU && settings.cpus == NULL) {
+        settings.cpus = TOPOLOGY_CPUS_ALL;
+    }
+
+    // Assign tuple type based on config, shards each bind their own listener
+    ret = tuple_class_get((shard_count > 1)? TUPLE_INET_REUSEPORT: settings.tuple_type, &tuple);
     if (ret != 0) {
         fprintf(stderr, "conf: no matching tuple module\n");
         exit(1);
     }
     tuple.node = TUPLE_NODE;
-    tuple.service = TUPLE_SERVICE;
+    tuple.service = (char *)settings.service;
 
     // Assign ioloop based on config
-    ret = ioloop_poller_get(IOLOOP_TYPE, &ioloop_type);
+    ret = ioloop_poller_get(settings.ioloop_type, &ioloop_type);
     if (ret != 0) {
         fprintf(stderr, "conf: no matching ioloop module\n");
         exit(1);
     }
-    ioloop_inst = malloc(IOLOOP_INST_SIZE_MAX);
-    if (ioloop_inst == NULL) {
-      fprintf(stderr, "conf: ioloop_inst could not be allocated\n");
+    shards = calloc((size_t)shard_count, sizeof(struct poll_shard));
+    if (shards == NULL) {
+      fprintf(stderr, "conf: shards could not be allocated\n");
       exit(1);
     }
+    for (int i = 0; i < shard_count; i++) {
+      shards[i].server_socket = -1;
+      shards[i].cpu = -1;
+      shards[i].poller_class = &ioloop_type;
+      shards[i].poller_inst = malloc(IOLOOP_INST_SIZE_MAX);
+      shards[i].pool = aligned_alloc(_Alignof(struct jobpool), sizeof(struct jobpool));
+      if (shards[i].poller_inst == NULL || shards[i].pool == NULL) {
+        fprintf(stderr, "conf: ioloop_inst could not be allocated\n");
+        exit(1);
+      }
+    }
 
     // Assign process type based on config
-    ret = handler_lifecycle_get(HANDLER_LIFECYCLE, &handler);
+    ret = handler_lifecycle_get(settings.lifecycle, &handler);
     if (ret != 0) {
         fprintf(stderr, "conf: no matching process module\n");
         exit(1);
     }
+
+    // a forked child can't share the parent's submission ring
+    if (settings.ioloop_type == IOLOOP_URING && settings.lifecycle == PROCESS_FORK) {
+        fprintf(stderr, "conf: IOLOOP_URING does not support PROCESS_FORK\n");
+        exit(1);
+    }
 }    
 
 
 int main(int argc, char* argv[])
 {
   int rc = -1;
-  int server_sock = -1;
 
-  (void)argc;
-  (void)argv;
+  conf(argc, argv);
 
-  conf(); // TODO: elaborate
-
-  rc = tuple.create(&server_sock, tuple.node, tuple.service);
+  // before any poller sizes itself on the fd limit
+  rc = jobpool_table_init(settings.max_con);
   if (rc != 0) {
-    fprintf(stderr, "main: server-create failed");
+    fprintf(stderr, "main: jobtable-create failed");
     return EXIT_FAILURE;
   }
-  
-  rc = jobpool_init(MAX_CON);
+
+  jobpool_zerocopy_init(settings.zerocopy_min);
+  jobpool_timeouts_init(settings.header_timeout, settings.idle_timeout, settings.write_timeout);
+
+  // before any reactor or worker thread claims its slot
+  rc = metrics_init(settings.metrics_file);
   if (rc != 0) {
-    fprintf(stderr, "main: jobpool-create failed");
+    fprintf(stderr, "main: metrics-create failed");
     return EXIT_FAILURE;
   }
 
-  rc = handler.init();
+  trace_init(settings.trace_file, settings.trace_sample);
+
+  // every reactor is placed before the first worker, the workers keep off their cores
+  rc = topology_init(settings.cpus);
   if (rc != 0) {
-    fprintf(stderr, "main: handler-create failed");
+    fprintf(stderr, "main: topology failed");
     return EXIT_FAILURE;
   }
+  for (int i = 0; i < shard_count; i++) {
+    shards[i].cpu = topology_reactor_next();
+  }
+
+  if (settings.static_root != NULL) {
+    rc = server_http_static_init(settings.static_root);
+    if (rc != 0) {
+      fprintf(stderr, "main: static-root failed");
+      return EXIT_FAILURE;
+    }
+  }
+
+  for (int i = 0; i < shard_count; i++) {
+    rc = tuple.create(&shards[i].server_socket, tuple.node, tuple.service);
+    if (rc != 0) {
+      fprintf(stderr, "main: server-create failed");
+      return EXIT_FAILURE;
+    }
+  
+    rc = jobpool_init(shards[i].pool);
+    if (rc != 0) {
+      fprintf(stderr, "main: jobpool-create failed");
+      return EXIT_FAILURE;
+    }
+    shards[i].pool->cpu = shards[i].cpu;
+
+    rc = handler.init(shards[i].pool, shard_threads);
+    if (rc != 0) {
+      fprintf(stderr, "main: handler-create failed");
+      return EXIT_FAILURE;
+    }
+  }
+
+  // once every listener is there, the first listen puts them into the reuseport group
+  if (settings.steer == TUPLE_STEER_CPU && shard_count > 1 && tuple.steer != NULL) {
+    int * sockets = calloc((size_t)shard_count * 2, sizeof(int));
+    if (sockets == NULL) {
+      fprintf(stderr, "main: server-steer failed");
+      return EXIT_FAILURE;
+    }
+    int * cpus = sockets + shard_count;
+    for (int i = 0; i < shard_count; i++) {
+      sockets[i] = shards[i].server_socket;
+      cpus[i] = shards[i].cpu;
+    }
+    rc = tuple.steer(sockets, cpus, shard_count);
+    free(sockets);
+    if (rc != 0) {
+      fprintf(stderr, "main: server-steer failed");
+      return EXIT_FAILURE;
+    }
+  }
 
-  rc = poll_ioloop(server_sock, &ioloop_type, ioloop_inst);
+  if (shard_count > 1) {
+    rc = poll_ioloop_sharded(shards, shard_count);
+  } else {
+    topology_pin_self(shards[0].cpu); // after the workers, they would have inherited it
+    rc = poll_ioloop(shards[0].server_socket, shards[0].poller_class, shards[0].poller_inst, shards[0].pool);
+  }
   if (rc != 0) {
     fprintf(stderr, "main: server-poll failed");
     return EXIT_FAILURE;
   }
 
   printf("Exited ioloop cleanly\n");
+
+  rc = trace_dump();
+  if (rc != 0) {
+    fprintf(stderr, "main: trace-dump failed");
+  }
   
   rc = handler.deinit();
   if (rc != 0) {
@@ -111,10 +575,12 @@ int main(int argc, char* argv[])
     return EXIT_FAILURE;
   }
 
-  rc = tuple.delete(server_sock);
-  if (rc != 0) {
-    fprintf(stderr, "main: server-delete failed");
-    return EXIT_FAILURE;
+  for (int i = 0; i < shard_count; i++) {
+    rc = tuple.delete(shards[i].server_socket);
+    if (rc != 0) {
+      fprintf(stderr, "main: server-delete failed");
+      return EXIT_FAILURE;
+    }
   }
 
   return EXIT_SUCCESS;
@@ -0,0 +1,51 @@
+// freestanding
+#include <stddef.h>
+// system
+#include <unistd.h>
+// libraries
+#include <stdio.h>
+#include <stdlib.h>
+// local
+#include "httpio/metrics.h"
+
+
+// DEVNOTE: Reads the metrics file of a running httpio, started with --metrics-file, from
+//          outside the process. Nothing is sent to the server, the mapping is read-only.
+#define STATS_BUF_SIZE (64 * 1024)
+
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "usage: %s METRICS_FILE [SECONDS]\n"
+                    "  prints the server's metrics, every SECONDS when given\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  int interval = (argc == 3)? atoi(argv[2]): 0;
+
+  const struct metrics_region * region = metrics_map(argv[1]);
+  if (NULL == region) {
+    perror("stats: metrics_map");
+    return EXIT_FAILURE;
+  }
+
+  char * buf = malloc(STATS_BUF_SIZE);
+  if (NULL == buf) {
+    perror("stats: malloc");
+    return EXIT_FAILURE;
+  }
+
+  do {
+    size_t len = metrics_format(region, buf, STATS_BUF_SIZE);
+    fwrite(buf, 1, (len < STATS_BUF_SIZE)? len: STATS_BUF_SIZE - 1, stdout);
+    if (interval > 0) {
+      printf("\n");
+      fflush(stdout);
+      sleep((unsigned int)interval);
+    }
+  } while (interval > 0);
+
+  free(buf);
+
+  return EXIT_SUCCESS;
+}